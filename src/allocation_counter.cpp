@@ -0,0 +1,110 @@
+/**
+ * @file allocation_counter.cpp - counts the allocations libmemcached clients
+ * make in the benchmarks.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+#include "allocation_counter.h"
+
+#include <atomic>
+#include <cstdlib>
+
+static std::atomic<bool> counting_enabled(false);
+static std::atomic<uint64_t> allocation_count(0);
+static std::atomic<uint64_t> allocation_bytes(0);
+
+static void count(size_t size)
+{
+  if (counting_enabled)
+  {
+    allocation_count++;
+    allocation_bytes += size;
+  }
+}
+
+static void* counting_malloc(const memcached_st* client, size_t size, void* context)
+{
+  count(size);
+  return malloc(size);
+}
+
+static void counting_free(const memcached_st* client, void* ptr, void* context)
+{
+  free(ptr);
+}
+
+static void* counting_realloc(const memcached_st* client, void* ptr, size_t size, void* context)
+{
+  count(size);
+  return realloc(ptr, size);
+}
+
+static void* counting_calloc(const memcached_st* client, size_t nelem, size_t elsize, void* context)
+{
+  count(nelem * elsize);
+  return calloc(nelem, elsize);
+}
+
+AllocationCounter::AllocationCounter()
+{
+  allocation_count = 0;
+  allocation_bytes = 0;
+  counting_enabled = true;
+}
+
+AllocationCounter::~AllocationCounter()
+{
+  counting_enabled = false;
+}
+
+uint64_t AllocationCounter::allocations() const
+{
+  return allocation_count;
+}
+
+uint64_t AllocationCounter::bytes() const
+{
+  return allocation_bytes;
+}
+
+void AllocationCounter::count_memcached_client(memcached_st* client)
+{
+  memcached_set_memory_allocators(client,
+                                  counting_malloc,
+                                  counting_free,
+                                  counting_realloc,
+                                  counting_calloc,
+                                  NULL);
+}
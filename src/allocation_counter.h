@@ -0,0 +1,65 @@
+/**
+ * @file allocation_counter.h - counts the allocations libmemcached clients make
+ * in the benchmarks.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+#ifndef ALLOCATION_COUNTER_H__
+#define ALLOCATION_COUNTER_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <libmemcached/memcached.h>
+
+/// Counts the heap allocations made while it is in scope by libmemcached
+/// clients passed to count_memcached_client. Allocations made by other code
+/// (e.g. copying a value into a std::string) aren't counted.
+///
+/// Only one counter may be in scope at a time, and it counts allocations on
+/// all threads, so nothing else should be running while it is in use.
+class AllocationCounter
+{
+public:
+  AllocationCounter();
+  ~AllocationCounter();
+
+  uint64_t allocations() const;
+  uint64_t bytes() const;
+
+  /// Make `client` allocate through the counter (it still uses malloc).
+  static void count_memcached_client(memcached_st* client);
+};
+
+#endif
@@ -0,0 +1,192 @@
+/**
+ * @file benchmark_utils.cpp - helpers for the FV stress tests and benchmarks.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+#include "benchmark_utils.h"
+
+#include <algorithm>
+#include <thread>
+#include <cstdlib>
+#include <cmath>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+uint64_t real_time_ns()
+{
+  struct timespec ts;
+  syscall(SYS_clock_gettime, CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+uint64_t monotonic_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+int64_t realtime_s()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ts.tv_sec;
+}
+
+std::string qualified_key(const std::string& table, const std::string& key)
+{
+  return table + "\\\\" + key;
+}
+
+unsigned long env_or_default(const char* name, unsigned long default_value)
+{
+  char* val = getenv(name);
+  return (val != NULL) ? strtoul(val, NULL, 10) : default_value;
+}
+
+double time_concurrent_ops(unsigned int threads,
+                           uint64_t ops,
+                           std::function<void(unsigned int, uint64_t)> fn)
+{
+  std::vector<std::thread> workers;
+  uint64_t start_ns = real_time_ns();
+
+  for (unsigned int ii = 0; ii < threads; ++ii)
+  {
+    workers.push_back(std::thread([&, ii]()
+    {
+      for (uint64_t op = 0; op < ops; ++op)
+      {
+        fn(ii, op);
+      }
+    }));
+  }
+
+  for (std::vector<std::thread>::iterator t = workers.begin();
+       t != workers.end();
+       ++t)
+  {
+    t->join();
+  }
+
+  return (double)(real_time_ns() - start_ns) / (threads * ops);
+}
+
+std::string patterned_value(size_t size, unsigned int seed)
+{
+  std::string value(size, '\0');
+
+  for (size_t ii = 0; ii < size; ++ii)
+  {
+    value[ii] = 'a' + ((ii + seed) % 26);
+  }
+
+  return value;
+}
+
+ZipfGenerator::ZipfGenerator(size_t n, double theta) : _cdf(n)
+{
+  double total = 0;
+
+  for (size_t ii = 0; ii < n; ++ii)
+  {
+    total += 1.0 / pow(ii + 1, theta);
+    _cdf[ii] = total;
+  }
+
+  for (size_t ii = 0; ii < n; ++ii)
+  {
+    _cdf[ii] /= total;
+  }
+}
+
+size_t ZipfGenerator::next(unsigned int& seed) const
+{
+  double u = rand_r(&seed) / ((double)RAND_MAX + 1);
+  size_t rank = std::lower_bound(_cdf.begin(), _cdf.end(), u) - _cdf.begin();
+  return std::min(rank, _cdf.size() - 1);
+}
+
+void LatencyRecorder::merge(const LatencyRecorder& other)
+{
+  _samples.insert(_samples.end(), other._samples.begin(), other._samples.end());
+}
+
+uint64_t LatencyRecorder::mean() const
+{
+  if (_samples.empty())
+  {
+    return 0;
+  }
+
+  uint64_t total = 0;
+
+  for (std::vector<uint64_t>::const_iterator it = _samples.begin();
+       it != _samples.end();
+       ++it)
+  {
+    total += *it;
+  }
+
+  return total / _samples.size();
+}
+
+uint64_t LatencyRecorder::max() const
+{
+  return _samples.empty() ? 0 : *std::max_element(_samples.begin(),
+                                                  _samples.end());
+}
+
+uint64_t LatencyRecorder::percentile(double pct) const
+{
+  if (_samples.empty())
+  {
+    return 0;
+  }
+
+  std::vector<uint64_t> sorted(_samples);
+  size_t index = (size_t)((pct / 100.0) * (sorted.size() - 1));
+  std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+  return sorted[index];
+}
+
+std::string LatencyRecorder::summary() const
+{
+  return "n=" + std::to_string(count()) +
+         " mean=" + std::to_string(mean() / 1000) + "us" +
+         " p50=" + std::to_string(percentile(50) / 1000) + "us" +
+         " p99=" + std::to_string(percentile(99) / 1000) + "us" +
+         " max=" + std::to_string(max() / 1000) + "us";
+}
@@ -0,0 +1,123 @@
+/**
+ * @file benchmark_utils.h - helpers for the FV stress tests and benchmarks.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+#ifndef BENCHMARK_UTILS_H__
+#define BENCHMARK_UTILS_H__
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <stdint.h>
+
+/// Read the monotonic clock in nanoseconds. This makes the system call
+/// directly so that it is not affected by the test interposer, which may be
+/// controlling time for the rest of the process.
+uint64_t real_time_ns();
+
+/// Read the monotonic clock in milliseconds. Unlike real_time_ns, this goes
+/// through clock_gettime, so tests can control it with the test interposer.
+uint64_t monotonic_ms();
+
+/// Read the real-time clock in seconds, for times that must mean something
+/// after the process exits. Like monotonic_ms, tests can control it.
+int64_t realtime_s();
+
+/// The key that MemcachedStore stores `key` in `table` under.
+std::string qualified_key(const std::string& table, const std::string& key);
+
+/// Read an unsigned integer setting from the environment, returning the
+/// default if it is not set. This is how the benchmarks are sized, e.g.
+/// `SNMP_STRESS_WRITERS=16 make bench`.
+unsigned long env_or_default(const char* name, unsigned long default_value);
+
+/// Run `fn` on `threads` threads at once, each calling it `ops` times (passing
+/// the thread's index and the operation number). Returns the elapsed time
+/// divided by the total number of operations, in nanoseconds - i.e. the
+/// inverse of the aggregate throughput.
+double time_concurrent_ops(unsigned int threads,
+                           uint64_t ops,
+                           std::function<void(unsigned int, uint64_t)> fn);
+
+/// The value sizes swept by the value size tests and benchmarks - from a short
+/// string, through typical registration bindings (tens of KB), up to 1MB.
+static const size_t VALUE_SIZES[] = {16, 256, 4096, 16384, 65536, 262144, 1048576};
+
+/// Build a value of the given size. The contents depend on `seed` and vary
+/// along the value, so a truncated or corrupted copy can't pass as the
+/// original.
+std::string patterned_value(size_t size, unsigned int seed);
+
+/// Generates ranks in [0, n) following a Zipf distribution with exponent
+/// `theta` - so rank 0 is the most popular, rank 1 the next, and so on. A theta
+/// of 0 is uniform; real key popularity is typically around 0.99.
+class ZipfGenerator
+{
+public:
+  ZipfGenerator(size_t n, double theta);
+
+  /// Get the next rank, using (and updating) the caller's random seed.
+  size_t next(unsigned int& seed) const;
+
+private:
+  /// The cumulative probability of each rank.
+  std::vector<double> _cdf;
+};
+
+/// Collects latency samples and reports summary statistics. This is not
+/// thread-safe - each thread should use its own recorder and merge them at the
+/// end of the run.
+class LatencyRecorder
+{
+public:
+  void record(uint64_t latency_ns) { _samples.push_back(latency_ns); }
+  void merge(const LatencyRecorder& other);
+
+  size_t count() const { return _samples.size(); }
+  uint64_t mean() const;
+  uint64_t max() const;
+
+  /// Get the specified percentile (0 - 100) of the recorded samples.
+  uint64_t percentile(double pct) const;
+
+  /// Summarize the recorded samples in microseconds, e.g.
+  /// "n=100 mean=12us p50=10us p99=40us max=52us".
+  std::string summary() const;
+
+private:
+  std::vector<uint64_t> _samples;
+};
+
+#endif
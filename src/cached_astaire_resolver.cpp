@@ -0,0 +1,163 @@
+/**
+ * @file cached_astaire_resolver.cpp - an AstaireResolver that avoids resolving
+ * on every operation.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+#include "cached_astaire_resolver.h"
+#include "benchmark_utils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <arpa/inet.h>
+#include <arpa/nameser.h>
+#include <netinet/in.h>
+
+CachedAstaireResolver::CachedAstaireResolver(DnsCachedResolver* dns_client,
+                                             int address_family,
+                                             int max_ttl_ms) :
+  AstaireResolver(dns_client, address_family),
+  _dns_client(dns_client),
+  _address_family(address_family),
+  _max_ttl_ms(max_ttl_ms),
+  _literal_hits(0),
+  _cache_hits(0),
+  _cache_misses(0)
+{
+}
+
+std::vector<AddrInfo> CachedAstaireResolver::resolve(const std::string& domain,
+                                                     int port,
+                                                     SAS::TrailId trail)
+{
+  std::pair<std::string, int> key(domain, port);
+  Target target;
+
+  {
+    std::unique_lock<std::mutex> lock(_lock);
+    std::map<std::string, Target>::iterator classified = _targets.find(domain);
+
+    if (classified == _targets.end())
+    {
+      classified = _targets.insert(std::make_pair(domain, classify(domain))).first;
+    }
+
+    target = classified->second;
+
+    if (!target.literal)
+    {
+      std::map<std::pair<std::string, int>, Resolved>::iterator resolved =
+        _resolved.find(key);
+
+      if ((resolved != _resolved.end()) && (resolved->second.expiry_ms > monotonic_ms()))
+      {
+        _cache_hits++;
+        return resolved->second.targets;
+      }
+    }
+  }
+
+  if (target.literal)
+  {
+    _literal_hits++;
+
+    AddrInfo ai;
+    ai.address = target.address;
+    ai.port = port;
+    ai.transport = IPPROTO_TCP;
+    ai.priority = 1;
+    ai.weight = 1;
+    return std::vector<AddrInfo>(1, ai);
+  }
+
+  _cache_misses++;
+  std::vector<AddrInfo> targets = AstaireResolver::resolve(domain, port, trail);
+
+  // The resolver doesn't return the TTL, so get it from the DNS cache (which
+  // the resolver has just filled).
+  int ttl_ms = 0;
+
+  if (!targets.empty())
+  {
+    DnsResult result = _dns_client->dns_query(domain,
+                                              (_address_family == AF_INET) ? ns_t_a : ns_t_aaaa,
+                                              trail);
+    ttl_ms = std::min(result.ttl() * 1000, _max_ttl_ms);
+  }
+
+  if (ttl_ms > 0)
+  {
+    std::unique_lock<std::mutex> lock(_lock);
+    Resolved& resolved = _resolved[key];
+    resolved.targets = targets;
+    resolved.expiry_ms = monotonic_ms() + ttl_ms;
+  }
+
+  return targets;
+}
+
+void CachedAstaireResolver::flush()
+{
+  std::unique_lock<std::mutex> lock(_lock);
+  _resolved.clear();
+}
+
+CachedAstaireResolver::Target CachedAstaireResolver::classify(const std::string& domain)
+{
+  Target target;
+  target.literal = false;
+  memset(&target.address, 0, sizeof(target.address));
+
+  // IPv6 literals may be bracketed.
+  std::string host = domain;
+
+  if ((host.size() > 2) && (host[0] == '[') && (host[host.size() - 1] == ']'))
+  {
+    host = host.substr(1, host.size() - 2);
+  }
+
+  if (inet_pton(AF_INET, host.c_str(), &target.address.addr.ipv4) == 1)
+  {
+    target.literal = true;
+    target.address.af = AF_INET;
+  }
+  else if (inet_pton(AF_INET6, host.c_str(), &target.address.addr.ipv6) == 1)
+  {
+    target.literal = true;
+    target.address.af = AF_INET6;
+  }
+
+  return target;
+}
@@ -0,0 +1,118 @@
+/**
+ * @file cached_astaire_resolver.h - an AstaireResolver that avoids resolving
+ * on every operation.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+#ifndef CACHED_ASTAIRE_RESOLVER_H__
+#define CACHED_ASTAIRE_RESOLVER_H__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <stdint.h>
+
+#include "astaire_resolver.h"
+
+/// An AstaireResolver for TopologyNeutralMemcachedStore that doesn't do the
+/// full resolution on every store operation.
+///
+/// - Each target string is classified the first time it is seen. IP literals
+///   (e.g. "127.0.0.1" or "[::1]") are then returned directly, without
+///   touching DNS.
+/// - The targets a domain resolves to are cached for the domain's DNS TTL
+///   (capped at `max_ttl_ms`), so repeated operations don't re-run the
+///   resolver.
+///
+/// A cached target list isn't updated when the store blacklists one of the
+/// targets, so the cap bounds how long a failed Astaire keeps being returned.
+/// Call flush() to drop the cached lists early.
+class CachedAstaireResolver : public AstaireResolver
+{
+public:
+  static const int DEFAULT_MAX_TTL_MS = 5000;
+
+  CachedAstaireResolver(DnsCachedResolver* dns_client,
+                        int address_family,
+                        int max_ttl_ms = DEFAULT_MAX_TTL_MS);
+  virtual ~CachedAstaireResolver() {};
+
+  virtual std::vector<AddrInfo> resolve(const std::string& domain,
+                                        int port,
+                                        SAS::TrailId trail);
+
+  /// Drop the cached target lists.
+  void flush();
+
+  /// The number of resolutions answered from an IP literal, from the cache,
+  /// and by the underlying resolver.
+  uint64_t literal_hits() const { return _literal_hits; }
+  uint64_t cache_hits() const { return _cache_hits; }
+  uint64_t cache_misses() const { return _cache_misses; }
+
+private:
+  /// How a target string was classified.
+  struct Target
+  {
+    bool literal;
+    IP46Address address;
+  };
+
+  /// A cached target list, with the time (from monotonic_ms) it expires.
+  struct Resolved
+  {
+    std::vector<AddrInfo> targets;
+    uint64_t expiry_ms;
+  };
+
+  /// Work out whether `domain` is an IP literal.
+  static Target classify(const std::string& domain);
+
+  DnsCachedResolver* _dns_client;
+  int _address_family;
+  int _max_ttl_ms;
+
+  std::mutex _lock;
+  std::map<std::string, Target> _targets;
+  std::map<std::pair<std::string, int>, Resolved> _resolved;
+
+  std::atomic<uint64_t> _literal_hits;
+  std::atomic<uint64_t> _cache_hits;
+  std::atomic<uint64_t> _cache_misses;
+};
+
+#endif
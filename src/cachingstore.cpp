@@ -0,0 +1,219 @@
+/**
+ * @file cachingstore.cpp - a store with an in-process cache of recently read values.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+#include "cachingstore.h"
+#include "benchmark_utils.h"
+
+
+CachingStore::CachingStore(Store* store,
+                           Mode mode,
+                           size_t capacity,
+                           int ttl_ms,
+                           size_t shards,
+                           Validator validator) :
+  _store(store),
+  _mode(mode),
+  _shard_capacity((capacity + shards - 1) / shards),
+  _ttl_ms(ttl_ms),
+  _validator(validator),
+  _shards(shards),
+  _hits(0),
+  _misses(0)
+{
+  if ((_mode == VALIDATE) && (!_validator))
+  {
+    _validator = [this](const std::string& table,
+                        const std::string& key,
+                        uint64_t& cas) -> Status
+    {
+      std::string data;
+      return _store->get_data(table, key, data, cas);
+    };
+  }
+}
+
+CachingStore::~CachingStore()
+{
+  delete _store; _store = NULL;
+}
+
+Store::Status CachingStore::get_data(const std::string& table,
+                                     const std::string& key,
+                                     std::string& data,
+                                     uint64_t& cas,
+                                     SAS::TrailId trail)
+{
+  std::string ckey = qualified_key(table, key);
+  std::string cached_data;
+  uint64_t cached_cas;
+  uint64_t generation;
+
+  if (lookup(ckey, cached_data, cached_cas, generation))
+  {
+    uint64_t current_cas = 0;
+
+    if ((_mode == TTL) ||
+        ((_validator(table, key, current_cas) == Status::OK) &&
+         (current_cas == cached_cas)))
+    {
+      _hits++;
+      data.swap(cached_data);
+      cas = cached_cas;
+      return Status::OK;
+    }
+
+    invalidate(ckey);
+    generation++;
+  }
+
+  _misses++;
+  Status status = _store->get_data(table, key, data, cas, trail);
+
+  if (status == Status::OK)
+  {
+    insert(ckey, data, cas, generation);
+  }
+
+  return status;
+}
+
+Store::Status CachingStore::set_data(const std::string& table,
+                                     const std::string& key,
+                                     const std::string& data,
+                                     uint64_t cas,
+                                     int expiry,
+                                     SAS::TrailId trail)
+{
+  // The store doesn't tell us the new CAS, so we can't cache the new value.
+  // Invalidate the entry even if the write fails, as that is normally because
+  // someone else has changed it.
+  Status status = _store->set_data(table, key, data, cas, expiry, trail);
+  invalidate(qualified_key(table, key));
+  return status;
+}
+
+Store::Status CachingStore::delete_data(const std::string& table,
+                                        const std::string& key,
+                                        SAS::TrailId trail)
+{
+  Status status = _store->delete_data(table, key, trail);
+  invalidate(qualified_key(table, key));
+  return status;
+}
+
+CachingStore::Shard& CachingStore::shard(const std::string& cache_key)
+{
+  return _shards[std::hash<std::string>()(cache_key) % _shards.size()];
+}
+
+bool CachingStore::lookup(const std::string& cache_key,
+                          std::string& data,
+                          uint64_t& cas,
+                          uint64_t& generation)
+{
+  Shard& s = shard(cache_key);
+  std::lock_guard<std::mutex> guard(s.lock);
+  generation = s.generation;
+
+  auto it = s.index.find(cache_key);
+
+  if (it == s.index.end())
+  {
+    return false;
+  }
+
+  if (it->second->expiry_ms <= monotonic_ms())
+  {
+    s.lru.erase(it->second);
+    s.index.erase(it);
+    return false;
+  }
+
+  // Move the entry to the front of the LRU list.
+  s.lru.splice(s.lru.begin(), s.lru, it->second);
+  data = it->second->data;
+  cas = it->second->cas;
+  return true;
+}
+
+void CachingStore::insert(const std::string& cache_key,
+                          const std::string& data,
+                          uint64_t cas,
+                          uint64_t generation)
+{
+  Shard& s = shard(cache_key);
+  std::lock_guard<std::mutex> guard(s.lock);
+
+  if (s.generation != generation)
+  {
+    return;
+  }
+
+  auto it = s.index.find(cache_key);
+
+  if (it != s.index.end())
+  {
+    s.lru.erase(it->second);
+    s.index.erase(it);
+  }
+
+  Entry entry = {cache_key, data, cas, monotonic_ms() + _ttl_ms};
+  s.lru.push_front(entry);
+  s.index[cache_key] = s.lru.begin();
+
+  // Evict the least recently used entries if the shard is over capacity.
+  while (s.lru.size() > _shard_capacity)
+  {
+    s.index.erase(s.lru.back().key);
+    s.lru.pop_back();
+  }
+}
+
+void CachingStore::invalidate(const std::string& cache_key)
+{
+  Shard& s = shard(cache_key);
+  std::lock_guard<std::mutex> guard(s.lock);
+  s.generation++;
+
+  auto it = s.index.find(cache_key);
+
+  if (it != s.index.end())
+  {
+    s.lru.erase(it->second);
+    s.index.erase(it);
+  }
+}
@@ -0,0 +1,164 @@
+/**
+ * @file cachingstore.h - a store with an in-process cache of recently read values.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+#ifndef CACHINGSTORE_H__
+#define CACHINGSTORE_H__
+
+#include <string>
+#include <list>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <atomic>
+#include <mutex>
+
+#include "store.h"
+
+/// A store that keeps the values it has recently read from (or seen written
+/// to) another store in an in-process cache, so hot keys don't have to be
+/// re-read from memcached on every request.
+///
+/// The cache is a bounded LRU, split into shards (each with its own lock) so
+/// that threads reading different keys don't contend. The store invalidates
+/// its own entries when it writes or deletes a key, but can't see writes made
+/// through other stores, so it supports two modes:
+///
+/// - TTL: a cached value is used for up to `ttl_ms` after it was read, so may
+///   be up to that stale.
+/// - VALIDATE: a cached value is only used if its CAS still matches the CAS in
+///   the underlying store, as returned by the validator.
+class CachingStore : public Store
+{
+public:
+  enum Mode { TTL, VALIDATE };
+
+  /// Gets the current CAS of a key. This returns NOT_FOUND if the key doesn't
+  /// exist.
+  typedef std::function<Status(const std::string& table,
+                               const std::string& key,
+                               uint64_t& cas)> Validator;
+
+  /// Create a caching store on top of `store`, which it takes ownership of.
+  /// The cache holds up to `capacity` values, split over `shards` shards.
+  ///
+  /// In VALIDATE mode, if no validator is supplied the underlying store is used
+  /// (reading the whole value). This is only a saving if reading the value
+  /// through the underlying store is expensive (e.g. it must be
+  /// decompressed).
+  CachingStore(Store* store,
+               Mode mode,
+               size_t capacity,
+               int ttl_ms,
+               size_t shards = 16,
+               Validator validator = Validator());
+  virtual ~CachingStore();
+
+  virtual Status get_data(const std::string& table,
+                          const std::string& key,
+                          std::string& data,
+                          uint64_t& cas,
+                          SAS::TrailId trail = 0);
+
+  virtual Status set_data(const std::string& table,
+                          const std::string& key,
+                          const std::string& data,
+                          uint64_t cas,
+                          int expiry,
+                          SAS::TrailId trail = 0);
+
+  virtual Status delete_data(const std::string& table,
+                             const std::string& key,
+                             SAS::TrailId trail = 0);
+
+  /// The number of reads served from the cache, and not.
+  uint64_t hits() const { return _hits; }
+  uint64_t misses() const { return _misses; }
+
+private:
+  struct Entry
+  {
+    std::string key;
+    std::string data;
+    uint64_t cas;
+    uint64_t expiry_ms;
+  };
+
+  /// A shard of the cache. The list is in order of use (most recent first),
+  /// and the map indexes it by key. The generation counts invalidations, so
+  /// that a value read from the store isn't cached if it might have been
+  /// overwritten while it was being read.
+  struct Shard
+  {
+    Shard() : generation(0) {};
+
+    std::mutex lock;
+    std::list<Entry> lru;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    uint64_t generation;
+  };
+
+  Shard& shard(const std::string& cache_key);
+
+  /// Look up a key in the cache. Returns false if it isn't cached (or its
+  /// entry has expired). Also returns the shard's generation, to pass to
+  /// insert.
+  bool lookup(const std::string& cache_key,
+              std::string& data,
+              uint64_t& cas,
+              uint64_t& generation);
+
+  /// Cache a value, unless the shard has had an invalidation since
+  /// `generation`.
+  void insert(const std::string& cache_key,
+              const std::string& data,
+              uint64_t cas,
+              uint64_t generation);
+  void invalidate(const std::string& cache_key);
+
+
+  Store* _store;
+  Mode _mode;
+  size_t _shard_capacity;
+  int _ttl_ms;
+  Validator _validator;
+  std::vector<Shard> _shards;
+
+  std::atomic<uint64_t> _hits;
+  std::atomic<uint64_t> _misses;
+};
+
+#endif
@@ -0,0 +1,120 @@
+/**
+ * @file child_time.cpp - controlling the time in the processes the tests
+ * start.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+#include "child_time.h"
+#include "test_interposer.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+static ChildTimeControl* control = NULL;
+
+bool child_time_init()
+{
+  if (control != NULL)
+  {
+    return true;
+  }
+
+  std::string file = child_time_file();
+  int fd = open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+
+  if (fd < 0)
+  {
+    perror("open child time file");
+    return false;
+  }
+
+  if (ftruncate(fd, sizeof(ChildTimeControl)) != 0)
+  {
+    perror("ftruncate child time file");
+    close(fd);
+    return false;
+  }
+
+  void* mem = mmap(NULL,
+                   sizeof(ChildTimeControl),
+                   PROT_READ | PROT_WRITE,
+                   MAP_SHARED,
+                   fd,
+                   0);
+  close(fd);
+
+  if (mem == MAP_FAILED)
+  {
+    perror("mmap child time file");
+    return false;
+  }
+
+  control = new (mem) ChildTimeControl;
+  control->offset_ns = 0;
+
+  // Make sure the processes we start can find the file, however it was named.
+  setenv(CHILD_TIME_FILE_ENV, file.c_str(), 1);
+  return true;
+}
+
+std::string child_time_file()
+{
+  const char* file = getenv(CHILD_TIME_FILE_ENV);
+  return (file != NULL) ? file : "./child_time_control";
+}
+
+void advance_all_clocks_ms(long delta_ms)
+{
+  cwtest_advance_time_ms(delta_ms);
+
+  if (control != NULL)
+  {
+    control->offset_ns += (int64_t)delta_ms * 1000000;
+  }
+}
+
+void reset_all_clocks()
+{
+  cwtest_reset_time();
+
+  if (control != NULL)
+  {
+    control->offset_ns = 0;
+  }
+}
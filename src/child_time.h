@@ -0,0 +1,85 @@
+/**
+ * @file child_time.h - controlling the time in the processes the tests
+ * start.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+#ifndef CHILD_TIME_H__
+#define CHILD_TIME_H__
+
+#include <string>
+#include <atomic>
+#include <stdint.h>
+
+/// The test interposer only controls the time in the test process itself. To
+/// control the time in the processes that the tests start (memcached, Astaire
+/// and dnsmasq), those processes are run with child_time_interposer.so
+/// preloaded, which offsets their clocks by the amount in this control block.
+/// The block lives in a memory-mapped file (named by the CHILD_TIME_FILE_ENV
+/// environment variable) so the tests can change it while they run.
+struct ChildTimeControl
+{
+  std::atomic<int64_t> offset_ns;
+};
+
+/// The environment variable that tells the interposer where the control file
+/// is.
+static const char* const CHILD_TIME_FILE_ENV = "FVTEST_CHILD_TIME_FILE";
+
+/// The interposer. The Makefile passes in its absolute path, so that the tests
+/// can be run from any directory - the default is relative to src/.
+#ifndef CHILD_TIME_INTERPOSER_PATH
+#define CHILD_TIME_INTERPOSER_PATH "../build/obj/fvtest/child_time_interposer.so"
+#endif
+static const char* const CHILD_TIME_INTERPOSER = CHILD_TIME_INTERPOSER_PATH;
+
+/// Create and map the control file, if that hasn't already been done. Returns
+/// false if it can't be created.
+bool child_time_init();
+
+/// The control file.
+std::string child_time_file();
+
+/// Move the clocks of the test process and every process started with virtual
+/// time on by `delta_ms`. Use this rather than cwtest_advance_time_ms in tests
+/// that depend on the time in other processes.
+void advance_all_clocks_ms(long delta_ms);
+
+/// Undo any changes to the clocks. Clocks mustn't go backwards in running
+/// processes, so only do this once the processes using virtual time have been
+/// killed.
+void reset_all_clocks();
+
+#endif
@@ -0,0 +1,162 @@
+/**
+ * @file child_time_interposer.cpp - moves the clocks of the processes the
+ * tests start.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+// This is preloaded into the processes that the tests start with virtual time
+// (see child_time.h), rather than being linked into the tests. It offsets
+// each clock (other than the CPU time clocks) by the amount in the control
+// file.
+
+#include "child_time.h"
+
+#include <cstdlib>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/select.h>
+
+static ChildTimeControl* control = NULL;
+
+static int (*real_clock_gettime)(clockid_t, struct timespec*);
+static int (*real_gettimeofday)(struct timeval*, void*);
+static time_t (*real_time)(time_t*);
+
+__attribute__((constructor))
+static void init()
+{
+  real_clock_gettime = (int (*)(clockid_t, struct timespec*))
+                         dlsym(RTLD_NEXT, "clock_gettime");
+  real_gettimeofday = (int (*)(struct timeval*, void*))
+                         dlsym(RTLD_NEXT, "gettimeofday");
+  real_time = (time_t (*)(time_t*))dlsym(RTLD_NEXT, "time");
+
+  // Without a control file the clocks are left alone.
+  const char* file = getenv(CHILD_TIME_FILE_ENV);
+  int fd = (file != NULL) ? open(file, O_RDWR) : -1;
+
+  if (fd >= 0)
+  {
+    void* mem = mmap(NULL,
+                     sizeof(ChildTimeControl),
+                     PROT_READ | PROT_WRITE,
+                     MAP_SHARED,
+                     fd,
+                     0);
+    close(fd);
+
+    if (mem != MAP_FAILED)
+    {
+      control = (ChildTimeControl*)mem;
+    }
+  }
+}
+
+static int64_t offset_ns()
+{
+  return (control != NULL) ? control->offset_ns.load() : 0;
+}
+
+extern "C" int clock_gettime(clockid_t clk_id, struct timespec* tp)
+{
+  if (real_clock_gettime == NULL)
+  {
+    init();
+  }
+
+  int rc = real_clock_gettime(clk_id, tp);
+
+  if ((rc == 0) &&
+      (clk_id != CLOCK_PROCESS_CPUTIME_ID) &&
+      (clk_id != CLOCK_THREAD_CPUTIME_ID))
+  {
+    int64_t ns = (int64_t)tp->tv_nsec + offset_ns();
+    tp->tv_sec += ns / 1000000000;
+    tp->tv_nsec = ns % 1000000000;
+
+    if (tp->tv_nsec < 0)
+    {
+      tp->tv_sec -= 1;
+      tp->tv_nsec += 1000000000;
+    }
+  }
+
+  return rc;
+}
+
+extern "C" int gettimeofday(struct timeval* tv, void* tz)
+{
+  if (real_gettimeofday == NULL)
+  {
+    init();
+  }
+
+  int rc = real_gettimeofday(tv, tz);
+
+  if ((rc == 0) && (tv != NULL))
+  {
+    int64_t us = (int64_t)tv->tv_usec + (offset_ns() / 1000);
+    tv->tv_sec += us / 1000000;
+    tv->tv_usec = us % 1000000;
+
+    if (tv->tv_usec < 0)
+    {
+      tv->tv_sec -= 1;
+      tv->tv_usec += 1000000;
+    }
+  }
+
+  return rc;
+}
+
+extern "C" time_t time(time_t* t)
+{
+  if (real_time == NULL)
+  {
+    init();
+  }
+
+  time_t now = real_time(NULL) + (offset_ns() / 1000000000);
+
+  if (t != NULL)
+  {
+    *t = now;
+  }
+
+  return now;
+}
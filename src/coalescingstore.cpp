@@ -0,0 +1,135 @@
+/**
+ * @file coalescingstore.cpp - a store that shares concurrent reads of the
+ * same key.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+#include "coalescingstore.h"
+#include "benchmark_utils.h"
+
+CoalescingStore::CoalescingStore(Store* store) :
+  _store(store),
+  _fetches(0),
+  _coalesced(0)
+{
+}
+
+CoalescingStore::~CoalescingStore()
+{
+  delete _store; _store = NULL;
+}
+
+Store::Status CoalescingStore::get_data(const std::string& table,
+                                        const std::string& key,
+                                        std::string& data,
+                                        uint64_t& cas,
+                                        SAS::TrailId trail)
+{
+  std::string fkey = qualified_key(table, key);
+  std::unique_lock<std::mutex> lock(_lock);
+  std::unordered_map<std::string, std::shared_ptr<Fetch>>::iterator it =
+    _in_flight.find(fkey);
+
+  if (it != _in_flight.end())
+  {
+    // Wait for the read in flight and share its result.
+    std::shared_ptr<Fetch> fetch = it->second;
+    fetch->waiters++;
+    _coalesced++;
+    fetch->cond.wait(lock, [&fetch]() { return fetch->done; });
+
+    data = fetch->data;
+    cas = fetch->cas;
+    return fetch->status;
+  }
+
+  std::shared_ptr<Fetch> fetch(new Fetch());
+  _in_flight[fkey] = fetch;
+  lock.unlock();
+
+  _fetches++;
+  Status status = _store->get_data(table, key, data, cas, trail);
+
+  lock.lock();
+  fetch->done = true;
+  fetch->status = status;
+  fetch->cas = cas;
+
+  // Only copy the data if someone is waiting for it. No-one else can join
+  // once the fetch is done.
+  if (fetch->waiters > 0)
+  {
+    fetch->data = data;
+  }
+
+  // A write may have detached this fetch (and another read may have started a
+  // new one).
+  it = _in_flight.find(fkey);
+
+  if ((it != _in_flight.end()) && (it->second == fetch))
+  {
+    _in_flight.erase(it);
+  }
+
+  lock.unlock();
+  fetch->cond.notify_all();
+
+  return status;
+}
+
+Store::Status CoalescingStore::set_data(const std::string& table,
+                                        const std::string& key,
+                                        const std::string& data,
+                                        uint64_t cas,
+                                        int expiry,
+                                        SAS::TrailId trail)
+{
+  detach(qualified_key(table, key));
+  return _store->set_data(table, key, data, cas, expiry, trail);
+}
+
+Store::Status CoalescingStore::delete_data(const std::string& table,
+                                           const std::string& key,
+                                           SAS::TrailId trail)
+{
+  detach(qualified_key(table, key));
+  return _store->delete_data(table, key, trail);
+}
+
+void CoalescingStore::detach(const std::string& fetch_key)
+{
+  std::unique_lock<std::mutex> lock(_lock);
+  _in_flight.erase(fetch_key);
+}
@@ -0,0 +1,123 @@
+/**
+ * @file coalescingstore.h - a store that shares concurrent reads of the
+ * same key.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+#ifndef COALESCINGSTORE_H__
+#define COALESCINGSTORE_H__
+
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <condition_variable>
+#include <atomic>
+#include <mutex>
+
+#include "store.h"
+
+/// A store that coalesces concurrent reads of the same key. While a read of a
+/// key is in flight to another store (e.g. a TopologyNeutralMemcachedStore),
+/// other reads of that key wait for it and return its result - the same
+/// status, data and CAS - rather than each making its own round trip.
+///
+/// Readers that share a fetch share its CAS, so at most one of them can write
+/// the key back with it. The rest get DATA_CONTENTION and must re-read, as
+/// they would if they had read the key separately and lost the race.
+///
+/// Writes and deletes made through this store detach any in-flight read of
+/// the key, so a read that starts after a write never returns data from
+/// before it. This store can't see writes made through other stores, so a
+/// read can return data that was overwritten elsewhere while the fetch it
+/// joined was in flight, just as it could if it had overlapped the write.
+///
+/// Only the reader that makes the fetch logs it to its SAS trail.
+class CoalescingStore : public Store
+{
+public:
+  /// Create a coalescing store on top of `store`, which it takes ownership of.
+  CoalescingStore(Store* store);
+  virtual ~CoalescingStore();
+
+  virtual Status get_data(const std::string& table,
+                          const std::string& key,
+                          std::string& data,
+                          uint64_t& cas,
+                          SAS::TrailId trail = 0);
+
+  virtual Status set_data(const std::string& table,
+                          const std::string& key,
+                          const std::string& data,
+                          uint64_t cas,
+                          int expiry,
+                          SAS::TrailId trail = 0);
+
+  virtual Status delete_data(const std::string& table,
+                             const std::string& key,
+                             SAS::TrailId trail = 0);
+
+  /// The number of reads passed on to the underlying store, and the number
+  /// that shared another read's fetch instead.
+  uint64_t fetches() const { return _fetches; }
+  uint64_t coalesced() const { return _coalesced; }
+
+private:
+  /// A read in flight to the underlying store. This is protected by the
+  /// store's lock.
+  struct Fetch
+  {
+    Fetch() : done(false), waiters(0), status(Status::ERROR), cas(0) {};
+
+    std::condition_variable cond;
+    bool done;
+    int waiters;
+    Status status;
+    std::string data;
+    uint64_t cas;
+  };
+
+  /// Stop new reads of a key joining the read in flight for it (if any).
+  void detach(const std::string& fetch_key);
+
+  Store* _store;
+
+  std::mutex _lock;
+  std::unordered_map<std::string, std::shared_ptr<Fetch>> _in_flight;
+
+  std::atomic<uint64_t> _fetches;
+  std::atomic<uint64_t> _coalesced;
+};
+
+#endif
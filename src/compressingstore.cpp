@@ -0,0 +1,190 @@
+/**
+ * @file compressingstore.cpp - a store that compresses large values.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+#include "compressingstore.h"
+#include "log.h"
+
+#include <zlib.h>
+
+/// Values written by a CompressingStore start with this if they are
+/// compressed (or would otherwise be mistaken for a compressed value). Values
+/// in Clearwater are text, so never start with a NUL.
+static const std::string MAGIC("\0CZ", 3);
+
+/// The byte following the magic, saying how the rest of the value is encoded.
+static const char COMPRESSED = 'z';
+static const char RAW = 'r';
+
+/// Compressed values store their uncompressed length (as a 4 byte big-endian
+/// integer) before the zlib data.
+static const size_t HEADER_SIZE = MAGIC.length() + 1 + 4;
+
+CompressingStore::CompressingStore(Store* store, int level) :
+  _store(store),
+  _level(level),
+  _min_sizes()
+{
+}
+
+CompressingStore::~CompressingStore()
+{
+  delete _store; _store = NULL;
+}
+
+void CompressingStore::compress_table(const std::string& table, size_t min_size)
+{
+  _min_sizes[table] = min_size;
+}
+
+Store::Status CompressingStore::get_data(const std::string& table,
+                                         const std::string& key,
+                                         std::string& data,
+                                         uint64_t& cas,
+                                         SAS::TrailId trail)
+{
+  std::string stored;
+  Status status = _store->get_data(table, key, stored, cas, trail);
+
+  if ((status == Status::OK) && (!decode(stored, data)))
+  {
+    TRC_ERROR("Failed to decode value of %s in table %s",
+              key.c_str(), table.c_str());
+    status = Status::ERROR;
+  }
+
+  return status;
+}
+
+Store::Status CompressingStore::set_data(const std::string& table,
+                                         const std::string& key,
+                                         const std::string& data,
+                                         uint64_t cas,
+                                         int expiry,
+                                         SAS::TrailId trail)
+{
+  return _store->set_data(table, key, encode(table, data), cas, expiry, trail);
+}
+
+Store::Status CompressingStore::delete_data(const std::string& table,
+                                            const std::string& key,
+                                            SAS::TrailId trail)
+{
+  return _store->delete_data(table, key, trail);
+}
+
+std::string CompressingStore::encode(const std::string& table,
+                                     const std::string& data) const
+{
+  std::map<std::string, size_t>::const_iterator min_size = _min_sizes.find(table);
+
+  if ((min_size != _min_sizes.end()) &&
+      (data.length() >= min_size->second) &&
+      (data.length() <= 0xFFFFFFFF))
+  {
+    uLongf compressed_len = compressBound(data.length());
+    std::string encoded(HEADER_SIZE + compressed_len, '\0');
+
+    if (compress2((Bytef*)&encoded[HEADER_SIZE],
+                  &compressed_len,
+                  (const Bytef*)data.data(),
+                  data.length(),
+                  _level) == Z_OK)
+    {
+      encoded.resize(HEADER_SIZE + compressed_len);
+
+      // Only use the compressed value if it is smaller.
+      if (encoded.length() < data.length())
+      {
+        encoded.replace(0, MAGIC.length(), MAGIC);
+        encoded[MAGIC.length()] = COMPRESSED;
+
+        for (int ii = 0; ii < 4; ++ii)
+        {
+          encoded[MAGIC.length() + 1 + ii] = (char)(data.length() >> (8 * (3 - ii)));
+        }
+
+        return encoded;
+      }
+    }
+  }
+
+  if (data.compare(0, MAGIC.length(), MAGIC) == 0)
+  {
+    // This value looks like an encoded value, so mark it as raw.
+    return MAGIC + RAW + data;
+  }
+
+  return data;
+}
+
+bool CompressingStore::decode(const std::string& stored, std::string& data)
+{
+  if ((stored.compare(0, MAGIC.length(), MAGIC) != 0) ||
+      (stored.length() == MAGIC.length()))
+  {
+    // Not encoded.
+    data = stored;
+    return true;
+  }
+
+  if (stored[MAGIC.length()] == RAW)
+  {
+    data = stored.substr(MAGIC.length() + 1);
+    return true;
+  }
+
+  if ((stored[MAGIC.length()] != COMPRESSED) || (stored.length() < HEADER_SIZE))
+  {
+    return false;
+  }
+
+  uLongf length = 0;
+
+  for (int ii = 0; ii < 4; ++ii)
+  {
+    length = (length << 8) | (unsigned char)stored[MAGIC.length() + 1 + ii];
+  }
+
+  uLongf uncompressed_len = length;
+  data.assign(length, '\0');
+
+  return ((uncompress((Bytef*)&data[0],
+                      &uncompressed_len,
+                      (const Bytef*)&stored[HEADER_SIZE],
+                      stored.length() - HEADER_SIZE) == Z_OK) &&
+          (uncompressed_len == length));
+}
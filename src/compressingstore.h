@@ -0,0 +1,100 @@
+/**
+ * @file compressingstore.h - a store that compresses large values.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+#ifndef COMPRESSINGSTORE_H__
+#define COMPRESSINGSTORE_H__
+
+#include <string>
+#include <map>
+
+#include "store.h"
+
+/// A store that compresses values before writing them to another store (e.g.
+/// a MemcachedStore or TopologyNeutralMemcachedStore), and decompresses them
+/// when they are read back.
+///
+/// Compression is enabled per table, for values of at least a minimum size.
+/// Compressed values start with a header that an uncompressed value can't
+/// start with, so a compressing store can read values written by a store that
+/// doesn't compress (e.g. during an upgrade). The reverse is only true of
+/// values below the table's minimum size (or in tables that aren't compressed).
+class CompressingStore : public Store
+{
+public:
+  /// Create a compressing store on top of `store`, which it takes ownership of.
+  /// `level` is the zlib compression level (1 is fastest, 9 is smallest).
+  CompressingStore(Store* store, int level = 1);
+  virtual ~CompressingStore();
+
+  /// Compress values written to `table` that are at least `min_size` bytes.
+  /// This must be called before the store is used.
+  void compress_table(const std::string& table, size_t min_size);
+
+  virtual Status get_data(const std::string& table,
+                          const std::string& key,
+                          std::string& data,
+                          uint64_t& cas,
+                          SAS::TrailId trail = 0);
+
+  virtual Status set_data(const std::string& table,
+                          const std::string& key,
+                          const std::string& data,
+                          uint64_t cas,
+                          int expiry,
+                          SAS::TrailId trail = 0);
+
+  virtual Status delete_data(const std::string& table,
+                             const std::string& key,
+                             SAS::TrailId trail = 0);
+
+  /// Encode a value to be written to `table`, compressing it if that is
+  /// enabled for the table and makes the value smaller.
+  std::string encode(const std::string& table, const std::string& data) const;
+
+  /// Decode a value read from the underlying store. Returns false if the
+  /// value is corrupt.
+  static bool decode(const std::string& stored, std::string& data);
+
+private:
+  Store* _store;
+  int _level;
+
+  /// The minimum size of value that is compressed in each table.
+  std::map<std::string, size_t> _min_sizes;
+};
+
+#endif
@@ -0,0 +1,157 @@
+/**
+ * @file direct_memcached_store.cpp - a store that talks to memcached directly
+ * rather than through Astaire.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+#include "direct_memcached_store.h"
+#include "benchmark_utils.h"
+
+#include <cstring>
+#include <sys/stat.h>
+
+DirectMemcachedStore::DirectMemcachedStore(const std::string& cluster_settings,
+                                           Store* astaire_store,
+                                           bool binary,
+                                           int check_interval_ms) :
+  _cluster_settings(cluster_settings),
+  _config_reader(cluster_settings),
+  _direct_store(new MemcachedStore(binary,
+                                   new MemcachedConfigFileReader(cluster_settings),
+                                   true)),
+  _astaire_store(astaire_store),
+  _check_interval_ms(check_interval_ms),
+  _next_check_ms(0),
+  _size(-1),
+  _direct(false),
+  _direct_ops(0),
+  _astaire_ops(0)
+{
+  memset(&_mtime, 0, sizeof(_mtime));
+  check_config();
+}
+
+DirectMemcachedStore::~DirectMemcachedStore()
+{
+  delete _direct_store; _direct_store = NULL;
+  delete _astaire_store; _astaire_store = NULL;
+}
+
+Store::Status DirectMemcachedStore::get_data(const std::string& table,
+                                             const std::string& key,
+                                             std::string& data,
+                                             uint64_t& cas,
+                                             SAS::TrailId trail)
+{
+  return choose_store()->get_data(table, key, data, cas, trail);
+}
+
+Store::Status DirectMemcachedStore::set_data(const std::string& table,
+                                             const std::string& key,
+                                             const std::string& data,
+                                             uint64_t cas,
+                                             int expiry,
+                                             SAS::TrailId trail)
+{
+  return choose_store()->set_data(table, key, data, cas, expiry, trail);
+}
+
+Store::Status DirectMemcachedStore::delete_data(const std::string& table,
+                                                const std::string& key,
+                                                SAS::TrailId trail)
+{
+  return choose_store()->delete_data(table, key, trail);
+}
+
+Store* DirectMemcachedStore::choose_store()
+{
+  if (monotonic_ms() >= _next_check_ms)
+  {
+    check_config();
+  }
+
+  if (_direct)
+  {
+    _direct_ops++;
+    return _direct_store;
+  }
+  else
+  {
+    _astaire_ops++;
+    return _astaire_store;
+  }
+}
+
+void DirectMemcachedStore::check_config()
+{
+  std::unique_lock<std::mutex> lock(_lock);
+  _next_check_ms = monotonic_ms() + _check_interval_ms;
+
+  struct stat st;
+
+  if (stat(_cluster_settings.c_str(), &st) != 0)
+  {
+    // Without cluster_settings we don't know where the data is, but Astaire
+    // may still do.
+    _direct = false;
+    _size = -1;
+    return;
+  }
+
+  if ((st.st_mtim.tv_sec == _mtime.tv_sec) &&
+      (st.st_mtim.tv_nsec == _mtime.tv_nsec) &&
+      (st.st_size == _size))
+  {
+    return;
+  }
+
+  _mtime = st.st_mtim;
+  _size = st.st_size;
+
+  MemcachedConfig config;
+
+  if (!_config_reader.read_config(config) || config.servers.empty())
+  {
+    _direct = false;
+    return;
+  }
+
+  // A resize is only in progress if new_servers differs from servers.
+  bool resizing = (!config.new_servers.empty()) &&
+                  (config.new_servers != config.servers);
+
+  _direct_store->update_config();
+  _direct = !resizing;
+}
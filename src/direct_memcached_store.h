@@ -0,0 +1,125 @@
+/**
+ * @file direct_memcached_store.h - a store that talks to memcached directly
+ * rather than through Astaire.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+#ifndef DIRECT_MEMCACHED_STORE_H__
+#define DIRECT_MEMCACHED_STORE_H__
+
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <time.h>
+#include <sys/types.h>
+
+#include "memcachedstore.h"
+
+/// A store that reads the same cluster_settings file as Astaire and talks to
+/// the memcached instances directly (with a MemcachedStore, which picks the
+/// same replicas for each key as Astaire does), saving the hop through
+/// Astaire on every operation.
+///
+/// While the cluster is being resized (cluster_settings lists new_servers)
+/// Astaire is moving data between the memcached instances, so the store sends
+/// operations through Astaire instead. It does the same if it can't read
+/// cluster_settings.
+///
+/// The store checks cluster_settings for changes at most once every
+/// `check_interval_ms` (0 to check before every operation), so it may take up
+/// to that long to notice a resize has started.
+class DirectMemcachedStore : public Store
+{
+public:
+  static const int DEFAULT_CHECK_INTERVAL_MS = 1000;
+
+  /// Create a direct store for the cluster described by `cluster_settings`,
+  /// falling back to `astaire_store`, which it takes ownership of.
+  DirectMemcachedStore(const std::string& cluster_settings,
+                       Store* astaire_store,
+                       bool binary = true,
+                       int check_interval_ms = DEFAULT_CHECK_INTERVAL_MS);
+  virtual ~DirectMemcachedStore();
+
+  virtual Status get_data(const std::string& table,
+                          const std::string& key,
+                          std::string& data,
+                          uint64_t& cas,
+                          SAS::TrailId trail = 0);
+
+  virtual Status set_data(const std::string& table,
+                          const std::string& key,
+                          const std::string& data,
+                          uint64_t cas,
+                          int expiry,
+                          SAS::TrailId trail = 0);
+
+  virtual Status delete_data(const std::string& table,
+                             const std::string& key,
+                             SAS::TrailId trail = 0);
+
+  /// Whether operations are currently going directly to memcached.
+  bool direct() const { return _direct; }
+
+  /// The number of operations sent directly to memcached, and through Astaire.
+  uint64_t direct_ops() const { return _direct_ops; }
+  uint64_t astaire_ops() const { return _astaire_ops; }
+
+private:
+  /// Check cluster_settings (if it's due) and return the store to use.
+  Store* choose_store();
+
+  /// Re-read cluster_settings if it has changed since it was last read.
+  void check_config();
+
+
+  std::string _cluster_settings;
+  MemcachedConfigFileReader _config_reader;
+  MemcachedStore* _direct_store;
+  Store* _astaire_store;
+  int _check_interval_ms;
+
+  /// Protects the details of the last version of cluster_settings read.
+  std::mutex _lock;
+  std::atomic<uint64_t> _next_check_ms;
+  struct timespec _mtime;
+  off_t _size;
+
+  std::atomic<bool> _direct;
+  std::atomic<uint64_t> _direct_ops;
+  std::atomic<uint64_t> _astaire_ops;
+};
+
+#endif
@@ -0,0 +1,944 @@
+/**
+ * @file fake_memcached.cpp - an in-process stand-in for memcached.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+#include "fake_memcached.h"
+#include "benchmark_utils.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <vector>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+/// Relative expiry times are limited to 30 days - anything larger is an
+/// absolute Unix time.
+static const int64_t MAX_RELATIVE_EXPIRY = 60 * 60 * 24 * 30;
+
+static const char* VERSION = "1.4.14-fake";
+
+// Binary protocol magic bytes, opcodes and statuses.
+static const uint8_t REQUEST_MAGIC = 0x80;
+static const uint8_t RESPONSE_MAGIC = 0x81;
+static const size_t HEADER_LEN = 24;
+
+enum Opcode
+{
+  OP_GET = 0x00,
+  OP_SET = 0x01,
+  OP_ADD = 0x02,
+  OP_REPLACE = 0x03,
+  OP_DELETE = 0x04,
+  OP_INCREMENT = 0x05,
+  OP_DECREMENT = 0x06,
+  OP_QUIT = 0x07,
+  OP_FLUSH = 0x08,
+  OP_GETQ = 0x09,
+  OP_NOOP = 0x0a,
+  OP_VERSION = 0x0b,
+  OP_GETK = 0x0c,
+  OP_GETKQ = 0x0d,
+  OP_APPEND = 0x0e,
+  OP_PREPEND = 0x0f,
+  OP_STAT = 0x10,
+  OP_SETQ = 0x11,
+  OP_ADDQ = 0x12,
+  OP_REPLACEQ = 0x13,
+  OP_DELETEQ = 0x14,
+  OP_INCREMENTQ = 0x15,
+  OP_DECREMENTQ = 0x16,
+  OP_QUITQ = 0x17,
+  OP_FLUSHQ = 0x18,
+  OP_APPENDQ = 0x19,
+  OP_PREPENDQ = 0x1a,
+  OP_TOUCH = 0x1c,
+};
+
+enum BinaryStatus
+{
+  STATUS_OK = 0x0000,
+  STATUS_KEY_ENOENT = 0x0001,
+  STATUS_KEY_EEXISTS = 0x0002,
+  STATUS_EINVAL = 0x0004,
+  STATUS_NOT_STORED = 0x0005,
+  STATUS_UNKNOWN_COMMAND = 0x0081,
+};
+
+static uint64_t read_be(const std::string& buf, size_t offset, size_t len)
+{
+  uint64_t value = 0;
+
+  for (size_t ii = 0; ii < len; ++ii)
+  {
+    value = (value << 8) | (uint8_t)buf[offset + ii];
+  }
+
+  return value;
+}
+
+static void write_be(std::string& buf, uint64_t value, size_t len)
+{
+  for (size_t ii = len; ii > 0; --ii)
+  {
+    buf.push_back((char)((value >> ((ii - 1) * 8)) & 0xff));
+  }
+}
+
+/// Append a binary protocol response to `response`.
+static void binary_response(std::string& response,
+                            uint8_t opcode,
+                            uint16_t status,
+                            uint32_t opaque,
+                            uint64_t cas,
+                            const std::string& extras = "",
+                            const std::string& key = "",
+                            const std::string& value = "")
+{
+  response.push_back((char)RESPONSE_MAGIC);
+  response.push_back((char)opcode);
+  write_be(response, key.size(), 2);
+  response.push_back((char)extras.size());
+  response.push_back(0);
+  write_be(response, status, 2);
+  write_be(response, extras.size() + key.size() + value.size(), 4);
+  write_be(response, opaque, 4);
+  write_be(response, cas, 8);
+  response.append(extras);
+  response.append(key);
+  response.append(value);
+}
+
+FakeMemcachedServer::FakeMemcachedServer(const std::string& ip, int port) :
+  _ip(ip),
+  _port(port),
+  _running(false),
+  _listen_fd(-1),
+  _next_cas(1),
+  _gets(0),
+  _sets(0)
+{
+}
+
+FakeMemcachedServer::~FakeMemcachedServer()
+{
+  kill_instance();
+}
+
+bool FakeMemcachedServer::start_instance()
+{
+  if (_running)
+  {
+    return true;
+  }
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(_port);
+
+  if (inet_pton(AF_INET, _ip.c_str(), &addr.sin_addr) != 1)
+  {
+    fprintf(stderr, "Invalid fake memcached address %s\n", _ip.c_str());
+    return false;
+  }
+
+  _listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  int reuse = 1;
+  setsockopt(_listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  if ((bind(_listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) ||
+      (listen(_listen_fd, 64) != 0))
+  {
+    perror("fake memcached bind/listen");
+    close(_listen_fd); _listen_fd = -1;
+    return false;
+  }
+
+  _running = true;
+  _listener = std::thread(&FakeMemcachedServer::listen_thread_fn, this);
+  return true;
+}
+
+bool FakeMemcachedServer::kill_instance()
+{
+  if (!_running)
+  {
+    return true;
+  }
+
+  // Shutting down the listening socket wakes up the listener thread's accept.
+  _running = false;
+  shutdown(_listen_fd, SHUT_RDWR);
+  _listener.join();
+  close(_listen_fd); _listen_fd = -1;
+
+  // Shut down each connection, which wakes up its thread, and wait for them
+  // all to close.
+  {
+    std::unique_lock<std::mutex> lock(_connections_lock);
+
+    for (std::set<int>::iterator fd = _connections.begin();
+         fd != _connections.end();
+         ++fd)
+    {
+      shutdown(*fd, SHUT_RDWR);
+    }
+
+    while (!_connections.empty())
+    {
+      _connections_cond.wait(lock);
+    }
+  }
+
+  // Like a real memcached, the data doesn't survive the server being killed.
+  std::unique_lock<std::mutex> lock(_lock);
+  _items.clear();
+  return true;
+}
+
+size_t FakeMemcachedServer::item_count()
+{
+  std::unique_lock<std::mutex> lock(_lock);
+  uint64_t now = monotonic_ms();
+  size_t count = 0;
+
+  for (std::map<std::string, Item>::iterator item = _items.begin();
+       item != _items.end();
+       ++item)
+  {
+    if ((item->second.expiry_ms == 0) || (item->second.expiry_ms > now))
+    {
+      ++count;
+    }
+  }
+
+  return count;
+}
+
+void FakeMemcachedServer::listen_thread_fn()
+{
+  while (_running)
+  {
+    int fd = accept(_listen_fd, NULL, NULL);
+
+    if (fd < 0)
+    {
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(_connections_lock);
+
+    if (!_running)
+    {
+      close(fd);
+      break;
+    }
+
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    // The connection threads are detached - they remove themselves from the
+    // set of connections when they finish, which is what kill_instance waits
+    // for.
+    _connections.insert(fd);
+    std::thread(&FakeMemcachedServer::connection_thread_fn, this, fd).detach();
+  }
+}
+
+void FakeMemcachedServer::connection_thread_fn(int fd)
+{
+  std::string buffer;
+  std::string response;
+  char chunk[16384];
+  bool open = true;
+
+  while (open)
+  {
+    ssize_t len = recv(fd, chunk, sizeof(chunk), 0);
+
+    if (len <= 0)
+    {
+      break;
+    }
+
+    buffer.append(chunk, len);
+
+    // Handle all the complete requests that we've received. A connection can
+    // switch between the protocols, so check each request's first byte.
+    size_t handled;
+
+    do
+    {
+      handled = buffer.size();
+      open = ((uint8_t)buffer[0] == REQUEST_MAGIC) ?
+               handle_binary(buffer, response) :
+               handle_text(buffer, response);
+    }
+    while ((open) && (!buffer.empty()) && (buffer.size() < handled));
+
+    if (!response.empty())
+    {
+      if (send(fd, response.data(), response.size(), MSG_NOSIGNAL) !=
+          (ssize_t)response.size())
+      {
+        open = false;
+      }
+
+      response.clear();
+    }
+  }
+
+  std::unique_lock<std::mutex> lock(_connections_lock);
+  _connections.erase(fd);
+  close(fd);
+  _connections_cond.notify_all();
+}
+
+bool FakeMemcachedServer::handle_text(std::string& buffer, std::string& response)
+{
+  size_t eol = buffer.find("\r\n");
+
+  if (eol == std::string::npos)
+  {
+    return true;
+  }
+
+  std::vector<std::string> words;
+  std::istringstream line(buffer.substr(0, eol));
+  std::string word;
+
+  while (line >> word)
+  {
+    words.push_back(word);
+  }
+
+  size_t consumed = eol + 2;
+  bool noreply = ((!words.empty()) && (words.back() == "noreply"));
+  std::string reply;
+
+  if (words.empty())
+  {
+    reply = "ERROR\r\n";
+  }
+  else if ((words[0] == "get") || (words[0] == "gets"))
+  {
+    for (size_t ii = 1; ii < words.size(); ++ii)
+    {
+      Item item;
+
+      if (get(words[ii], item))
+      {
+        reply += "VALUE " + words[ii] + " " + std::to_string(item.flags) +
+                 " " + std::to_string(item.data.size());
+
+        if (words[0] == "gets")
+        {
+          reply += " " + std::to_string(item.cas);
+        }
+
+        reply += "\r\n" + item.data + "\r\n";
+      }
+    }
+
+    reply += "END\r\n";
+  }
+  else if ((words[0] == "set") ||
+           (words[0] == "add") ||
+           (words[0] == "replace") ||
+           (words[0] == "append") ||
+           (words[0] == "prepend") ||
+           (words[0] == "cas"))
+  {
+    bool is_cas = (words[0] == "cas");
+
+    if (words.size() < (is_cas ? 6u : 5u))
+    {
+      reply = "CLIENT_ERROR bad command line format\r\n";
+    }
+    else
+    {
+      size_t bytes = strtoul(words[4].c_str(), NULL, 10);
+
+      // Wait for the whole data block (and its terminator) to arrive.
+      if (buffer.size() < consumed + bytes + 2)
+      {
+        return true;
+      }
+
+      std::string data = buffer.substr(consumed, bytes);
+      consumed += bytes + 2;
+
+      Mode mode = (words[0] == "add") ? ADD :
+                  (words[0] == "replace") ? REPLACE :
+                  (words[0] == "append") ? APPEND :
+                  (words[0] == "prepend") ? PREPEND :
+                  SET;
+      uint64_t cas = is_cas ? strtoull(words[5].c_str(), NULL, 10) : 0;
+      uint64_t new_cas;
+      Result result = store(mode,
+                            words[1],
+                            data,
+                            strtoul(words[2].c_str(), NULL, 10),
+                            strtoll(words[3].c_str(), NULL, 10),
+                            cas,
+                            new_cas);
+      reply = (result == STORED) ? "STORED\r\n" :
+              (result == EXISTS) ? "EXISTS\r\n" :
+              (result == NOT_FOUND) ? "NOT_FOUND\r\n" :
+              "NOT_STORED\r\n";
+    }
+  }
+  else if ((words[0] == "delete") && (words.size() >= 2))
+  {
+    reply = (remove(words[1], 0) == STORED) ? "DELETED\r\n" : "NOT_FOUND\r\n";
+  }
+  else if (((words[0] == "incr") || (words[0] == "decr")) && (words.size() >= 3))
+  {
+    uint64_t value;
+    uint64_t new_cas;
+    Result result = arithmetic(words[1],
+                               (words[0] == "incr"),
+                               strtoull(words[2].c_str(), NULL, 10),
+                               value,
+                               new_cas);
+    reply = (result == STORED) ? std::to_string(value) + "\r\n" :
+            (result == NOT_FOUND) ? "NOT_FOUND\r\n" :
+            "CLIENT_ERROR cannot increment or decrement non-numeric value\r\n";
+  }
+  else if ((words[0] == "touch") && (words.size() >= 3))
+  {
+    reply = touch(words[1], strtoll(words[2].c_str(), NULL, 10)) ?
+              "TOUCHED\r\n" : "NOT_FOUND\r\n";
+  }
+  else if (words[0] == "flush_all")
+  {
+    flush();
+    reply = "OK\r\n";
+  }
+  else if (words[0] == "version")
+  {
+    reply = std::string("VERSION ") + VERSION + "\r\n";
+  }
+  else if (words[0] == "stats")
+  {
+    std::map<std::string, std::string> values = stats();
+
+    for (std::map<std::string, std::string>::iterator stat = values.begin();
+         stat != values.end();
+         ++stat)
+    {
+      reply += "STAT " + stat->first + " " + stat->second + "\r\n";
+    }
+
+    reply += "END\r\n";
+  }
+  else if (words[0] == "quit")
+  {
+    buffer.clear();
+    return false;
+  }
+  else
+  {
+    reply = "ERROR\r\n";
+  }
+
+  buffer.erase(0, consumed);
+
+  if (!noreply)
+  {
+    response += reply;
+  }
+
+  return true;
+}
+
+bool FakeMemcachedServer::handle_binary(std::string& buffer, std::string& response)
+{
+  if (buffer.size() < HEADER_LEN)
+  {
+    return true;
+  }
+
+  uint8_t opcode = buffer[1];
+  size_t key_len = read_be(buffer, 2, 2);
+  size_t extras_len = (uint8_t)buffer[4];
+  size_t body_len = read_be(buffer, 8, 4);
+  uint32_t opaque = read_be(buffer, 12, 4);
+  uint64_t cas = read_be(buffer, 16, 8);
+
+  if (buffer.size() < HEADER_LEN + body_len)
+  {
+    return true;
+  }
+
+  if (extras_len + key_len > body_len)
+  {
+    binary_response(response, opcode, STATUS_EINVAL, opaque, 0);
+    buffer.clear();
+    return false;
+  }
+
+  std::string extras = buffer.substr(HEADER_LEN, extras_len);
+  std::string key = buffer.substr(HEADER_LEN + extras_len, key_len);
+  std::string value = buffer.substr(HEADER_LEN + extras_len + key_len,
+                                    body_len - extras_len - key_len);
+  buffer.erase(0, HEADER_LEN + body_len);
+
+  switch (opcode)
+  {
+  case OP_GET:
+  case OP_GETQ:
+  case OP_GETK:
+  case OP_GETKQ:
+    {
+      bool quiet = ((opcode == OP_GETQ) || (opcode == OP_GETKQ));
+      bool with_key = ((opcode == OP_GETK) || (opcode == OP_GETKQ));
+      Item item;
+
+      if (get(key, item))
+      {
+        std::string flags;
+        write_be(flags, item.flags, 4);
+        binary_response(response, opcode, STATUS_OK, opaque, item.cas,
+                        flags, with_key ? key : "", item.data);
+      }
+      else if (!quiet)
+      {
+        binary_response(response, opcode, STATUS_KEY_ENOENT, opaque, 0,
+                        "", with_key ? key : "");
+      }
+    }
+    break;
+
+  case OP_SET:
+  case OP_SETQ:
+  case OP_ADD:
+  case OP_ADDQ:
+  case OP_REPLACE:
+  case OP_REPLACEQ:
+  case OP_APPEND:
+  case OP_APPENDQ:
+  case OP_PREPEND:
+  case OP_PREPENDQ:
+    {
+      bool quiet = ((opcode == OP_SETQ) ||
+                    (opcode == OP_ADDQ) ||
+                    (opcode == OP_REPLACEQ) ||
+                    (opcode == OP_APPENDQ) ||
+                    (opcode == OP_PREPENDQ));
+      Mode mode = ((opcode == OP_ADD) || (opcode == OP_ADDQ)) ? ADD :
+                  ((opcode == OP_REPLACE) || (opcode == OP_REPLACEQ)) ? REPLACE :
+                  ((opcode == OP_APPEND) || (opcode == OP_APPENDQ)) ? APPEND :
+                  ((opcode == OP_PREPEND) || (opcode == OP_PREPENDQ)) ? PREPEND :
+                  SET;
+
+      // Set, add and replace have the flags and expiry as extras; append and
+      // prepend have no extras.
+      uint32_t flags = 0;
+      int64_t exptime = 0;
+
+      if ((mode != APPEND) && (mode != PREPEND))
+      {
+        if (extras_len != 8)
+        {
+          binary_response(response, opcode, STATUS_EINVAL, opaque, 0);
+          break;
+        }
+
+        flags = read_be(extras, 0, 4);
+        exptime = read_be(extras, 4, 4);
+      }
+
+      uint64_t new_cas = 0;
+      Result result = store(mode, key, value, flags, exptime, cas, new_cas);
+      uint16_t status = (result == STORED) ? STATUS_OK :
+                        (result == EXISTS) ? STATUS_KEY_EEXISTS :
+                        (result == NOT_FOUND) ? STATUS_KEY_ENOENT :
+                        STATUS_NOT_STORED;
+
+      // The binary protocol reports why an add or replace wasn't stored.
+      if ((status == STATUS_NOT_STORED) && (mode == ADD))
+      {
+        status = STATUS_KEY_EEXISTS;
+      }
+      else if ((status == STATUS_NOT_STORED) && (mode == REPLACE))
+      {
+        status = STATUS_KEY_ENOENT;
+      }
+
+      if ((status != STATUS_OK) || (!quiet))
+      {
+        binary_response(response, opcode, status, opaque, new_cas);
+      }
+    }
+    break;
+
+  case OP_DELETE:
+  case OP_DELETEQ:
+    {
+      Result result = remove(key, cas);
+      uint16_t status = (result == STORED) ? STATUS_OK :
+                        (result == EXISTS) ? STATUS_KEY_EEXISTS :
+                        STATUS_KEY_ENOENT;
+
+      if ((status != STATUS_OK) || (opcode == OP_DELETE))
+      {
+        binary_response(response, opcode, status, opaque, 0);
+      }
+    }
+    break;
+
+  case OP_INCREMENT:
+  case OP_INCREMENTQ:
+  case OP_DECREMENT:
+  case OP_DECREMENTQ:
+    {
+      if (extras_len != 20)
+      {
+        binary_response(response, opcode, STATUS_EINVAL, opaque, 0);
+        break;
+      }
+
+      // An expiry of all ones means that a missing counter shouldn't be
+      // created.
+      uint32_t exptime = read_be(extras, 16, 4);
+      uint64_t counter;
+      uint64_t new_cas = 0;
+      Result result = arithmetic(key,
+                                 ((opcode == OP_INCREMENT) || (opcode == OP_INCREMENTQ)),
+                                 read_be(extras, 0, 8),
+                                 counter,
+                                 new_cas,
+                                 (exptime != 0xffffffff),
+                                 read_be(extras, 8, 8),
+                                 exptime);
+
+      if (result == STORED)
+      {
+        if ((opcode == OP_INCREMENT) || (opcode == OP_DECREMENT))
+        {
+          std::string body;
+          write_be(body, counter, 8);
+          binary_response(response, opcode, STATUS_OK, opaque, new_cas, "", "", body);
+        }
+      }
+      else
+      {
+        binary_response(response, opcode,
+                        (result == NOT_FOUND) ? STATUS_KEY_ENOENT : STATUS_EINVAL,
+                        opaque, 0);
+      }
+    }
+    break;
+
+  case OP_TOUCH:
+    {
+      if (extras_len != 4)
+      {
+        binary_response(response, opcode, STATUS_EINVAL, opaque, 0);
+        break;
+      }
+
+      binary_response(response, opcode,
+                      touch(key, read_be(extras, 0, 4)) ? STATUS_OK : STATUS_KEY_ENOENT,
+                      opaque, 0);
+    }
+    break;
+
+  case OP_FLUSH:
+  case OP_FLUSHQ:
+    flush();
+
+    if (opcode == OP_FLUSH)
+    {
+      binary_response(response, opcode, STATUS_OK, opaque, 0);
+    }
+    break;
+
+  case OP_NOOP:
+    binary_response(response, opcode, STATUS_OK, opaque, 0);
+    break;
+
+  case OP_VERSION:
+    binary_response(response, opcode, STATUS_OK, opaque, 0, "", "", VERSION);
+    break;
+
+  case OP_STAT:
+    {
+      // Each statistic is sent in its own response, followed by an empty one.
+      std::map<std::string, std::string> values = stats();
+
+      for (std::map<std::string, std::string>::iterator stat = values.begin();
+           stat != values.end();
+           ++stat)
+      {
+        binary_response(response, opcode, STATUS_OK, opaque, 0,
+                        "", stat->first, stat->second);
+      }
+
+      binary_response(response, opcode, STATUS_OK, opaque, 0);
+    }
+    break;
+
+  case OP_QUIT:
+  case OP_QUITQ:
+    if (opcode == OP_QUIT)
+    {
+      binary_response(response, opcode, STATUS_OK, opaque, 0);
+    }
+    buffer.clear();
+    return false;
+
+  default:
+    // This includes TAP, which Astaire uses to resynchronise.
+    binary_response(response, opcode, STATUS_UNKNOWN_COMMAND, opaque, 0);
+    break;
+  }
+
+  return true;
+}
+
+FakeMemcachedServer::Result FakeMemcachedServer::store(Mode mode,
+                                                       const std::string& key,
+                                                       const std::string& data,
+                                                       uint32_t flags,
+                                                       int64_t exptime,
+                                                       uint64_t cas,
+                                                       uint64_t& new_cas)
+{
+  std::unique_lock<std::mutex> lock(_lock);
+  std::map<std::string, Item>::iterator existing = find_live(key);
+  ++_sets;
+
+  if (cas != 0)
+  {
+    // A CAS only succeeds if the item is unchanged since it was read.
+    if (existing == _items.end())
+    {
+      return NOT_FOUND;
+    }
+    else if (existing->second.cas != cas)
+    {
+      return EXISTS;
+    }
+  }
+
+  if (((mode == ADD) && (existing != _items.end())) ||
+      ((mode != ADD) && (mode != SET) && (existing == _items.end())))
+  {
+    return NOT_STORED;
+  }
+
+  Item& item = _items[key];
+  new_cas = _next_cas++;
+  item.cas = new_cas;
+
+  if (mode == APPEND)
+  {
+    item.data += data;
+  }
+  else if (mode == PREPEND)
+  {
+    item.data = data + item.data;
+  }
+  else
+  {
+    item.data = data;
+    item.flags = flags;
+    item.expiry_ms = expiry_ms(exptime);
+  }
+
+  return STORED;
+}
+
+bool FakeMemcachedServer::get(const std::string& key, Item& item)
+{
+  std::unique_lock<std::mutex> lock(_lock);
+  std::map<std::string, Item>::iterator existing = find_live(key);
+  ++_gets;
+
+  if (existing == _items.end())
+  {
+    return false;
+  }
+
+  item = existing->second;
+  return true;
+}
+
+FakeMemcachedServer::Result FakeMemcachedServer::remove(const std::string& key,
+                                                        uint64_t cas)
+{
+  std::unique_lock<std::mutex> lock(_lock);
+  std::map<std::string, Item>::iterator existing = find_live(key);
+
+  if (existing == _items.end())
+  {
+    return NOT_FOUND;
+  }
+  else if ((cas != 0) && (existing->second.cas != cas))
+  {
+    return EXISTS;
+  }
+
+  _items.erase(existing);
+  return STORED;
+}
+
+FakeMemcachedServer::Result FakeMemcachedServer::arithmetic(const std::string& key,
+                                                            bool incr,
+                                                            uint64_t delta,
+                                                            uint64_t& value,
+                                                            uint64_t& new_cas,
+                                                            bool create,
+                                                            uint64_t initial,
+                                                            int64_t exptime)
+{
+  std::unique_lock<std::mutex> lock(_lock);
+  std::map<std::string, Item>::iterator existing = find_live(key);
+  new_cas = _next_cas++;
+
+  if (existing == _items.end())
+  {
+    if (!create)
+    {
+      return NOT_FOUND;
+    }
+
+    Item& item = _items[key];
+    item.data = std::to_string(initial);
+    item.flags = 0;
+    item.cas = new_cas;
+    item.expiry_ms = expiry_ms(exptime);
+    value = initial;
+    return STORED;
+  }
+
+  // The value must be a decimal number. As in memcached, decrementing stops
+  // at zero, but incrementing wraps.
+  const std::string& data = existing->second.data;
+
+  if ((data.empty()) ||
+      (data.find_first_not_of("0123456789") != std::string::npos))
+  {
+    return NOT_STORED;
+  }
+
+  uint64_t current = strtoull(data.c_str(), NULL, 10);
+  value = incr ? current + delta : ((current > delta) ? current - delta : 0);
+  existing->second.data = std::to_string(value);
+  existing->second.cas = new_cas;
+  return STORED;
+}
+
+bool FakeMemcachedServer::touch(const std::string& key, int64_t exptime)
+{
+  std::unique_lock<std::mutex> lock(_lock);
+  std::map<std::string, Item>::iterator existing = find_live(key);
+
+  if (existing == _items.end())
+  {
+    return false;
+  }
+
+  existing->second.expiry_ms = expiry_ms(exptime);
+  return true;
+}
+
+void FakeMemcachedServer::flush()
+{
+  std::unique_lock<std::mutex> lock(_lock);
+  _items.clear();
+}
+
+std::map<std::string, std::string> FakeMemcachedServer::stats()
+{
+  std::map<std::string, std::string> values;
+  size_t items = item_count();
+
+  std::unique_lock<std::mutex> lock(_lock);
+  values["version"] = VERSION;
+  values["curr_items"] = std::to_string(items);
+  values["cmd_get"] = std::to_string(_gets);
+  values["cmd_set"] = std::to_string(_sets);
+  return values;
+}
+
+std::map<std::string, FakeMemcachedServer::Item>::iterator
+  FakeMemcachedServer::find_live(const std::string& key)
+{
+  std::map<std::string, Item>::iterator item = _items.find(key);
+
+  if ((item != _items.end()) &&
+      (item->second.expiry_ms != 0) &&
+      (item->second.expiry_ms <= monotonic_ms()))
+  {
+    _items.erase(item);
+    item = _items.end();
+  }
+
+  return item;
+}
+
+uint64_t FakeMemcachedServer::expiry_ms(int64_t exptime)
+{
+  if (exptime == 0)
+  {
+    return 0;
+  }
+
+  int64_t relative_ms;
+
+  if (exptime <= MAX_RELATIVE_EXPIRY)
+  {
+    relative_ms = exptime * 1000;
+  }
+  else
+  {
+    relative_ms = (exptime - realtime_s()) * 1000;
+  }
+
+  // Items with expiry times in the past expire immediately. (The expiry time
+  // can't be zero, as that means that the item doesn't expire.)
+  uint64_t now_ms = monotonic_ms();
+  return (relative_ms > 0) ? now_ms + relative_ms : (now_ms > 0 ? now_ms : 1);
+}
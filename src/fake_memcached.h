@@ -0,0 +1,167 @@
+/**
+ * @file fake_memcached.h - an in-process stand-in for memcached.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+#ifndef FAKE_MEMCACHED_H__
+#define FAKE_MEMCACHED_H__
+
+#include <string>
+#include <map>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <stdint.h>
+
+/// An in-process server that speaks enough of the memcached text and binary
+/// protocols to stand in for memcached in the tests - get(s), set, add,
+/// replace, cas, append/prepend, delete, incr/decr, touch, flush_all, version
+/// and stats, including the binary protocol's quiet variants. It doesn't
+/// support TAP, so Astaire can't resynchronise data from it.
+///
+/// Expiry is driven by clock_gettime, which the test interposer controls - so
+/// unlike a real memcached, tests can expire items with cwtest_advance_time_ms
+/// rather than waiting for them to expire.
+///
+/// Each connection is served by its own thread. The interface mirrors
+/// ProcessInstance: killing the server drops all its connections and data,
+/// as killing memcached would.
+class FakeMemcachedServer
+{
+public:
+  FakeMemcachedServer(const std::string& ip, int port);
+  FakeMemcachedServer(int port) : FakeMemcachedServer("127.0.0.1", port) {};
+  ~FakeMemcachedServer();
+
+  /// Start listening for connections. Returns false if the server can't
+  /// listen on its port.
+  bool start_instance();
+
+  /// Stop the server, closing all its connections and discarding its data.
+  bool kill_instance();
+
+  bool restart_instance() { return kill_instance() && start_instance(); }
+
+  /// The server is listening as soon as start_instance returns, so this just
+  /// reports whether it's running.
+  bool wait_for_instance() { return _running; }
+
+  std::string ip() const { return _ip; }
+  int port() const { return _port; }
+
+  /// The number of unexpired items the server holds.
+  size_t item_count();
+
+private:
+  struct Item
+  {
+    std::string data;
+    uint32_t flags;
+    uint64_t cas;
+
+    /// The time (from monotonic_ms) the item expires at, or 0 if it doesn't.
+    uint64_t expiry_ms;
+  };
+
+  /// The result of a storage command.
+  enum Result { STORED, NOT_STORED, EXISTS, NOT_FOUND };
+
+  /// The storage commands, which differ in when they store the item.
+  enum Mode { SET, ADD, REPLACE, APPEND, PREPEND };
+
+  void listen_thread_fn();
+  void connection_thread_fn(int fd);
+
+  /// Handle the requests in `buffer` (removing them), writing responses to
+  /// `response`. Stops at the first incomplete request. Returns false if the
+  /// connection should be closed.
+  bool handle_text(std::string& buffer, std::string& response);
+  bool handle_binary(std::string& buffer, std::string& response);
+
+  //
+  // Operations on the items. These all take the lock.
+  //
+
+  Result store(Mode mode,
+               const std::string& key,
+               const std::string& data,
+               uint32_t flags,
+               int64_t exptime,
+               uint64_t cas,
+               uint64_t& new_cas);
+  bool get(const std::string& key, Item& item);
+  Result remove(const std::string& key, uint64_t cas);
+  Result arithmetic(const std::string& key,
+                    bool incr,
+                    uint64_t delta,
+                    uint64_t& value,
+                    uint64_t& new_cas,
+                    bool create = false,
+                    uint64_t initial = 0,
+                    int64_t exptime = 0);
+  bool touch(const std::string& key, int64_t exptime);
+  void flush();
+  std::map<std::string, std::string> stats();
+
+  /// Find an item, discarding it if it has expired. Must be called with the
+  /// lock held.
+  std::map<std::string, Item>::iterator find_live(const std::string& key);
+
+  /// Convert a memcached expiry time (0 for never, a number of seconds of up
+  /// to 30 days, or an absolute Unix time) to a time from monotonic_ms.
+  static uint64_t expiry_ms(int64_t exptime);
+
+  std::string _ip;
+  int _port;
+
+  std::atomic<bool> _running;
+  int _listen_fd;
+  std::thread _listener;
+
+  /// The open connections, and a condition signalled when one closes.
+  std::mutex _connections_lock;
+  std::condition_variable _connections_cond;
+  std::set<int> _connections;
+
+  std::mutex _lock;
+  std::map<std::string, Item> _items;
+  uint64_t _next_cas;
+  uint64_t _gets;
+  uint64_t _sets;
+};
+
+#endif
@@ -0,0 +1,94 @@
+/**
+ * @file inprocess_snmp_test.h - SNMP test fixture that queries the agent
+ * in-process.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+#ifndef INPROCESS_SNMP_TEST_H__
+#define INPROCESS_SNMP_TEST_H__
+
+#include "test_snmp.h"
+#include "snmp_client.h"
+
+/// Fixture for SNMP tests. This extends the common SNMPTest fixture (which
+/// runs the agent on a background thread) but replaces its snmp_get and
+/// snmp_walk helpers, which fork snmpget/snmpwalk for every query, with ones
+/// that query the agent over UDP from within the test process.
+class InProcessSNMPTest : public SNMPTest
+{
+public:
+  virtual void SetUp()
+  {
+    SNMPTest::SetUp();
+    _client = new SNMPClient();
+  }
+
+  virtual void TearDown()
+  {
+    delete _client; _client = NULL;
+    SNMPTest::TearDown();
+  }
+
+  /// Get the value of a single integer OID. Fails the test (and returns 0) if
+  /// the OID does not exist.
+  unsigned int snmp_get(std::string oid)
+  {
+    SNMPVarBind result;
+    bool success = _client->get(oid, result);
+    EXPECT_TRUE(success) << "Failed to get " << oid;
+    return success ? (unsigned int)result.integer : 0;
+  }
+
+  /// Walk the subtree below an OID, returning each entry formatted as
+  /// "<oid> = <value>".
+  std::vector<std::string> snmp_walk(std::string oid)
+  {
+    std::vector<SNMPVarBind> results;
+    std::vector<std::string> entries;
+    EXPECT_TRUE(_client->walk(oid, results)) << "Failed to walk " << oid;
+
+    for (std::vector<SNMPVarBind>::const_iterator it = results.begin();
+         it != results.end();
+         ++it)
+    {
+      entries.push_back(it->to_string());
+    }
+
+    return entries;
+  }
+
+  SNMPClient* _client;
+};
+
+#endif
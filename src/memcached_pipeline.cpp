@@ -0,0 +1,95 @@
+/**
+ * @file memcached_pipeline.cpp - pipelined best-effort writes to memcached.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+#include "memcached_pipeline.h"
+#include "benchmark_utils.h"
+
+#include <cstdlib>
+
+MemcachedPipeline::MemcachedPipeline(const std::string& server, int port)
+{
+  std::string options("--CONNECT-TIMEOUT=10 --BINARY-PROTOCOL --NOREPLY --BUFFER-REQUESTS");
+  _client = memcached(options.c_str(), options.length());
+  memcached_server_add(_client, server.c_str(), port);
+}
+
+MemcachedPipeline::~MemcachedPipeline()
+{
+  flush();
+  memcached_free(_client); _client = NULL;
+}
+
+void MemcachedPipeline::set_data(const std::string& table,
+                                 const std::string& key,
+                                 const std::string& data,
+                                 int expiry)
+{
+  std::string fq = qualified_key(table, key);
+  memcached_set(_client,
+                fq.c_str(),
+                fq.length(),
+                data.c_str(),
+                data.length(),
+                expiry,
+                0);
+}
+
+void MemcachedPipeline::delete_data(const std::string& table,
+                                    const std::string& key)
+{
+  std::string fq = qualified_key(table, key);
+  memcached_delete(_client, fq.c_str(), fq.length(), 0);
+}
+
+void MemcachedPipeline::flush()
+{
+  memcached_flush_buffers(_client);
+}
+
+void MemcachedPipeline::sync()
+{
+  flush();
+
+  // memcached handles the requests on a connection in order, so once it has
+  // answered a get it has processed every write sent before it.
+  std::string fq = qualified_key("", "sync");
+  size_t length;
+  uint32_t flags;
+  memcached_return_t rc;
+  char* value = memcached_get(_client, fq.c_str(), fq.length(), &length, &flags, &rc);
+  free(value);
+}
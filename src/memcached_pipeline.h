@@ -0,0 +1,78 @@
+/**
+ * @file memcached_pipeline.h - pipelined best-effort writes to memcached.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+#ifndef MEMCACHED_PIPELINE_H__
+#define MEMCACHED_PIPELINE_H__
+
+#include <string>
+#include <libmemcached/memcached.h>
+
+/// A memcached client for best-effort writes, whose results aren't needed -
+/// e.g. tombstone cleanups, or writes to backup replicas.
+///
+/// This uses the binary protocol's quiet operations (which memcached doesn't
+/// reply to on success), and buffers the writes so that several are sent
+/// together rather than each waiting for a response. Failures are not
+/// reported. Keys are qualified by table in the same way as MemcachedStore,
+/// so the writes are visible to stores reading the same table.
+///
+/// This is not thread-safe - each thread should use its own pipeline.
+class MemcachedPipeline
+{
+public:
+  MemcachedPipeline(const std::string& server, int port);
+  ~MemcachedPipeline();
+
+  void set_data(const std::string& table,
+                const std::string& key,
+                const std::string& data,
+                int expiry);
+
+  void delete_data(const std::string& table, const std::string& key);
+
+  /// Send any buffered writes. Writes are also sent whenever libmemcached's
+  /// buffer fills.
+  void flush();
+
+  /// Send any buffered writes, and wait until memcached has processed them.
+  void sync();
+
+private:
+  memcached_st* _client;
+};
+
+#endif
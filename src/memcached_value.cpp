@@ -0,0 +1,93 @@
+/**
+ * @file memcached_value.cpp - values read from memcached without copying them.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+#include "memcached_value.h"
+
+#include <cstdlib>
+#include <cstring>
+
+MemcachedValue::MemcachedValue(char* buffer, size_t length) :
+  _buffer(buffer, free),
+  _length(length)
+{
+}
+
+bool MemcachedValue::operator==(const std::string& other) const
+{
+  return ((_length == other.length()) &&
+          ((_length == 0) || (memcmp(data(), other.data(), _length) == 0)));
+}
+
+memcached_return_t memcached_get_value(memcached_st* client,
+                                       const std::string& key,
+                                       MemcachedValue& value,
+                                       uint64_t& cas)
+{
+  const char* key_ptr = key.c_str();
+  const size_t key_len = key.length();
+
+  memcached_return_t rc = memcached_mget(client, &key_ptr, &key_len, 1);
+
+  if (memcached_success(rc))
+  {
+    memcached_result_st result;
+    memcached_result_create(client, &result);
+
+    if (memcached_fetch_result(client, &result, &rc) != NULL)
+    {
+      // Take the buffer libmemcached read the value into, rather than copying
+      // it. The buffer was allocated by the client's allocator, which must be
+      // (or wrap) malloc as MemcachedValue frees it.
+      size_t length = memcached_result_length(&result);
+      cas = memcached_result_cas(&result);
+      value = MemcachedValue(memcached_result_take_value(&result), length);
+
+      // Read the end of the response, so the client is ready for the next
+      // request.
+      memcached_return_t end_rc;
+      memcached_fetch_result(client, &result, &end_rc);
+    }
+    else if (rc == MEMCACHED_END)
+    {
+      rc = MEMCACHED_NOTFOUND;
+    }
+
+    memcached_result_free(&result);
+  }
+
+  return rc;
+}
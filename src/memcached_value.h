@@ -0,0 +1,81 @@
+/**
+ * @file memcached_value.h - values read from memcached without copying them.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+#ifndef MEMCACHED_VALUE_H__
+#define MEMCACHED_VALUE_H__
+
+#include <string>
+#include <memory>
+#include <stdint.h>
+#include <libmemcached/memcached.h>
+
+/// A value read from memcached.
+///
+/// This owns the buffer that libmemcached read the value into, rather than a
+/// copy of it, and copies of a MemcachedValue share that buffer - so a large
+/// value is only copied if the caller asks for it as a std::string.
+class MemcachedValue
+{
+public:
+  MemcachedValue() : _length(0) {};
+
+  /// Take ownership of a buffer allocated by libmemcached.
+  MemcachedValue(char* buffer, size_t length);
+
+  const char* data() const { return _buffer.get(); }
+  size_t length() const { return _length; }
+  bool empty() const { return (_length == 0); }
+
+  /// Copy the value into a std::string.
+  std::string str() const { return std::string(data(), _length); }
+
+  bool operator==(const std::string& other) const;
+
+private:
+  std::shared_ptr<char> _buffer;
+  size_t _length;
+};
+
+/// Get the value (and CAS) of `key` using `client`, without copying it out of
+/// the result libmemcached reads it into. Returns MEMCACHED_NOTFOUND if the
+/// key doesn't exist.
+memcached_return_t memcached_get_value(memcached_st* client,
+                                       const std::string& key,
+                                       MemcachedValue& value,
+                                       uint64_t& cas);
+
+#endif
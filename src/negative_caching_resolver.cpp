@@ -0,0 +1,122 @@
+/**
+ * @file negative_caching_resolver.cpp - a DNS resolver that caches failed
+ * lookups.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+#include "negative_caching_resolver.h"
+#include "benchmark_utils.h"
+
+#include <algorithm>
+
+NegativeCachingDnsResolver::NegativeCachingDnsResolver(const std::string& server,
+                                                       int port,
+                                                       int default_ttl,
+                                                       int max_ttl) :
+  DnsCachedResolver(server, port),
+  _default_ttl(default_ttl),
+  _max_ttl(max_ttl),
+  _negative_hits(0),
+  _negative_inserts(0)
+{
+}
+
+DnsResult NegativeCachingDnsResolver::dns_query(const std::string& domain,
+                                                int dnstype,
+                                                SAS::TrailId trail)
+{
+  std::pair<std::string, int> cache_key(domain, dnstype);
+
+  {
+    std::unique_lock<std::mutex> lock(_lock);
+    std::map<std::pair<std::string, int>, uint64_t>::iterator entry =
+      _negative_cache.find(cache_key);
+
+    if (entry != _negative_cache.end())
+    {
+      if (entry->second > monotonic_ms())
+      {
+        _negative_hits++;
+        return DnsResult(domain, dnstype, 0);
+      }
+
+      _negative_cache.erase(entry);
+    }
+  }
+
+  DnsResult result = DnsCachedResolver::dns_query(domain, dnstype, trail);
+
+  if (result.records().empty())
+  {
+    int ttl = (result.ttl() > 0) ? result.ttl() : _default_ttl;
+    ttl = std::min(ttl, _max_ttl);
+
+    if (ttl > 0)
+    {
+      std::unique_lock<std::mutex> lock(_lock);
+      uint64_t now = monotonic_ms();
+
+      // Remove any expired answers, so that names which are looked up once
+      // (e.g. typos) don't accumulate. Every answer expires within `max_ttl`,
+      // so this bounds the cache by the number of distinct failing names
+      // looked up in that time.
+      std::map<std::pair<std::string, int>, uint64_t>::iterator entry =
+        _negative_cache.begin();
+
+      while (entry != _negative_cache.end())
+      {
+        if (entry->second <= now)
+        {
+          _negative_cache.erase(entry++);
+        }
+        else
+        {
+          ++entry;
+        }
+      }
+
+      _negative_cache[cache_key] = now + ((uint64_t)ttl * 1000);
+      _negative_inserts++;
+    }
+  }
+
+  return result;
+}
+
+size_t NegativeCachingDnsResolver::negative_entries()
+{
+  std::unique_lock<std::mutex> lock(_lock);
+  return _negative_cache.size();
+}
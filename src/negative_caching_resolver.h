@@ -0,0 +1,100 @@
+/**
+ * @file negative_caching_resolver.h - a DNS resolver that caches failed
+ * lookups.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+#ifndef NEGATIVE_CACHING_RESOLVER_H__
+#define NEGATIVE_CACHING_RESOLVER_H__
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <stdint.h>
+
+#include "dnscachedresolver.h"
+
+/// A DnsCachedResolver that also caches negative answers (NXDOMAIN or NODATA),
+/// so a misconfigured name doesn't turn every request into a DNS query. It can
+/// be passed to AstaireResolver in place of a DnsCachedResolver.
+///
+/// A negative answer is cached for the TTL the underlying DnsCachedResolver
+/// gives it, or `default_ttl` if that is 0, capped at `max_ttl`. Only
+/// single-domain queries are cached. A DnsResult doesn't say why it is empty,
+/// so lookups that fail because the server can't be reached are cached too -
+/// the cap bounds how long that hides a recovered server.
+class NegativeCachingDnsResolver : public DnsCachedResolver
+{
+public:
+  static const int DEFAULT_NEGATIVE_TTL = 30;
+  static const int MAX_NEGATIVE_TTL = 300;
+
+  NegativeCachingDnsResolver(const std::string& server,
+                             int port = 53,
+                             int default_ttl = DEFAULT_NEGATIVE_TTL,
+                             int max_ttl = MAX_NEGATIVE_TTL);
+  virtual ~NegativeCachingDnsResolver() {};
+
+  using DnsCachedResolver::dns_query;
+  virtual DnsResult dns_query(const std::string& domain,
+                              int dnstype,
+                              SAS::TrailId trail);
+
+  /// The number of queries answered from the negative cache.
+  uint64_t negative_hits() const { return _negative_hits; }
+
+  /// The number of negative answers that have been cached.
+  uint64_t negative_inserts() const { return _negative_inserts; }
+
+  /// The number of negative answers currently cached (including any that
+  /// have expired but not yet been removed).
+  size_t negative_entries();
+
+private:
+
+  int _default_ttl;
+  int _max_ttl;
+
+  /// The expiry time of each cached negative answer, keyed on the domain and
+  /// query type. Expired answers are removed whenever a new one is cached.
+  std::mutex _lock;
+  std::map<std::pair<std::string, int>, uint64_t> _negative_cache;
+
+  std::atomic<uint64_t> _negative_hits;
+  std::atomic<uint64_t> _negative_inserts;
+};
+
+#endif
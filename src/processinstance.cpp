@@ -40,18 +40,47 @@
 #include <unistd.h>
 #include <signal.h>
 #include <cstdio>
+#include <cstdlib>
 #include <string>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <netdb.h>
 #include <cstring>
 #include <fstream>
+#include <algorithm>
+#include <cerrno>
+#include <deque>
+#include <list>
+#include <new>
+#include <fcntl.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "benchmark_utils.h"
+#include "child_time.h"
 
 /// Start this instance.
 bool ProcessInstance::start_instance()
 {
   bool success;
 
+  if ((_virtual_time) && (!child_time_init()))
+  {
+    return false;
+  }
+
+  // If the interposer can't be found, ld.so would start the process without
+  // it, and the process would silently keep real time.
+  if ((_virtual_time) && (access(CHILD_TIME_INTERPOSER, R_OK) != 0))
+  {
+    fprintf(stderr, "Can't find %s\n", CHILD_TIME_INTERPOSER);
+    return false;
+  }
+
   // Fork the current process so that we can start an instance of the process.
   int pid = fork();
 
@@ -63,7 +92,22 @@ bool ProcessInstance::start_instance()
   }
   else if (pid == 0)
   {
-    // This is the new process, so execute the process.
+    // This is the new process, so execute the process. If it uses virtual
+    // time, preload the interposer that controls its clock.
+    if (_virtual_time)
+    {
+      // Add to any libraries that are already being preloaded.
+      const char* preload = getenv("LD_PRELOAD");
+      std::string new_preload = CHILD_TIME_INTERPOSER;
+
+      if ((preload != NULL) && (*preload != '\0'))
+      {
+        new_preload = std::string(preload) + ":" + new_preload;
+      }
+
+      setenv("LD_PRELOAD", new_preload.c_str(), 1);
+    }
+
     success = execute_process();
   }
   else
@@ -82,6 +126,9 @@ bool ProcessInstance::kill_instance()
 
   if (kill(_pid, SIGTERM) == 0)
   {
+    // If the instance is paused it won't handle the SIGTERM until it is
+    // resumed.
+    kill(_pid, SIGCONT);
     waitpid(_pid, &status, 0);
     return (WIFSIGNALED(status) || WIFEXITED(status));
   }
@@ -93,6 +140,55 @@ bool ProcessInstance::kill_instance()
   }
 }
 
+/// Pause this instance.
+bool ProcessInstance::pause_instance()
+{
+  int status;
+
+  if (kill(_pid, SIGSTOP) == 0)
+  {
+    // Wait until the instance has actually stopped.
+    waitpid(_pid, &status, WUNTRACED);
+    return WIFSTOPPED(status);
+  }
+  else
+  {
+    // Failed to pause the instance.
+    perror("kill");
+    return false;
+  }
+}
+
+/// Resume this instance after it has been paused.
+bool ProcessInstance::resume_instance()
+{
+  if (kill(_pid, SIGCONT) == 0)
+  {
+    return true;
+  }
+  else
+  {
+    // Failed to resume the instance.
+    perror("kill");
+    return false;
+  }
+}
+
+/// Ask this instance to reload its configuration.
+bool ProcessInstance::reload_instance()
+{
+  if (kill(_pid, SIGHUP) == 0)
+  {
+    return true;
+  }
+  else
+  {
+    // Failed to signal the instance.
+    perror("kill");
+    return false;
+  }
+}
+
 /// Restart this instance.
 bool ProcessInstance::restart_instance()
 {
@@ -100,21 +196,45 @@ bool ProcessInstance::restart_instance()
   return kill_instance() && start_instance();
 }
 
-/// Wait for the instance to come up by trying to connect to the port the
-/// instance listens on.
+/// Wait for the instance to come up by trying to connect to the port (or Unix
+/// domain socket) the instance listens on.
 bool ProcessInstance::wait_for_instance()
 {
-  struct addrinfo hints, *res;
+  struct addrinfo hints, *res = NULL;
+  struct sockaddr_un un_addr;
+  struct sockaddr* addr;
+  socklen_t addr_len;
   int sockfd;
-  memset(&hints, 0, sizeof hints);
-  hints.ai_family = AF_UNSPEC;
-  hints.ai_socktype = SOCK_STREAM;
-  getaddrinfo(_ip.c_str(), std::to_string(_port).c_str(), &hints, &res);
-  sockfd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+
+  if (!_socket_path.empty())
+  {
+    memset(&un_addr, 0, sizeof(un_addr));
+    un_addr.sun_family = AF_UNIX;
+    strncpy(un_addr.sun_path, _socket_path.c_str(), sizeof(un_addr.sun_path) - 1);
+    addr = (struct sockaddr*)&un_addr;
+    addr_len = sizeof(un_addr);
+    sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
+  }
+  else
+  {
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    getaddrinfo(_ip.c_str(), std::to_string(_port).c_str(), &hints, &res);
+    addr = res->ai_addr;
+    addr_len = res->ai_addrlen;
+    sockfd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+  }
 
   if (sockfd == -1)
   {
     perror("socket");
+
+    if (res != NULL)
+    {
+      freeaddrinfo(res);
+    }
+
     return false;
   }
 
@@ -129,7 +249,7 @@ bool ProcessInstance::wait_for_instance()
 
   while ((!connected) && (attempts < 5))
   {
-    if (connect(sockfd, res->ai_addr, res->ai_addrlen) == 0)
+    if (connect(sockfd, addr, addr_len) == 0)
     {
       connected = true;
     }
@@ -141,7 +261,11 @@ bool ProcessInstance::wait_for_instance()
   }
 
   close(sockfd);
-  freeaddrinfo(res);
+
+  if (res != NULL)
+  {
+    freeaddrinfo(res);
+  }
 
   return connected;
 }
@@ -149,13 +273,34 @@ bool ProcessInstance::wait_for_instance()
 bool MemcachedInstance::execute_process()
 {
   // Start memcached. execlp only returns if an error has occurred, in which
-  // case return false.
+  // case return false. Items of up to 2MB are allowed, so the value size tests
+  // can store 1MB values.
+  if (!_socket_path.empty())
+  {
+    // memcached doesn't listen on TCP or UDP if it has a Unix domain socket.
+    execlp("/usr/bin/memcached",
+           "memcached",
+           "-s",
+           _socket_path.c_str(),
+           "-a",
+           "0700",
+           "-I",
+           "2m",
+           "-e",
+           "ignore_vbucket=true",
+           (char*)NULL);
+    perror("execlp");
+    return false;
+  }
+
   execlp("/usr/bin/memcached",
          "memcached",
          "-l",
          "127.0.0.1",
          "-p",
          std::to_string(_port).c_str(),
+         "-I",
+         "2m",
          "-e",
          "ignore_vbucket=true",
          (char*)NULL);
@@ -199,13 +344,25 @@ bool AstaireInstance::execute_process()
   return false;
 }
 
-void DnsmasqInstance::write_config(std::map<std::string, std::vector<std::string>> a_records)
+void DnsmasqInstance::write_config(std::map<std::string, std::vector<std::string>> a_records,
+                                   bool log_queries,
+                                   int ttl)
 {
   _cfgfile = _ip + "_" + std::to_string(_port) + "_" + "_dnsmasq.cfg";
 
   std::ofstream ofs(_cfgfile, std::ios::trunc);
   ofs << "listen-address=" << _ip << "\n";
   ofs << "port=" << _port << "\n";
+  ofs << "local=/invalid/\n";
+  ofs << "local-ttl=" << ttl << "\n";
+
+  if (log_queries)
+  {
+    _logfile = _ip + "_" + std::to_string(_port) + "_" + "_dnsmasq.log";
+    std::remove(_logfile.c_str());
+    ofs << "log-queries\n";
+    ofs << "log-facility=" << _logfile << "\n";
+  }
 
   for (auto i: a_records)
   {
@@ -218,6 +375,27 @@ void DnsmasqInstance::write_config(std::map<std::string, std::vector<std::string
   ofs.close();
 }
 
+int DnsmasqInstance::query_count(const std::string& domain)
+{
+  // Each query is logged as (for example) "query[A] astaire.local from
+  // 127.0.0.1".
+  std::ifstream ifs(_logfile);
+  std::string line;
+  std::string query = "] " + domain + " from ";
+  int count = 0;
+
+  while (std::getline(ifs, line))
+  {
+    if ((line.find("query[") != std::string::npos) &&
+        (line.find(query) != std::string::npos))
+    {
+      ++count;
+    }
+  }
+
+  return count;
+}
+
 bool DnsmasqInstance::execute_process()
 {
   // Start dnsmasq. execlp only returns if an error has occurred, in which
@@ -232,3 +410,541 @@ bool DnsmasqInstance::execute_process()
   perror("execlp");
   return false;
 }
+
+ProxyInstance::ProxyInstance(const std::string& ip,
+                             int port,
+                             const std::string& target_ip,
+                             int target_port) :
+  ProcessInstance(ip, port),
+  _target_ip(target_ip),
+  _target_port(target_port)
+{
+  // The faults live in an anonymous shared mapping, which the proxy process
+  // inherits when it is forked (including after a restart).
+  void* mem = mmap(NULL,
+                   sizeof(ProxyFaults),
+                   PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS,
+                   -1,
+                   0);
+
+  if (mem == MAP_FAILED)
+  {
+    perror("mmap");
+    throw std::bad_alloc();
+  }
+
+  _faults = new (mem) ProxyFaults();
+  clear_faults();
+}
+
+ProxyInstance::~ProxyInstance()
+{
+  // The proxy process has its own mapping of the faults, so it's fine to
+  // unmap them before the base class kills it.
+  munmap(_faults, sizeof(ProxyFaults)); _faults = NULL;
+}
+
+void ProxyInstance::set_latency(int latency_ms, int jitter_ms)
+{
+  _faults->latency_ms = latency_ms;
+  _faults->jitter_ms = jitter_ms;
+}
+
+void ProxyInstance::set_bandwidth(int bytes_per_sec)
+{
+  _faults->bytes_per_sec = bytes_per_sec;
+}
+
+void ProxyInstance::set_stalled(bool stalled)
+{
+  _faults->stalled = stalled;
+}
+
+void ProxyInstance::set_half_open(bool half_open)
+{
+  _faults->half_open = half_open;
+}
+
+void ProxyInstance::clear_faults()
+{
+  set_latency(0, 0);
+  set_bandwidth(0);
+  set_stalled(false);
+  set_half_open(false);
+}
+
+bool ProxyInstance::execute_process()
+{
+  // This is the forked process. Put back the default crash handling (the
+  // test's handler tidies up the instances, which is the parent's job) and
+  // run the proxy. This must never return to the test code.
+  signal(SIGSEGV, SIG_DFL);
+  run_proxy();
+  _exit(1);
+}
+
+namespace
+{
+
+/// Don't read more from a connection while this much data is waiting to be
+/// forwarded from it.
+const size_t MAX_QUEUED_BYTES = 4 * 1024 * 1024;
+
+uint64_t now_ms()
+{
+  return real_time_ns() / 1000000;
+}
+
+/// A chunk of data read from one side of a connection, and when it may be
+/// forwarded to the other.
+struct ProxyChunk
+{
+  uint64_t release_ms;
+  std::string data;
+};
+
+/// One direction of a proxied connection.
+struct ProxyPipe
+{
+  ProxyPipe(int from, int to) :
+    from_fd(from), to_fd(to), eof(false), queued_bytes(0), tokens(0), refill_ms(now_ms())
+  {
+  }
+
+  int from_fd;
+  int to_fd;
+  bool eof;
+  std::deque<ProxyChunk> queue;
+  size_t queued_bytes;
+
+  // Token bucket for the bandwidth limit.
+  double tokens;
+  uint64_t refill_ms;
+};
+
+struct ProxyConnection
+{
+  ProxyConnection(int client_fd, int server_fd) :
+    upstream(client_fd, server_fd),
+    downstream(server_fd, client_fd),
+    black_hole(false),
+    connecting(true)
+  {
+  }
+
+  ~ProxyConnection()
+  {
+    close(upstream.from_fd);
+    close(downstream.from_fd);
+  }
+
+  /// Close the connection with a reset rather than a FIN.
+  void reset()
+  {
+    struct linger lin = {1, 0};
+    setsockopt(upstream.from_fd, SOL_SOCKET, SO_LINGER, &lin, sizeof(lin));
+    setsockopt(downstream.from_fd, SOL_SOCKET, SO_LINGER, &lin, sizeof(lin));
+  }
+
+  ProxyPipe upstream;
+  ProxyPipe downstream;
+
+  /// Whether the connection has been made half-open.
+  bool black_hole;
+
+  /// Whether the connection to the target is still being made. Data from the
+  /// client is queued until it has been.
+  bool connecting;
+};
+
+void set_nonblocking(int fd)
+{
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+bool make_address(const std::string& ip, int port, struct sockaddr_in& addr)
+{
+  // Don't use getaddrinfo - the test interposer may have replaced it.
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  return (inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) == 1);
+}
+
+/// Read whatever is available from one side of a connection and queue it.
+void read_pipe(ProxyPipe& pipe, bool discard, int delay_ms)
+{
+  char buf[64 * 1024];
+  ssize_t len = read(pipe.from_fd, buf, sizeof(buf));
+
+  if (len == 0)
+  {
+    pipe.eof = true;
+  }
+  else if (len < 0)
+  {
+    if ((errno != EAGAIN) && (errno != EINTR))
+    {
+      pipe.eof = true;
+    }
+  }
+  else if (!discard)
+  {
+    ProxyChunk chunk;
+    chunk.release_ms = now_ms() + delay_ms;
+    chunk.data.assign(buf, len);
+    pipe.queue.push_back(chunk);
+    pipe.queued_bytes += len;
+  }
+}
+
+/// Forward as much queued data as the faults allow.
+void write_pipe(ProxyPipe& pipe, int bytes_per_sec)
+{
+  uint64_t now = now_ms();
+
+  if (bytes_per_sec > 0)
+  {
+    // Allow bursts of up to 50ms worth of data.
+    double max_tokens = std::max(bytes_per_sec / 20.0, 1.0);
+    pipe.tokens = std::min(max_tokens,
+                           pipe.tokens + ((now - pipe.refill_ms) * bytes_per_sec / 1000.0));
+  }
+
+  pipe.refill_ms = now;
+
+  while ((!pipe.queue.empty()) && (pipe.queue.front().release_ms <= now))
+  {
+    std::string& data = pipe.queue.front().data;
+    size_t allowed = data.size();
+
+    if (bytes_per_sec > 0)
+    {
+      allowed = std::min(allowed, (size_t)pipe.tokens);
+    }
+
+    if (allowed == 0)
+    {
+      break;
+    }
+
+    ssize_t len = send(pipe.to_fd, data.data(), allowed, MSG_NOSIGNAL);
+
+    if (len <= 0)
+    {
+      if ((len < 0) && (errno != EAGAIN) && (errno != EINTR))
+      {
+        // The other side has gone away, so there's no point forwarding
+        // anything else.
+        pipe.eof = true;
+        pipe.queue.clear();
+        pipe.queued_bytes = 0;
+      }
+
+      break;
+    }
+
+    pipe.queued_bytes -= len;
+
+    if (bytes_per_sec > 0)
+    {
+      pipe.tokens -= len;
+    }
+
+    if ((size_t)len < data.size())
+    {
+      data.erase(0, len);
+      break;
+    }
+
+    pipe.queue.pop_front();
+  }
+}
+
+}
+
+void ProxyInstance::run_proxy()
+{
+  struct sockaddr_in listen_addr;
+  struct sockaddr_in target_addr;
+
+  if ((!make_address(_ip, _port, listen_addr)) ||
+      (!make_address(_target_ip, _target_port, target_addr)))
+  {
+    fprintf(stderr, "Invalid proxy address %s:%d -> %s:%d\n",
+            _ip.c_str(), _port, _target_ip.c_str(), _target_port);
+    return;
+  }
+
+  int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  int reuse = 1;
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  if ((bind(listen_fd, (struct sockaddr*)&listen_addr, sizeof(listen_addr)) != 0) ||
+      (listen(listen_fd, 64) != 0))
+  {
+    perror("proxy bind/listen");
+    return;
+  }
+
+  std::list<ProxyConnection*> connections;
+  unsigned int seed = getpid();
+
+  while (true)
+  {
+    bool half_open = _faults->half_open;
+    bool stalled = _faults->stalled;
+    int bytes_per_sec = _faults->bytes_per_sec;
+    bool pending = false;
+
+    // Poll the listening socket, and every connection that we're willing to
+    // read more from.
+    std::vector<struct pollfd> fds;
+    struct pollfd listen_pfd = {listen_fd, POLLIN, 0};
+    fds.push_back(listen_pfd);
+
+    for (std::list<ProxyConnection*>::iterator conn = connections.begin();
+         conn != connections.end();
+         ++conn)
+    {
+      if (half_open)
+      {
+        (*conn)->black_hole = true;
+      }
+
+      ProxyPipe* pipes[] = {&(*conn)->upstream, &(*conn)->downstream};
+
+      for (int ii = 0; ii < 2; ++ii)
+      {
+        struct pollfd pfd = {pipes[ii]->from_fd, 0, 0};
+
+        if ((pipes[ii] == &(*conn)->downstream) && ((*conn)->connecting))
+        {
+          // Wait for the connection to the target to complete.
+          pfd.events = POLLOUT;
+        }
+        else if ((!pipes[ii]->eof) && (pipes[ii]->queued_bytes < MAX_QUEUED_BYTES))
+        {
+          pfd.events = POLLIN;
+        }
+
+        pending = pending || (!pipes[ii]->queue.empty());
+        fds.push_back(pfd);
+      }
+    }
+
+    // Wake up regularly to forward delayed data and pick up fault changes.
+    poll(fds.data(), fds.size(), pending ? 1 : 10);
+
+    if (fds[0].revents & POLLIN)
+    {
+      int client_fd = accept(listen_fd, NULL, NULL);
+
+      if (client_fd >= 0)
+      {
+        // Connect to the target without blocking, so that a slow target
+        // doesn't hold up the other connections. The connection completes
+        // (or fails) later in the loop.
+        int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+        set_nonblocking(server_fd);
+        int rc = connect(server_fd, (struct sockaddr*)&target_addr, sizeof(target_addr));
+
+        if ((rc == 0) || (errno == EINPROGRESS))
+        {
+          set_nonblocking(client_fd);
+          connections.push_back(new ProxyConnection(client_fd, server_fd));
+          connections.back()->black_hole = half_open;
+          connections.back()->connecting = (rc != 0);
+        }
+        else
+        {
+          // Pass the failure on to the client.
+          close(server_fd);
+          close(client_fd);
+        }
+      }
+    }
+
+    int latency_ms = _faults->latency_ms;
+    int jitter_ms = _faults->jitter_ms;
+    size_t ix = 1;
+
+    for (std::list<ProxyConnection*>::iterator conn = connections.begin();
+         conn != connections.end();
+         ix += 2)
+    {
+      ProxyConnection* c = *conn;
+      ProxyPipe* pipes[] = {&c->upstream, &c->downstream};
+      bool failed = false;
+
+      // Connections accepted this time round weren't polled.
+      bool polled = (ix + 1 < fds.size());
+
+      if ((c->connecting) &&
+          (polled) &&
+          (fds[ix + 1].revents & (POLLOUT | POLLHUP | POLLERR)))
+      {
+        int error = 0;
+        socklen_t error_len = sizeof(error);
+        getsockopt(c->downstream.from_fd, SOL_SOCKET, SO_ERROR, &error, &error_len);
+
+        // If the connection failed, pass the failure on to the client by
+        // closing its connection.
+        c->connecting = false;
+        failed = (error != 0);
+      }
+
+      for (int ii = 0; (ii < 2) && (!failed); ++ii)
+      {
+        if ((ii == 1) && (c->connecting))
+        {
+          // Nothing can be read from the target until the connection to it
+          // completes.
+          break;
+        }
+
+        if ((polled) && (fds[ix + ii].revents & (POLLIN | POLLHUP | POLLERR)))
+        {
+          int delay_ms = latency_ms + ((jitter_ms > 0) ? rand_r(&seed) % (jitter_ms + 1) : 0);
+          read_pipe(*pipes[ii], c->black_hole, delay_ms);
+        }
+
+        if ((!stalled) && (!c->black_hole) && (!c->connecting))
+        {
+          write_pipe(*pipes[ii], bytes_per_sec);
+        }
+      }
+
+      // Close the connection if it couldn't be made, once either side has
+      // closed and everything it sent has been forwarded, or when a half-open
+      // connection is healed.
+      bool done = failed ||
+                  ((c->upstream.eof && c->upstream.queue.empty()) ||
+                   (c->downstream.eof && c->downstream.queue.empty()));
+
+      if (c->black_hole && (!half_open))
+      {
+        c->reset();
+        done = true;
+      }
+
+      if (done)
+      {
+        delete c;
+        conn = connections.erase(conn);
+      }
+      else
+      {
+        ++conn;
+      }
+    }
+  }
+}
+
+bool MemcachedInstance::get_stats(std::map<std::string, std::string>& stats)
+{
+  if (!_socket_path.empty())
+  {
+    return get_memcached_stats(_socket_path, stats);
+  }
+
+  return get_memcached_stats(_ip, _port, stats);
+}
+
+/// Send the `stats` command on a connected socket and parse the response.
+/// This closes the socket.
+static bool read_memcached_stats(int fd,
+                                 std::map<std::string, std::string>& stats);
+
+bool get_memcached_stats(const std::string& ip,
+                         int port,
+                         std::map<std::string, std::string>& stats)
+{
+  struct sockaddr_in addr;
+  make_address(ip, port, addr);
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct timeval timeout = {1, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+  {
+    perror("connect");
+    close(fd);
+    return false;
+  }
+
+  return read_memcached_stats(fd, stats);
+}
+
+bool get_memcached_stats(const std::string& socket_path,
+                         std::map<std::string, std::string>& stats)
+{
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  struct timeval timeout = {1, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+  {
+    perror("connect");
+    close(fd);
+    return false;
+  }
+
+  return read_memcached_stats(fd, stats);
+}
+
+static bool read_memcached_stats(int fd,
+                                 std::map<std::string, std::string>& stats)
+{
+
+  // The response is a series of "STAT <name> <value>" lines, followed by
+  // "END".
+  std::string request = "stats\r\n";
+  std::string response;
+  bool success = (send(fd, request.data(), request.size(), MSG_NOSIGNAL) ==
+                  (ssize_t)request.size());
+
+  while ((success) &&
+         ((response.size() < 5) ||
+          (response.compare(response.size() - 5, 5, "END\r\n") != 0)))
+  {
+    char buf[4096];
+    ssize_t len = read(fd, buf, sizeof(buf));
+
+    if (len <= 0)
+    {
+      success = false;
+    }
+    else
+    {
+      response.append(buf, len);
+    }
+  }
+
+  close(fd);
+
+  size_t pos = 0;
+  size_t eol;
+
+  while ((success) && ((eol = response.find("\r\n", pos)) != std::string::npos))
+  {
+    std::string line = response.substr(pos, eol - pos);
+    size_t name_end = line.find(' ', 5);
+
+    if ((line.compare(0, 5, "STAT ") == 0) && (name_end != std::string::npos))
+    {
+      stats[line.substr(5, name_end - 5)] = line.substr(name_end + 1);
+    }
+
+    pos = eol + 2;
+  }
+
+  return success;
+}
@@ -38,11 +38,15 @@
 #include <string>
 #include <map>
 #include <vector>
+#include <atomic>
 
 class ProcessInstance
 {
 public:
-  ProcessInstance(std::string ip, int port) : _ip(ip), _port(port) {};
+  /// If `socket_path` is set, the instance listens on that Unix domain socket
+  /// rather than on `ip` and `port`.
+  ProcessInstance(std::string ip, int port, std::string socket_path = "") :
+    _ip(ip), _port(port), _socket_path(socket_path), _virtual_time(false) {};
   ProcessInstance(int port) : ProcessInstance("127.0.0.1", port) {};
   virtual ~ProcessInstance() { kill_instance(); }
 
@@ -51,24 +55,60 @@ public:
   bool restart_instance();
   bool wait_for_instance();
 
+  /// Freeze the instance with SIGSTOP, as if it had hung (e.g. it has been
+  /// descheduled or is swapping). Its sockets stay open, but it stops
+  /// responding until it is resumed.
+  bool pause_instance();
+  bool resume_instance();
+
+  /// Ask the instance to reload its configuration (with SIGHUP).
+  bool reload_instance();
+
+  /// Run the instance with virtual time, so that advance_all_clocks_ms moves
+  /// its clock on along with the tests' (see child_time.h). This takes effect
+  /// the next time the instance is started.
+  void use_virtual_time(bool virtual_time) { _virtual_time = virtual_time; }
+
   std::string ip() const { return _ip; }
   int port() const { return _port; }
+  std::string socket_path() const { return _socket_path; }
 
 private:
   virtual bool execute_process() = 0;
 
   std::string _ip;
   int _port;
+  std::string _socket_path;
   int _pid;
+  bool _virtual_time;
 };
 
 class MemcachedInstance : public ProcessInstance
 {
 public:
   MemcachedInstance(int port) : ProcessInstance(port) {};
+
+  /// A memcached that listens on a Unix domain socket, rather than TCP.
+  MemcachedInstance(const std::string& socket_path) :
+    ProcessInstance("127.0.0.1", 0, socket_path) {};
   virtual bool execute_process();
+
+  /// Get memcached's statistics, as returned by the `stats` command (e.g.
+  /// "curr_items" or "bytes_read"), over TCP or its Unix domain socket.
+  bool get_stats(std::map<std::string, std::string>& stats);
 };
 
+/// Get the statistics of the memcached listening on `ip` and `port` (which
+/// needn't be a MemcachedInstance).
+bool get_memcached_stats(const std::string& ip,
+                         int port,
+                         std::map<std::string, std::string>& stats);
+
+/// Get the statistics of the memcached listening on the Unix domain socket
+/// `socket_path`.
+bool get_memcached_stats(const std::string& socket_path,
+                         std::map<std::string, std::string>& stats);
+
 class AstaireInstance : public ProcessInstance
 {
 public:
@@ -76,15 +116,95 @@ public:
   virtual bool execute_process();
 };
 
+/// A dnsmasq serving the given A records. It answers NXDOMAIN for names in the
+/// reserved .invalid domain (rather than forwarding them), so tests can look
+/// up names that definitely don't exist.
 class DnsmasqInstance : public ProcessInstance
 {
 public:
-  DnsmasqInstance(std::string ip, int port, std::map<std::string, std::vector<std::string>> a_records) :
-    ProcessInstance(ip, port) { write_config(a_records); };
-  ~DnsmasqInstance() { std::remove(_cfgfile.c_str()); };
+  /// If `log_queries` is set, dnsmasq logs the queries it receives, so tests
+  /// can count them with query_count. The records are served with the given
+  /// TTL (by default 0, so they aren't cached).
+  DnsmasqInstance(std::string ip,
+                  int port,
+                  std::map<std::string, std::vector<std::string>> a_records,
+                  bool log_queries = false,
+                  int ttl = 0) :
+    ProcessInstance(ip, port) { write_config(a_records, log_queries, ttl); };
+  ~DnsmasqInstance() { std::remove(_cfgfile.c_str()); std::remove(_logfile.c_str()); };
 
   bool execute_process();
+
+  /// The number of queries for `domain` that dnsmasq has logged.
+  int query_count(const std::string& domain);
+
 private:
-  void write_config(std::map<std::string, std::vector<std::string>> a_records);
+  void write_config(std::map<std::string, std::vector<std::string>> a_records,
+                    bool log_queries,
+                    int ttl);
   std::string _cfgfile;
+  std::string _logfile;
+};
+
+/// The faults a ProxyInstance injects. This is shared with the proxy process
+/// so that the faults can be changed while it is running.
+struct ProxyFaults
+{
+  std::atomic<int> latency_ms;
+  std::atomic<int> jitter_ms;
+  std::atomic<int> bytes_per_sec;
+  std::atomic<bool> stalled;
+  std::atomic<bool> half_open;
+};
+
+/// A TCP proxy that sits in front of another instance (e.g. a memcached or an
+/// Astaire) and injects faults into the connections through it. This lets
+/// tests make an instance slow or unreachable, rather than just killing it.
+///
+/// The proxy runs in its own process like the other instances, but doesn't
+/// exec anything - the forked process just runs the proxy until it is killed.
+class ProxyInstance : public ProcessInstance
+{
+public:
+  ProxyInstance(const std::string& ip,
+                int port,
+                const std::string& target_ip,
+                int target_port);
+  ProxyInstance(int port, int target_port) :
+    ProxyInstance("127.0.0.1", port, "127.0.0.1", target_port) {};
+  ~ProxyInstance();
+
+  bool execute_process();
+
+  /// Delay data in both directions by `latency_ms`, plus a random extra delay
+  /// of up to `jitter_ms`.
+  void set_latency(int latency_ms, int jitter_ms = 0);
+
+  /// Limit each direction of each connection to `bytes_per_sec` (0 for no
+  /// limit).
+  void set_bandwidth(int bytes_per_sec);
+
+  /// Stop forwarding data. Data is buffered (and connections are still
+  /// accepted) until the stall is cleared, at which point it is forwarded.
+  void set_stalled(bool stalled);
+
+  /// Make connections half-open: the proxy keeps them open and reads from
+  /// them but never forwards or responds, as if the peer had vanished without
+  /// closing them (e.g. due to a network partition). When this is cleared the
+  /// affected connections are reset, as they would be when the partition
+  /// heals, and new connections work normally.
+  void set_half_open(bool half_open);
+
+  /// Clear all the faults.
+  void clear_faults();
+
+  std::string target_ip() const { return _target_ip; }
+  int target_port() const { return _target_port; }
+
+private:
+  void run_proxy();
+
+  std::string _target_ip;
+  int _target_port;
+  ProxyFaults* _faults;
 };
@@ -0,0 +1,303 @@
+/**
+ * @file racing_dns_resolver.cpp - a DNS resolver that races queries across
+ * several nameservers.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+#include "racing_dns_resolver.h"
+#include "benchmark_utils.h"
+
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+RacingDnsResolver::RacingDnsResolver(const std::vector<std::string>& servers,
+                                     int port,
+                                     int hedge_ms,
+                                     int slow_ms) :
+  DnsCachedResolver(first_server(servers), port),
+  _hedge_ms(hedge_ms),
+  _slow_ms(slow_ms),
+  _threads(0)
+{
+  for (std::vector<std::string>::const_iterator server = servers.begin();
+       server != servers.end();
+       ++server)
+  {
+    Server* s = new Server();
+
+    // The first server is queried through the base class.
+    if (server != servers.begin())
+    {
+      s->resolver.reset(new DnsCachedResolver(*server, port));
+    }
+
+    s->consecutive_failures = 0;
+    s->last_latency_us = 0;
+    s->wins = 0;
+    s->failures = 0;
+    _servers.emplace_back(s);
+  }
+}
+
+const std::string& RacingDnsResolver::first_server(const std::vector<std::string>& servers)
+{
+  if (servers.empty())
+  {
+    throw std::invalid_argument("RacingDnsResolver needs at least one server");
+  }
+
+  return servers.front();
+}
+
+RacingDnsResolver::~RacingDnsResolver()
+{
+  std::unique_lock<std::mutex> lock(_threads_lock);
+
+  while (_threads > 0)
+  {
+    _threads_cond.wait(lock);
+  }
+}
+
+bool RacingDnsResolver::demoted(size_t ix) const
+{
+  return ((_servers[ix]->consecutive_failures > 0) ||
+          (_servers[ix]->last_latency_us > (uint64_t)_slow_ms * 1000));
+}
+
+DnsResult RacingDnsResolver::dns_query(const std::string& domain,
+                                       int dnstype,
+                                       SAS::TrailId trail)
+{
+  std::pair<std::string, int> cache_key(domain, dnstype);
+  bool cached = false;
+  size_t winner = 0;
+
+  {
+    std::unique_lock<std::mutex> lock(_winners_lock);
+    std::map<std::pair<std::string, int>, Winner>::iterator entry =
+      _winners.find(cache_key);
+
+    if ((entry != _winners.end()) && (entry->second.expiry_ms > monotonic_ms()))
+    {
+      cached = true;
+      winner = entry->second.ix;
+    }
+  }
+
+  // The last winner still has this name cached, so ask it directly rather
+  // than starting a race. It might have dropped the answer early, in which
+  // case it goes back to its server - only do that if the server is healthy.
+  if ((cached) && (!demoted(winner)))
+  {
+    DnsResult result = query_server(winner, domain, dnstype, trail);
+
+    if (!result.records().empty())
+    {
+      return result;
+    }
+  }
+
+  return race_query(domain, dnstype, trail);
+}
+
+DnsResult RacingDnsResolver::query_server(size_t ix,
+                                          const std::string& domain,
+                                          int dnstype,
+                                          SAS::TrailId trail)
+{
+  if (ix == 0)
+  {
+    return DnsCachedResolver::dns_query(domain, dnstype, trail);
+  }
+
+  return _servers[ix]->resolver->dns_query(domain, dnstype, trail);
+}
+
+DnsResult RacingDnsResolver::race_query(const std::string& domain,
+                                        int dnstype,
+                                        SAS::TrailId trail)
+{
+  std::vector<size_t> healthy;
+  std::vector<size_t> demoted_servers;
+
+  for (size_t ix = 0; ix < _servers.size(); ++ix)
+  {
+    if (demoted(ix))
+    {
+      demoted_servers.push_back(ix);
+    }
+    else
+    {
+      healthy.push_back(ix);
+    }
+  }
+
+  // If every server is demoted, treat them all as healthy.
+  if (healthy.empty())
+  {
+    healthy.swap(demoted_servers);
+  }
+
+  std::shared_ptr<Race> race(new Race());
+  race->outstanding = 0;
+
+  std::unique_lock<std::mutex> lock(race->lock);
+
+  for (std::vector<size_t>::iterator ix = healthy.begin();
+       ix != healthy.end();
+       ++ix)
+  {
+    start_query(*ix, race, domain, dnstype, trail);
+  }
+
+  // Give the healthy servers a head start, then bring in the demoted ones if
+  // none of them has answered. The demoted servers are also brought in early
+  // if all the healthy servers have failed.
+  race->cond.wait_for(lock,
+                      std::chrono::milliseconds(_hedge_ms),
+                      [&]() { return ((race->answer) || (race->outstanding == 0)); });
+
+  if (!race->answer)
+  {
+    for (std::vector<size_t>::iterator ix = demoted_servers.begin();
+         ix != demoted_servers.end();
+         ++ix)
+    {
+      start_query(*ix, race, domain, dnstype, trail);
+    }
+  }
+
+  race->cond.wait(lock,
+                  [&]() { return ((race->answer) || (race->outstanding == 0)); });
+
+  // If no server found any records, return one of the empty answers (which
+  // may be a valid NXDOMAIN or NODATA).
+  return race->answer ? *race->answer : *race->empty_answer;
+}
+
+void RacingDnsResolver::start_query(size_t ix,
+                                    std::shared_ptr<Race> race,
+                                    const std::string& domain,
+                                    int dnstype,
+                                    SAS::TrailId trail)
+{
+  race->outstanding++;
+
+  {
+    std::unique_lock<std::mutex> lock(_threads_lock);
+    _threads++;
+  }
+
+  // The thread holds its own reference to the race, so it can finish after
+  // the caller has returned. The destructor waits for it.
+  std::thread([this, ix, race, domain, dnstype, trail]()
+  {
+    Server* server = _servers[ix].get();
+    uint64_t start_ns = real_time_ns();
+    std::shared_ptr<DnsResult> result(
+      new DnsResult(query_server(ix, domain, dnstype, trail)));
+    server->last_latency_us = (real_time_ns() - start_ns) / 1000;
+
+    {
+      std::unique_lock<std::mutex> lock(race->lock);
+      race->outstanding--;
+
+      if (!result->records().empty())
+      {
+        server->consecutive_failures = 0;
+
+        if (!race->answer)
+        {
+          race->answer = result;
+          server->wins++;
+          record_winner(ix, domain, dnstype, result->ttl());
+        }
+      }
+      else
+      {
+        server->consecutive_failures++;
+        server->failures++;
+
+        if (!race->empty_answer)
+        {
+          race->empty_answer = result;
+        }
+      }
+
+      race->cond.notify_all();
+    }
+
+    std::unique_lock<std::mutex> lock(_threads_lock);
+    _threads--;
+    _threads_cond.notify_all();
+  }).detach();
+}
+
+void RacingDnsResolver::record_winner(size_t ix,
+                                      const std::string& domain,
+                                      int dnstype,
+                                      int ttl)
+{
+  if (ttl <= 0)
+  {
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(_winners_lock);
+  uint64_t now = monotonic_ms();
+
+  // Remove any expired winners, so that names which are looked up once don't
+  // accumulate.
+  std::map<std::pair<std::string, int>, Winner>::iterator entry =
+    _winners.begin();
+
+  while (entry != _winners.end())
+  {
+    if (entry->second.expiry_ms <= now)
+    {
+      _winners.erase(entry++);
+    }
+    else
+    {
+      ++entry;
+    }
+  }
+
+  Winner& winner = _winners[std::make_pair(domain, dnstype)];
+  winner.ix = ix;
+  winner.expiry_ms = now + ((uint64_t)ttl * 1000);
+}
@@ -0,0 +1,176 @@
+/**
+ * @file racing_dns_resolver.h - a DNS resolver that races queries across
+ * several nameservers.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+#ifndef RACING_DNS_RESOLVER_H__
+#define RACING_DNS_RESOLVER_H__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <stdint.h>
+
+#include "dnscachedresolver.h"
+
+/// A DnsCachedResolver that sends each query to several nameservers at once
+/// and takes the first answer, so a single slow or failed server doesn't
+/// stall lookups. It can be passed to AstaireResolver in place of a
+/// DnsCachedResolver.
+///
+/// Servers that have recently failed to answer (or answered slowly) are
+/// demoted: they are only queried if the healthy servers haven't answered
+/// within `hedge_ms`. Once a demoted server answers promptly again it is
+/// promoted. A DnsResult doesn't say why it is empty, so an empty answer
+/// counts as a failure - if every server is demoted (e.g. after looking up a
+/// name that doesn't exist) they are all treated as healthy.
+///
+/// Once a server has won a race for a name, later lookups of that name are
+/// answered synchronously from that server's cache until the answer's TTL
+/// expires, so only cache misses are raced. Only single-domain queries are
+/// raced - multi-domain queries go to the first server.
+///
+/// `servers` must not be empty.
+class RacingDnsResolver : public DnsCachedResolver
+{
+public:
+  static const int DEFAULT_HEDGE_MS = 20;
+  static const int DEFAULT_SLOW_MS = 100;
+
+  RacingDnsResolver(const std::vector<std::string>& servers,
+                    int port = 53,
+                    int hedge_ms = DEFAULT_HEDGE_MS,
+                    int slow_ms = DEFAULT_SLOW_MS);
+
+  /// Waits for any queries still outstanding to slow servers.
+  virtual ~RacingDnsResolver();
+
+  using DnsCachedResolver::dns_query;
+  virtual DnsResult dns_query(const std::string& domain,
+                              int dnstype,
+                              SAS::TrailId trail);
+
+  size_t num_servers() const { return _servers.size(); }
+
+  /// Whether the server with the given index is currently demoted.
+  bool demoted(size_t ix) const;
+
+  /// The number of races the server with the given index has won.
+  uint64_t wins(size_t ix) const { return _servers[ix]->wins; }
+
+  /// The number of queries the server with the given index has failed to
+  /// answer.
+  uint64_t failures(size_t ix) const { return _servers[ix]->failures; }
+
+private:
+  struct Server
+  {
+    /// The resolver for this server. This is null for the first server,
+    /// which is queried through the base class.
+    std::unique_ptr<DnsCachedResolver> resolver;
+    std::atomic<int> consecutive_failures;
+    std::atomic<uint64_t> last_latency_us;
+    std::atomic<uint64_t> wins;
+    std::atomic<uint64_t> failures;
+  };
+
+  /// The state of a single race, which is shared with the threads querying
+  /// each server (some of which may finish after the race is over).
+  struct Race
+  {
+    std::mutex lock;
+    std::condition_variable cond;
+    int outstanding;
+    std::shared_ptr<DnsResult> answer;
+    std::shared_ptr<DnsResult> empty_answer;
+  };
+
+  /// The server that last won a race for a name, and when its answer
+  /// expires from that server's cache.
+  struct Winner
+  {
+    size_t ix;
+    uint64_t expiry_ms;
+  };
+
+  static const std::string& first_server(const std::vector<std::string>& servers);
+
+  /// Query the server with the given index on the calling thread.
+  DnsResult query_server(size_t ix,
+                         const std::string& domain,
+                         int dnstype,
+                         SAS::TrailId trail);
+
+  /// Race a query across the servers.
+  DnsResult race_query(const std::string& domain,
+                       int dnstype,
+                       SAS::TrailId trail);
+
+  /// Record that a server has won a race, so that later lookups of the same
+  /// name are answered from its cache for `ttl` seconds.
+  void record_winner(size_t ix,
+                     const std::string& domain,
+                     int dnstype,
+                     int ttl);
+
+  /// Query a server on a new thread, recording the result in the race.
+  void start_query(size_t ix,
+                   std::shared_ptr<Race> race,
+                   const std::string& domain,
+                   int dnstype,
+                   SAS::TrailId trail);
+
+  std::vector<std::unique_ptr<Server>> _servers;
+  int _hedge_ms;
+  int _slow_ms;
+
+  /// The last winner for each name, keyed on the domain and query type.
+  /// Expired entries are removed whenever a new winner is recorded.
+  std::mutex _winners_lock;
+  std::map<std::pair<std::string, int>, Winner> _winners;
+
+  /// The number of query threads still running, and a condition signalled
+  /// when one finishes.
+  std::mutex _threads_lock;
+  std::condition_variable _threads_cond;
+  int _threads;
+};
+
+#endif
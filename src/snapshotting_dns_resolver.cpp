@@ -0,0 +1,318 @@
+/**
+ * @file snapshotting_dns_resolver.cpp - a DNS resolver whose cache survives
+ * restarts.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+#include "snapshotting_dns_resolver.h"
+#include "benchmark_utils.h"
+
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/nameser.h>
+
+const char SnapshottingDnsResolver::MAGIC[8] = {'F', 'V', 'D', 'N', 'S', 'S', 'N', '1'};
+
+SnapshottingDnsResolver::SnapshottingDnsResolver(const std::string& server,
+                                                 int port,
+                                                 const std::string& snapshot_file,
+                                                 int interval_ms) :
+  DnsCachedResolver(server, port),
+  _snapshot_file(snapshot_file),
+  _interval_ms(interval_ms),
+  _loaded(0),
+  _stopping(false)
+{
+  load_snapshot();
+
+  if (_interval_ms > 0)
+  {
+    _snapshot_thread = std::thread(&SnapshottingDnsResolver::snapshot_thread_fn, this);
+  }
+}
+
+SnapshottingDnsResolver::~SnapshottingDnsResolver()
+{
+  if (_snapshot_thread.joinable())
+  {
+    {
+      std::unique_lock<std::mutex> lock(_lock);
+      _stopping = true;
+      _stop_cond.notify_all();
+    }
+
+    _snapshot_thread.join();
+  }
+
+  save_snapshot();
+}
+
+DnsResult SnapshottingDnsResolver::dns_query(const std::string& domain,
+                                             int dnstype,
+                                             SAS::TrailId trail)
+{
+  if ((dnstype != ns_t_a) && (dnstype != ns_t_aaaa))
+  {
+    return DnsCachedResolver::dns_query(domain, dnstype, trail);
+  }
+
+  std::pair<std::string, int> key(domain, dnstype);
+  int64_t now = realtime_s();
+
+  {
+    std::unique_lock<std::mutex> lock(_lock);
+    AnswerMap::iterator answer = _answers.find(key);
+
+    if ((answer != _answers.end()) && (answer->second.expires > now))
+    {
+      // Build the result from the cached addresses. DnsResult copies the
+      // records, so free ours afterwards.
+      int ttl = answer->second.expires - now;
+      std::vector<DnsRRecord*> records;
+
+      for (std::vector<in6_addr>::iterator address = answer->second.addresses.begin();
+           address != answer->second.addresses.end();
+           ++address)
+      {
+        if (dnstype == ns_t_a)
+        {
+          struct in_addr addr4;
+          memcpy(&addr4, &*address, sizeof(addr4));
+          records.push_back(new DnsARecord(domain, ttl, addr4));
+        }
+        else
+        {
+          records.push_back(new DnsAAAARecord(domain, ttl, *address));
+        }
+      }
+
+      DnsResult result(domain, dnstype, records, ttl);
+
+      for (std::vector<DnsRRecord*>::iterator record = records.begin();
+           record != records.end();
+           ++record)
+      {
+        delete *record;
+      }
+
+      return result;
+    }
+  }
+
+  DnsResult result = DnsCachedResolver::dns_query(domain, dnstype, trail);
+
+  if ((!result.records().empty()) && (result.ttl() > 0))
+  {
+    CachedAnswer answer;
+    answer.expires = now + result.ttl();
+
+    for (std::vector<DnsRRecord*>::iterator record = result.records().begin();
+         record != result.records().end();
+         ++record)
+    {
+      in6_addr address;
+      memset(&address, 0, sizeof(address));
+
+      if ((*record)->rrtype() == ns_t_a)
+      {
+        memcpy(&address, &((DnsARecord*)*record)->address(), sizeof(struct in_addr));
+        answer.addresses.push_back(address);
+      }
+      else if ((*record)->rrtype() == ns_t_aaaa)
+      {
+        address = ((DnsAAAARecord*)*record)->address();
+        answer.addresses.push_back(address);
+      }
+    }
+
+    if (!answer.addresses.empty())
+    {
+      std::unique_lock<std::mutex> lock(_lock);
+      _answers[key] = answer;
+    }
+  }
+
+  return result;
+}
+
+bool SnapshottingDnsResolver::save_snapshot()
+{
+  std::vector<SnapshotEntry> entries;
+  int64_t now = realtime_s();
+
+  {
+    std::unique_lock<std::mutex> lock(_lock);
+
+    for (AnswerMap::iterator answer = _answers.begin();
+         answer != _answers.end();
+         ++answer)
+    {
+      if ((answer->second.expires <= now) ||
+          (answer->first.first.size() > MAX_DOMAIN_LEN))
+      {
+        continue;
+      }
+
+      for (std::vector<in6_addr>::iterator address = answer->second.addresses.begin();
+           address != answer->second.addresses.end();
+           ++address)
+      {
+        SnapshotEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        strncpy(entry.domain, answer->first.first.c_str(), MAX_DOMAIN_LEN);
+        entry.dnstype = answer->first.second;
+        memcpy(entry.address, &*address, sizeof(entry.address));
+        entry.expires = answer->second.expires;
+        entries.push_back(entry);
+      }
+    }
+  }
+
+  SnapshotHeader header;
+  memcpy(header.magic, MAGIC, sizeof(header.magic));
+  header.entries = entries.size();
+  header.entry_size = sizeof(SnapshotEntry);
+
+  // Write to a temporary file and rename it, so a reader never sees a partly
+  // written snapshot.
+  std::string tmp_file = _snapshot_file + ".tmp";
+  FILE* f = fopen(tmp_file.c_str(), "wb");
+
+  if (f == NULL)
+  {
+    perror("open DNS snapshot");
+    return false;
+  }
+
+  bool success = ((fwrite(&header, sizeof(header), 1, f) == 1) &&
+                  ((entries.empty()) ||
+                   (fwrite(entries.data(), sizeof(SnapshotEntry), entries.size(), f) ==
+                    entries.size())));
+  success = (fclose(f) == 0) && success;
+
+  if ((!success) || (rename(tmp_file.c_str(), _snapshot_file.c_str()) != 0))
+  {
+    perror("write DNS snapshot");
+    remove(tmp_file.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+bool SnapshottingDnsResolver::load_snapshot()
+{
+  int fd = open(_snapshot_file.c_str(), O_RDONLY);
+
+  if (fd < 0)
+  {
+    // There's no snapshot yet.
+    return false;
+  }
+
+  struct stat st;
+
+  if ((fstat(fd, &st) != 0) || ((size_t)st.st_size < sizeof(SnapshotHeader)))
+  {
+    close(fd);
+    return false;
+  }
+
+  void* mem = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (mem == MAP_FAILED)
+  {
+    perror("mmap DNS snapshot");
+    return false;
+  }
+
+  // Ignore the snapshot if it isn't one we understand.
+  const SnapshotHeader* header = (const SnapshotHeader*)mem;
+  bool valid = ((memcmp(header->magic, MAGIC, sizeof(MAGIC)) == 0) &&
+                (header->entry_size == sizeof(SnapshotEntry)) &&
+                ((size_t)st.st_size ==
+                 sizeof(SnapshotHeader) + ((size_t)header->entries * sizeof(SnapshotEntry))));
+
+  if (valid)
+  {
+    const SnapshotEntry* entries = (const SnapshotEntry*)(header + 1);
+    int64_t now = realtime_s();
+    std::unique_lock<std::mutex> lock(_lock);
+
+    for (uint32_t ii = 0; ii < header->entries; ++ii)
+    {
+      const SnapshotEntry& entry = entries[ii];
+
+      if (entry.expires <= now)
+      {
+        continue;
+      }
+
+      std::string domain(entry.domain, strnlen(entry.domain, sizeof(entry.domain)));
+      CachedAnswer& answer = _answers[std::make_pair(domain, (int)entry.dnstype)];
+      in6_addr address;
+      memcpy(&address, entry.address, sizeof(address));
+      answer.addresses.push_back(address);
+      answer.expires = entry.expires;
+      _loaded++;
+    }
+  }
+
+  munmap(mem, st.st_size);
+  return valid;
+}
+
+void SnapshottingDnsResolver::snapshot_thread_fn()
+{
+  std::unique_lock<std::mutex> lock(_lock);
+
+  while (!_stopping)
+  {
+    _stop_cond.wait_for(lock, std::chrono::milliseconds(_interval_ms));
+
+    if (!_stopping)
+    {
+      lock.unlock();
+      save_snapshot();
+      lock.lock();
+    }
+  }
+}
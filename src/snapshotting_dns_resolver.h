@@ -0,0 +1,130 @@
+/**
+ * @file snapshotting_dns_resolver.h - a DNS resolver whose cache survives
+ * restarts.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+#ifndef SNAPSHOTTING_DNS_RESOLVER_H__
+#define SNAPSHOTTING_DNS_RESOLVER_H__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <stdint.h>
+#include <netinet/in.h>
+
+#include "dnscachedresolver.h"
+
+/// A DnsCachedResolver that keeps a snapshot of the A and AAAA records it has
+/// resolved in a file, so that when it is restarted it can answer from the
+/// snapshot straight away rather than making every first lookup wait for DNS.
+/// It can be passed to AstaireResolver in place of a DnsCachedResolver.
+///
+/// The snapshot is written when the resolver is destroyed, and also every
+/// `interval_ms` if that is non-zero. When the resolver is created it loads
+/// the snapshot, discarding any records whose TTLs have since run out. It
+/// answers from the records it holds (whether loaded or resolved since) until
+/// they expire.
+class SnapshottingDnsResolver : public DnsCachedResolver
+{
+public:
+  SnapshottingDnsResolver(const std::string& server,
+                          int port,
+                          const std::string& snapshot_file,
+                          int interval_ms = 0);
+  virtual ~SnapshottingDnsResolver();
+
+  using DnsCachedResolver::dns_query;
+  virtual DnsResult dns_query(const std::string& domain,
+                              int dnstype,
+                              SAS::TrailId trail);
+
+  /// Write the snapshot. Returns false if it can't be written.
+  bool save_snapshot();
+
+  /// The number of records loaded from the snapshot when the resolver was
+  /// created.
+  size_t loaded() const { return _loaded; }
+
+  /// The snapshot is an array of fixed size entries (one per record) after a
+  /// header, so it can be mapped and read in place.
+  static const char MAGIC[8];
+  static const size_t MAX_DOMAIN_LEN = 255;
+
+  struct SnapshotHeader
+  {
+    char magic[8];
+    uint32_t entries;
+    uint32_t entry_size;
+  };
+
+  struct SnapshotEntry
+  {
+    char domain[MAX_DOMAIN_LEN + 1];
+    uint16_t dnstype;
+    uint8_t address[16];
+    int64_t expires;
+  };
+
+private:
+  /// The records for a domain and query type, with the (absolute) time they
+  /// expire.
+  struct CachedAnswer
+  {
+    std::vector<in6_addr> addresses;
+    int64_t expires;
+  };
+
+  typedef std::map<std::pair<std::string, int>, CachedAnswer> AnswerMap;
+
+  bool load_snapshot();
+  void snapshot_thread_fn();
+
+  std::string _snapshot_file;
+  int _interval_ms;
+  size_t _loaded;
+
+  std::mutex _lock;
+  AnswerMap _answers;
+
+  std::condition_variable _stop_cond;
+  bool _stopping;
+  std::thread _snapshot_thread;
+};
+
+#endif
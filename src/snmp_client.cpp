@@ -0,0 +1,331 @@
+/**
+ * @file snmp_client.cpp - in-process SNMP client for querying the FV test
+ * agent.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+#include "snmp_client.h"
+#include "snmp_includes.h"
+
+#include <cstdlib>
+#include <cstring>
+
+/// Convert a numeric OID string (e.g. ".1.2.2.0") into net-snmp form. We
+/// parse it ourselves rather than using read_objid, as that goes via the MIB
+/// parser which the test agent never initializes.
+static bool parse_oid(const std::string& str, oid* name, size_t* name_len)
+{
+  size_t len = 0;
+  const char* p = str.c_str();
+
+  while (*p != '\0')
+  {
+    if (*p == '.')
+    {
+      ++p;
+      continue;
+    }
+
+    if ((*p < '0') || (*p > '9') || (len >= *name_len))
+    {
+      return false;
+    }
+
+    char* end;
+    name[len++] = strtoul(p, &end, 10);
+    p = end;
+  }
+
+  *name_len = len;
+  return (len > 0);
+}
+
+/// Convert a net-snmp OID back into numeric string form.
+static std::string oid_to_string(const oid* name, size_t name_len)
+{
+  std::string str;
+
+  for (size_t ii = 0; ii < name_len; ++ii)
+  {
+    str += "." + std::to_string(name[ii]);
+  }
+
+  return str;
+}
+
+/// Convert a net-snmp variable into an SNMPVarBind. Returns false if the agent
+/// returned one of the exception values (noSuchObject etc.).
+static bool convert_variable(const netsnmp_variable_list* var,
+                             SNMPVarBind& result)
+{
+  result.oid = oid_to_string(var->name, var->name_length);
+
+  switch (var->type)
+  {
+  case ASN_INTEGER:
+    result.type = SNMPVarBind::INTEGER;
+    result.integer = *var->val.integer;
+    break;
+
+  case ASN_COUNTER:
+  case ASN_GAUGE:
+  case ASN_TIMETICKS:
+  case ASN_UINTEGER:
+    result.type = SNMPVarBind::UNSIGNED;
+    result.integer = (uint32_t)*var->val.integer;
+    break;
+
+  case ASN_COUNTER64:
+    result.type = SNMPVarBind::COUNTER64;
+    result.integer = ((uint64_t)var->val.counter64->high << 32) |
+                     var->val.counter64->low;
+    break;
+
+  case ASN_OCTET_STR:
+    result.type = SNMPVarBind::STRING;
+    result.string.assign((const char*)var->val.string, var->val_len);
+    break;
+
+  case SNMP_NOSUCHOBJECT:
+  case SNMP_NOSUCHINSTANCE:
+  case SNMP_ENDOFMIBVIEW:
+    return false;
+
+  default:
+    result.type = SNMPVarBind::OTHER;
+    break;
+  }
+
+  return true;
+}
+
+std::string SNMPVarBind::to_string() const
+{
+  std::string value;
+
+  switch (type)
+  {
+  case INTEGER:
+  case UNSIGNED:
+  case COUNTER64:
+    value = std::to_string(integer);
+    break;
+
+  case STRING:
+    value = string;
+    break;
+
+  default:
+    value = "?";
+    break;
+  }
+
+  return oid + " = " + value;
+}
+
+SNMPClient::SNMPClient(const std::string& peer, const std::string& community) :
+  _session(NULL)
+{
+  netsnmp_session session;
+  snmp_sess_init(&session);
+
+  // net-snmp copies these into the opened session, so it's safe for them to
+  // point at our strings.
+  session.peername = (char*)peer.c_str();
+  session.version = SNMP_VERSION_2c;
+  session.community = (u_char*)community.c_str();
+  session.community_len = community.length();
+
+  // The agent runs in this process so should respond almost immediately. Keep
+  // the timeout short so that a wedged agent fails the test rather than hangs
+  // it.
+  session.timeout = 1000000;
+  session.retries = 1;
+
+  _session = snmp_sess_open(&session);
+
+  if (_session == NULL)
+  {
+    snmp_perror("snmp_sess_open");
+  }
+}
+
+SNMPClient::~SNMPClient()
+{
+  if (_session != NULL)
+  {
+    snmp_sess_close(_session); _session = NULL;
+  }
+}
+
+bool SNMPClient::get(const std::vector<std::string>& oids,
+                     std::vector<SNMPVarBind>& results)
+{
+  if (_session == NULL)
+  {
+    return false;
+  }
+
+  netsnmp_pdu* pdu = snmp_pdu_create(SNMP_MSG_GET);
+
+  for (std::vector<std::string>::const_iterator it = oids.begin();
+       it != oids.end();
+       ++it)
+  {
+    oid name[MAX_OID_LEN];
+    size_t name_len = MAX_OID_LEN;
+
+    if (!parse_oid(*it, name, &name_len))
+    {
+      snmp_free_pdu(pdu);
+      return false;
+    }
+
+    snmp_add_null_var(pdu, name, name_len);
+  }
+
+  netsnmp_pdu* response = NULL;
+  int status = snmp_sess_synch_response(_session, pdu, &response);
+  bool success = ((status == STAT_SUCCESS) &&
+                  (response->errstat == SNMP_ERR_NOERROR));
+
+  if (success)
+  {
+    results.clear();
+
+    for (netsnmp_variable_list* var = response->variables;
+         var != NULL;
+         var = var->next_variable)
+    {
+      SNMPVarBind result;
+      success = success && convert_variable(var, result);
+      results.push_back(result);
+    }
+  }
+
+  if (response != NULL)
+  {
+    snmp_free_pdu(response);
+  }
+
+  return success;
+}
+
+bool SNMPClient::get(const std::string& oid, SNMPVarBind& result)
+{
+  std::vector<SNMPVarBind> results;
+  bool success = get(std::vector<std::string>(1, oid), results);
+
+  if (success)
+  {
+    result = results.front();
+  }
+
+  return success;
+}
+
+bool SNMPClient::walk(const std::string& root,
+                      std::vector<SNMPVarBind>& results,
+                      int max_repetitions)
+{
+  oid root_name[MAX_OID_LEN];
+  size_t root_len = MAX_OID_LEN;
+
+  if ((_session == NULL) || (!parse_oid(root, root_name, &root_len)))
+  {
+    return false;
+  }
+
+  oid next_name[MAX_OID_LEN];
+  size_t next_len = root_len;
+  memcpy(next_name, root_name, root_len * sizeof(oid));
+
+  results.clear();
+  bool finished = false;
+
+  while (!finished)
+  {
+    netsnmp_pdu* pdu = snmp_pdu_create(SNMP_MSG_GETBULK);
+    pdu->non_repeaters = 0;
+    pdu->max_repetitions = max_repetitions;
+    snmp_add_null_var(pdu, next_name, next_len);
+
+    netsnmp_pdu* response = NULL;
+    int status = snmp_sess_synch_response(_session, pdu, &response);
+
+    if ((status != STAT_SUCCESS) ||
+        (response->errstat != SNMP_ERR_NOERROR))
+    {
+      if (response != NULL)
+      {
+        snmp_free_pdu(response);
+      }
+
+      return false;
+    }
+
+    netsnmp_variable_list* var = response->variables;
+
+    if (var == NULL)
+    {
+      finished = true;
+    }
+
+    for (; var != NULL; var = var->next_variable)
+    {
+      // Stop once we've walked off the end of the subtree (or the MIB).
+      SNMPVarBind result;
+
+      if ((netsnmp_oid_is_subtree(root_name,
+                                  root_len,
+                                  var->name,
+                                  var->name_length) != 0) ||
+          (!convert_variable(var, result)))
+      {
+        finished = true;
+        break;
+      }
+
+      results.push_back(result);
+
+      // Continue the next request from the last variable we received.
+      memcpy(next_name, var->name, var->name_length * sizeof(oid));
+      next_len = var->name_length;
+    }
+
+    snmp_free_pdu(response);
+  }
+
+  return true;
+}
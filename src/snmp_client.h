@@ -0,0 +1,107 @@
+/**
+ * @file snmp_client.h - in-process SNMP client for querying the FV test agent.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+#ifndef SNMP_CLIENT_H__
+#define SNMP_CLIENT_H__
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// This header deliberately does not pull in the net-snmp headers, as they
+// pollute the global namespace (see the check at the top of test_snmp.cpp).
+
+/// A single variable binding returned by the agent.
+struct SNMPVarBind
+{
+  enum Type
+  {
+    INTEGER,
+    UNSIGNED,
+    COUNTER64,
+    STRING,
+    OTHER
+  };
+
+  SNMPVarBind() : oid(), type(OTHER), integer(0), string() {};
+
+  /// The numeric OID of the variable, e.g. ".1.2.2.1.2.1".
+  std::string oid;
+
+  Type type;
+
+  /// The value of the variable if it is an integer type (INTEGER, UNSIGNED or
+  /// COUNTER64).
+  int64_t integer;
+
+  /// The value of the variable if it is an OCTET STRING.
+  std::string string;
+
+  /// Render the variable the same way as `snmpwalk -OQn`, i.e.
+  /// "<oid> = <value>".
+  std::string to_string() const;
+};
+
+/// Client that queries an SNMP agent over UDP using the net-snmp single
+/// session API. This avoids forking snmpget/snmpwalk for every query, and is
+/// safe to use from multiple threads provided each thread has its own client.
+class SNMPClient
+{
+public:
+  SNMPClient(const std::string& peer = "127.0.0.1:16161",
+             const std::string& community = "clearwater");
+  ~SNMPClient();
+
+  /// Fetch the specified OIDs in a single GET request. Returns false if the
+  /// request failed or any of the OIDs do not exist.
+  bool get(const std::vector<std::string>& oids,
+           std::vector<SNMPVarBind>& results);
+
+  /// Fetch a single OID.
+  bool get(const std::string& oid, SNMPVarBind& result);
+
+  /// Fetch every variable below the specified root OID, using GETBULK
+  /// requests of up to `max_repetitions` variables each.
+  bool walk(const std::string& root,
+            std::vector<SNMPVarBind>& results,
+            int max_repetitions = 50);
+
+private:
+  // Opaque net-snmp session handle.
+  void* _session;
+};
+
+#endif
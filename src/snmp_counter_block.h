@@ -0,0 +1,224 @@
+/**
+ * @file snmp_counter_block.h - compact, cache-line-aligned storage for
+ * time-based SNMP counters.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+#ifndef SNMP_COUNTER_BLOCK_H__
+#define SNMP_COUNTER_BLOCK_H__
+
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <stdint.h>
+#include <time.h>
+
+namespace SNMP
+{
+
+static const size_t CACHE_LINE_SIZE = 64;
+
+/// The time periods that counters are reported over. The values match the
+/// time period index used by the counter tables.
+enum class CounterPeriod
+{
+  PREVIOUS_5_SECONDS = 1,
+  CURRENT_5_MINUTES = 2,
+  PREVIOUS_5_MINUTES = 3
+};
+
+/// Storage for a group of N related counters (e.g. attempts, successes and
+/// failures) tracked over all of the reporting time periods.
+///
+/// The counter tables store each time period as a separately allocated row,
+/// so updating one logical counter touches three objects spread around the
+/// heap. This instead lays the counters out as a structure of arrays in a
+/// single block: the current and previous buckets for both the 5 second and
+/// 5 minute intervals sit together, so an update touches one cache line (for
+/// N <= 3). Blocks are aligned and padded to a whole number of cache lines, so
+/// blocks updated by different threads never share a line.
+///
+/// Buckets roll over lazily (on the next update or read after an interval
+/// ends) using the same clock as the tables, so the test interposer controls
+/// them in the same way. An update that races with a rollover may be counted
+/// in either interval.
+template <int N>
+class alignas(CACHE_LINE_SIZE) TimeBasedCounterBlock
+{
+public:
+  TimeBasedCounterBlock()
+  {
+    uint64_t now = now_ms();
+
+    for (int p = 0; p < NUM_INTERVALS; ++p)
+    {
+      _tick[p].store(now / INTERVAL_MS[p], std::memory_order_relaxed);
+
+      for (int ii = 0; ii < N; ++ii)
+      {
+        _current[p][ii].store(0, std::memory_order_relaxed);
+        _previous[p][ii].store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /// Add to one of the counters in the current intervals.
+  void increment(int counter, uint32_t amount = 1)
+  {
+    roll(now_ms());
+
+    for (int p = 0; p < NUM_INTERVALS; ++p)
+    {
+      _current[p][counter].fetch_add(amount, std::memory_order_relaxed);
+    }
+  }
+
+  /// Read a counter for the given time period.
+  uint32_t value(int counter, CounterPeriod period)
+  {
+    roll(now_ms());
+
+    switch (period)
+    {
+    case CounterPeriod::PREVIOUS_5_SECONDS:
+      return _previous[FIVE_SECONDS][counter].load(std::memory_order_relaxed);
+
+    case CounterPeriod::CURRENT_5_MINUTES:
+      return _current[FIVE_MINUTES][counter].load(std::memory_order_relaxed);
+
+    case CounterPeriod::PREVIOUS_5_MINUTES:
+    default:
+      return _previous[FIVE_MINUTES][counter].load(std::memory_order_relaxed);
+    }
+  }
+
+private:
+  enum { FIVE_SECONDS = 0, FIVE_MINUTES = 1, NUM_INTERVALS = 2 };
+  static const uint64_t INTERVAL_MS[NUM_INTERVALS];
+
+  static uint64_t now_ms()
+  {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+    return ((uint64_t)now.tv_sec * 1000) + (now.tv_nsec / 1000000);
+  }
+
+  /// Move the current buckets into the previous ones for any interval that
+  /// has ended. The common case of no rollover is a single load per interval.
+  void roll(uint64_t now)
+  {
+    for (int p = 0; p < NUM_INTERVALS; ++p)
+    {
+      uint32_t tick = now / INTERVAL_MS[p];
+      uint32_t old_tick = _tick[p].load(std::memory_order_acquire);
+
+      // Only the thread that moves the tick on does the rollover. If time has
+      // gone backwards leave the buckets alone.
+      if ((tick > old_tick) &&
+          (_tick[p].compare_exchange_strong(old_tick, tick)))
+      {
+        for (int ii = 0; ii < N; ++ii)
+        {
+          uint32_t value = _current[p][ii].exchange(0);
+
+          // If a whole interval has passed without an update, the previous
+          // interval is empty.
+          _previous[p][ii].store((tick == old_tick + 1) ? value : 0,
+                                 std::memory_order_relaxed);
+        }
+      }
+    }
+  }
+
+  std::atomic<uint32_t> _tick[NUM_INTERVALS];
+  std::atomic<uint32_t> _current[NUM_INTERVALS][N];
+  std::atomic<uint32_t> _previous[NUM_INTERVALS][N];
+};
+
+template <int N>
+const uint64_t TimeBasedCounterBlock<N>::INTERVAL_MS[NUM_INTERVALS] = {5000, 300000};
+
+/// A fixed-size array of counter blocks, e.g. one per result code or IP
+/// address. The standard allocator doesn't honour over-aligned types, so this
+/// allocates the blocks on cache line boundaries itself.
+template <int N>
+class TimeBasedCounterBlockArray
+{
+public:
+  typedef TimeBasedCounterBlock<N> Block;
+
+  TimeBasedCounterBlockArray(size_t size) : _blocks(NULL), _size(size)
+  {
+    void* mem = NULL;
+
+    if (posix_memalign(&mem, CACHE_LINE_SIZE, size * sizeof(Block)) != 0)
+    {
+      throw std::bad_alloc();
+    }
+
+    _blocks = (Block*)mem;
+
+    for (size_t ii = 0; ii < _size; ++ii)
+    {
+      new (&_blocks[ii]) Block();
+    }
+  }
+
+  ~TimeBasedCounterBlockArray()
+  {
+    for (size_t ii = 0; ii < _size; ++ii)
+    {
+      _blocks[ii].~Block();
+    }
+
+    free(_blocks); _blocks = NULL;
+  }
+
+  Block& operator[](size_t ix) { return _blocks[ix]; }
+  size_t size() const { return _size; }
+
+  /// The memory used by the counters.
+  size_t bytes() const { return sizeof(*this) + (_size * sizeof(Block)); }
+
+private:
+  TimeBasedCounterBlockArray(const TimeBasedCounterBlockArray&);
+  TimeBasedCounterBlockArray& operator=(const TimeBasedCounterBlockArray&);
+
+  Block* _blocks;
+  size_t _size;
+};
+
+}
+
+#endif
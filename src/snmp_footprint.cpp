@@ -0,0 +1,115 @@
+/**
+ * @file snmp_footprint.cpp - measure the memory used by SNMP tables.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+#include "snmp_footprint.h"
+
+#include <malloc.h>
+#include <set>
+
+std::string SNMPTableFootprint::summary() const
+{
+  return std::to_string(rows) + " rows, " +
+         std::to_string(total_bytes) + " bytes (" +
+         std::to_string(bytes_per_row()) + " bytes/row)";
+}
+
+size_t heap_bytes_in_use()
+{
+  // uordblks covers allocations from the main heap and hblkhd covers large
+  // allocations that malloc satisfied with mmap.
+  struct mallinfo info = mallinfo();
+  return (size_t)(unsigned int)info.uordblks + (size_t)(unsigned int)info.hblkhd;
+}
+
+size_t count_rows(const std::vector<SNMPVarBind>& walk,
+                  const std::string& table_oid)
+{
+  // Entries are named <table>.1.<column>.<index>. Every row has a value in
+  // every column, so count the distinct indexes in the first column we see.
+  std::string entry_prefix = table_oid + ".1.";
+  std::string column_prefix;
+  std::set<std::string> indexes;
+
+  for (std::vector<SNMPVarBind>::const_iterator var = walk.begin();
+       var != walk.end();
+       ++var)
+  {
+    if (var->oid.compare(0, entry_prefix.length(), entry_prefix) != 0)
+    {
+      continue;
+    }
+
+    size_t index_start = var->oid.find('.', entry_prefix.length());
+
+    if (index_start == std::string::npos)
+    {
+      continue;
+    }
+
+    if (column_prefix.empty())
+    {
+      column_prefix = var->oid.substr(0, index_start);
+    }
+
+    if (var->oid.compare(0, index_start, column_prefix) == 0)
+    {
+      indexes.insert(var->oid.substr(index_start));
+    }
+  }
+
+  return indexes.size();
+}
+
+SNMPTableFootprint measure_table_footprint(std::function<void()> create,
+                                           SNMPClient& client,
+                                           const std::string& table_oid)
+{
+  SNMPTableFootprint footprint;
+
+  size_t before = heap_bytes_in_use();
+  create();
+  size_t after = heap_bytes_in_use();
+
+  footprint.total_bytes = (after > before) ? (after - before) : 0;
+
+  std::vector<SNMPVarBind> walk;
+  if (client.walk(table_oid, walk))
+  {
+    footprint.rows = count_rows(walk, table_oid);
+  }
+
+  return footprint;
+}
@@ -0,0 +1,86 @@
+/**
+ * @file snmp_footprint.h - measure the memory used by SNMP tables.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+#ifndef SNMP_FOOTPRINT_H__
+#define SNMP_FOOTPRINT_H__
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "snmp_client.h"
+
+/// The memory used by an SNMP table.
+///
+/// The tables live in cpp-common and don't track their own allocations, so
+/// this is measured from the outside: the heap in use is sampled before and
+/// after the table is created and populated (which covers both our row
+/// objects and net-snmp's registrations for them), and the rows are counted by
+/// walking the table.
+struct SNMPTableFootprint
+{
+  SNMPTableFootprint() : rows(0), total_bytes(0) {};
+
+  /// The number of rows in the table, i.e. the number of distinct indexes.
+  size_t rows;
+
+  /// The heap allocated by creating and populating the table.
+  size_t total_bytes;
+
+  size_t bytes_per_row() const { return (rows == 0) ? 0 : total_bytes / rows; }
+
+  /// Summarize the footprint, e.g. "144 rows, 81920 bytes (568 bytes/row)".
+  std::string summary() const;
+};
+
+/// Get the number of bytes of heap currently allocated by the process.
+size_t heap_bytes_in_use();
+
+/// Count the rows in a walk of the table at `table_oid`.
+size_t count_rows(const std::vector<SNMPVarBind>& walk,
+                  const std::string& table_oid);
+
+/// Measure the footprint of an SNMP table. `create` must create and populate
+/// the table at `table_oid` (and not free it); the table is then walked
+/// with `client` to count its rows.
+///
+/// The measurement includes any other allocations made by this process while
+/// `create` runs, so nothing else should be running at the time.
+SNMPTableFootprint measure_table_footprint(std::function<void()> create,
+                                           SNMPClient& client,
+                                           const std::string& table_oid);
+
+#endif
@@ -0,0 +1,89 @@
+/**
+ * @file snmp_table_schema.cpp - OID helpers for the SNMP table schemas.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+#include "snmp_table_schema.h"
+
+#include <cstdlib>
+
+namespace SNMP
+{
+namespace Schema
+{
+
+OID OID::parse(const std::string& str)
+{
+  OID oid;
+  const char* pos = str.c_str();
+
+  while (*pos != '\0')
+  {
+    if (*pos == '.')
+    {
+      ++pos;
+      continue;
+    }
+
+    char* end;
+    unsigned long component = strtoul(pos, &end, 10);
+
+    if (end == pos)
+    {
+      // Not a number - stop rather than loop forever.
+      break;
+    }
+
+    oid.append(component);
+    pos = end;
+  }
+
+  return oid;
+}
+
+std::string OID::to_string() const
+{
+  std::string str;
+
+  for (size_t ii = 0; ii < length; ++ii)
+  {
+    str += "." + std::to_string(subids[ii]);
+  }
+
+  return str;
+}
+
+}
+}
@@ -0,0 +1,323 @@
+/**
+ * @file snmp_table_schema.h - compile-time definitions of the SNMP table
+ * layouts.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+#ifndef SNMP_TABLE_SCHEMA_H__
+#define SNMP_TABLE_SCHEMA_H__
+
+#include <string>
+#include <cstddef>
+#include <stdint.h>
+
+#include "snmp_counter_block.h"
+
+/// The tables indexed by time period and something else (node type, request
+/// type or Diameter result code) hand-code their column numbers and the
+/// values of their indexes, and the tests have to hard-code the OIDs these
+/// produce. The schemas here declare each table's index and columns once, and
+/// everything else - the number of rows, the OID of each cell, the order the
+/// cells are walked in and the storage for the counters - is derived from
+/// them at compile time.
+namespace SNMP
+{
+namespace Schema
+{
+
+static const size_t NOT_FOUND = (size_t)-1;
+
+constexpr size_t offset_position(size_t pos, size_t offset)
+{
+  return (pos == NOT_FOUND) ? NOT_FOUND : pos + offset;
+}
+
+/// A compile-time list of OID sub-identifiers.
+template <uint32_t... Values>
+struct ValueList;
+
+template <>
+struct ValueList<>
+{
+  static constexpr size_t size() { return 0; }
+  static constexpr uint32_t at(size_t ix) { return 0; }
+  static constexpr size_t find(uint32_t value) { return NOT_FOUND; }
+  static constexpr bool increasing_after(uint32_t prev) { return true; }
+  static constexpr bool is_increasing() { return true; }
+};
+
+template <uint32_t Value, uint32_t... Values>
+struct ValueList<Value, Values...>
+{
+  typedef ValueList<Values...> Rest;
+
+  static constexpr size_t size() { return 1 + Rest::size(); }
+
+  static constexpr uint32_t at(size_t ix)
+  {
+    return (ix == 0) ? Value : Rest::at(ix - 1);
+  }
+
+  static constexpr size_t find(uint32_t value)
+  {
+    return (value == Value) ? 0 : offset_position(Rest::find(value), 1);
+  }
+
+  static constexpr bool increasing_after(uint32_t prev)
+  {
+    return (Value > prev) && Rest::increasing_after(Value);
+  }
+
+  static constexpr bool is_increasing() { return Rest::increasing_after(Value); }
+};
+
+/// An index made up of a single sub-identifier, e.g. a node type.
+///
+/// Every index type provides:
+/// -  size() - the number of distinct keys.
+/// -  length() - the number of sub-identifiers in each key.
+/// -  subid(key, ii) - the ii'th sub-identifier of the key at position `key`.
+/// -  position(...) - the position of the key with the given sub-identifiers,
+///    or NOT_FOUND.
+///
+/// Keys are numbered in OID order, which is checked at compile time, so the
+/// position of a key is also its position in a walk of the table.
+template <uint32_t... Values>
+struct SimpleIndex
+{
+  typedef ValueList<Values...> Keys;
+  static_assert(Keys::is_increasing(), "Index values must be in OID order");
+
+  static constexpr size_t size() { return Keys::size(); }
+  static constexpr size_t length() { return 1; }
+  static constexpr uint32_t subid(size_t key, size_t ii) { return Keys::at(key); }
+
+  template <typename T>
+  static constexpr size_t position(T value)
+  {
+    return Keys::find(static_cast<uint32_t>(value));
+  }
+};
+
+/// A set of keys that share their first sub-identifier, e.g. the result codes
+/// for one Diameter application.
+template <uint32_t Prefix, uint32_t... Values>
+struct KeyGroup
+{
+  static constexpr uint32_t prefix() { return Prefix; }
+  typedef ValueList<Values...> Keys;
+};
+
+/// An index made up of two sub-identifiers, where the valid second
+/// sub-identifiers depend on the first.
+template <typename... Groups>
+struct GroupedIndex;
+
+template <>
+struct GroupedIndex<>
+{
+  static constexpr size_t size() { return 0; }
+  static constexpr uint32_t subid(size_t key, size_t ii) { return 0; }
+  static constexpr size_t position(uint32_t prefix, uint32_t value) { return NOT_FOUND; }
+  static constexpr bool ordered_after(uint32_t prev) { return true; }
+};
+
+template <typename Group, typename... Groups>
+struct GroupedIndex<Group, Groups...>
+{
+  typedef GroupedIndex<Groups...> Rest;
+
+  static constexpr size_t size() { return Group::Keys::size() + Rest::size(); }
+  static constexpr size_t length() { return 2; }
+
+  static constexpr uint32_t subid(size_t key, size_t ii)
+  {
+    return (key >= Group::Keys::size()) ?
+             Rest::subid(key - Group::Keys::size(), ii) :
+           (ii == 0) ?
+             Group::prefix() :
+             Group::Keys::at(key);
+  }
+
+  template <typename P, typename T>
+  static constexpr size_t position(P prefix, T value)
+  {
+    return (static_cast<uint32_t>(prefix) == Group::prefix()) ?
+             Group::Keys::find(static_cast<uint32_t>(value)) :
+             offset_position(Rest::position(static_cast<uint32_t>(prefix),
+                                            static_cast<uint32_t>(value)),
+                             Group::Keys::size());
+  }
+
+  static constexpr bool ordered_after(uint32_t prev)
+  {
+    return (Group::prefix() > prev) && is_ordered();
+  }
+
+  static constexpr bool is_ordered()
+  {
+    return Group::Keys::is_increasing() && Rest::ordered_after(Group::prefix());
+  }
+};
+
+/// An OID held as a fixed-size array of sub-identifiers, so that it can be
+/// built up without allocating.
+struct OID
+{
+  static const size_t MAX_LENGTH = 128;
+
+  OID() : length(0) {}
+
+  void append(uint32_t subid)
+  {
+    if (length < MAX_LENGTH)
+    {
+      subids[length++] = subid;
+    }
+  }
+
+  /// Parse a dotted OID such as ".1.2.2".
+  static OID parse(const std::string& str);
+
+  /// Render the OID in the same dotted form, with a leading dot.
+  std::string to_string() const;
+
+  uint32_t subids[MAX_LENGTH];
+  size_t length;
+};
+
+/// A table with a row for each time period and key of `Index`, and
+/// `NumColumns` counter columns numbered from `FirstColumn`. Cells are named
+/// <table>.1.<column>.<time period>.<key>, so a walk returns them ordered by
+/// column, then time period, then key.
+template <typename Index_, uint32_t FirstColumn, int NumColumns>
+struct TimeBasedTable
+{
+  typedef Index_ Index;
+
+  /// Storage for the table's counters - one block per key, holding every
+  /// column for every time period.
+  typedef TimeBasedCounterBlockArray<NumColumns> Storage;
+
+  static const int PERIODS = 3;
+
+  static constexpr size_t rows() { return PERIODS * Index::size(); }
+  static constexpr size_t cells() { return rows() * NumColumns; }
+
+  static constexpr bool has_column(uint32_t column)
+  {
+    return (column >= FirstColumn) && (column < FirstColumn + NumColumns);
+  }
+
+  /// The counter within a storage block that holds the given column.
+  static constexpr int counter(uint32_t column) { return column - FirstColumn; }
+
+  /// The position of a cell in a walk of the table.
+  static constexpr size_t walk_position(uint32_t column,
+                                        CounterPeriod period,
+                                        size_t key)
+  {
+    return ((counter(column) * PERIODS) + (static_cast<size_t>(period) - 1)) *
+           Index::size() + key;
+  }
+
+  /// The OID of a cell, given the OID of the table.
+  static OID cell_oid(const OID& table, uint32_t column, CounterPeriod period, size_t key)
+  {
+    OID oid = table;
+    oid.append(1);
+    oid.append(column);
+    oid.append(static_cast<uint32_t>(period));
+
+    for (size_t ii = 0; ii < Index::length(); ++ii)
+    {
+      oid.append(Index::subid(key, ii));
+    }
+
+    return oid;
+  }
+
+  /// The dotted OID of a cell, looking up the key from its sub-identifiers,
+  /// e.g. oid_string(".1.2.2", COUNT, CounterPeriod::PREVIOUS_5_SECONDS,
+  /// DiameterAppId::BASE, 2001) gives ".1.2.2.1.4.1.0.2001" for the Cx table.
+  template <typename... Keys>
+  static std::string oid_string(const std::string& table,
+                                uint32_t column,
+                                CounterPeriod period,
+                                Keys... keys)
+  {
+    return cell_oid(OID::parse(table), column, period, Index::position(keys...)).to_string();
+  }
+};
+
+/// SNMP::NodeTypes - SCSCF, PCSCF and ICSCF.
+typedef SimpleIndex<0, 1, 2> NodeTypeIndex;
+
+/// SNMP::SIPRequestTypes - INVITE through to OTHER.
+typedef SimpleIndex<0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14> SIPRequestTypeIndex;
+
+/// The result codes counted for each SNMP::DiameterAppId. Timeouts don't have
+/// a result code so are counted under 0.
+typedef GroupedIndex<
+  KeyGroup<0,
+           1001, 2001, 2002, 3001, 3002, 3003, 3004, 3005, 3006, 3007, 3008,
+           3009, 3010, 4001, 4002, 4003, 5001, 5002, 5003, 5004, 5005, 5006,
+           5007, 5008, 5009, 5010, 5011, 5012, 5013, 5014, 5015, 5016, 5017>,
+  KeyGroup<1,
+           2001, 2002, 2003, 2004, 4100, 4101, 5001, 5002, 5003, 5004, 5005,
+           5006, 5007, 5011>,
+  KeyGroup<2, 0> > DiameterResultCodeIndex;
+
+static_assert(DiameterResultCodeIndex::is_ordered(),
+              "Result codes must be in OID order");
+
+struct SingleCountByNodeTypeTableSchema : TimeBasedTable<NodeTypeIndex, 3, 1>
+{
+  enum Column { COUNT = 3 };
+};
+
+struct SuccessFailCountByRequestTypeTableSchema : TimeBasedTable<SIPRequestTypeIndex, 3, 3>
+{
+  enum Column { ATTEMPTS = 3, SUCCESSES = 4, FAILURES = 5 };
+};
+
+struct CxCounterTableSchema : TimeBasedTable<DiameterResultCodeIndex, 4, 1>
+{
+  enum Column { COUNT = 4 };
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,113 @@
+/**
+ * @file store_update.cpp - read-modify-write updates to a store.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+#include "store_update.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <unistd.h>
+
+/// The longest the first backoff can be.
+static const int INITIAL_BACKOFF_US = 100;
+
+Store::Status update_data(Store* store,
+                          const std::string& table,
+                          const std::string& key,
+                          std::function<void(std::string& data)> mutator,
+                          int expiry,
+                          SAS::TrailId trail,
+                          UpdateStats* stats,
+                          int max_backoff_us)
+{
+  unsigned int seed = std::rand();
+  int backoff_limit_us = std::min(INITIAL_BACKOFF_US, max_backoff_us);
+
+  for (int attempt = 0; attempt < MAX_UPDATE_ATTEMPTS; ++attempt)
+  {
+    std::string data;
+    uint64_t cas = 0;
+    Store::Status status = store->get_data(table, key, data, cas, trail);
+
+    if (status == Store::Status::NOT_FOUND)
+    {
+      // Create the key - a CAS of 0 only succeeds if it doesn't exist.
+      data.clear();
+      cas = 0;
+    }
+    else if (status != Store::Status::OK)
+    {
+      return status;
+    }
+
+    mutator(data);
+    status = store->set_data(table, key, data, cas, expiry, trail);
+
+    if (status != Store::Status::DATA_CONTENTION)
+    {
+      if ((status == Store::Status::OK) && (stats != NULL))
+      {
+        stats->updates++;
+      }
+
+      return status;
+    }
+
+    if (stats != NULL)
+    {
+      stats->retries++;
+    }
+
+    if (backoff_limit_us > 0)
+    {
+      int backoff_us = rand_r(&seed) % (backoff_limit_us + 1);
+      usleep(backoff_us);
+      backoff_limit_us = std::min(backoff_limit_us * 2, max_backoff_us);
+
+      if (stats != NULL)
+      {
+        stats->backoff_us += backoff_us;
+      }
+    }
+  }
+
+  if (stats != NULL)
+  {
+    stats->abandoned++;
+  }
+
+  return Store::Status::DATA_CONTENTION;
+}
@@ -0,0 +1,98 @@
+/**
+ * @file store_update.h - read-modify-write updates to a store.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+#ifndef STORE_UPDATE_H__
+#define STORE_UPDATE_H__
+
+#include <string>
+#include <functional>
+#include <atomic>
+#include <stdint.h>
+
+#include "store.h"
+
+/// Statistics about calls to update_data. These can be shared between
+/// threads.
+struct UpdateStats
+{
+  UpdateStats() : updates(0), abandoned(0), retries(0), backoff_us(0) {};
+
+  /// The number of successful updates.
+  std::atomic<uint64_t> updates;
+
+  /// The number of updates that gave up because of contention.
+  std::atomic<uint64_t> abandoned;
+
+  /// The number of attempts that were retried because of contention.
+  std::atomic<uint64_t> retries;
+
+  /// The total time spent backing off between attempts.
+  std::atomic<uint64_t> backoff_us;
+
+  double retries_per_update() const
+  {
+    return (updates == 0) ? 0.0 : (double)retries / updates;
+  }
+};
+
+/// The most an update backs off for between attempts by default.
+static const int DEFAULT_MAX_BACKOFF_US = 10000;
+
+/// The number of attempts an update makes before giving up.
+static const int MAX_UPDATE_ATTEMPTS = 100;
+
+/// Update the value of `key`: read it, pass it to `mutator` to modify (it's
+/// empty if the key doesn't exist yet), and write it back with the CAS from
+/// the read. If another writer gets there first, the update is retried.
+///
+/// Between attempts the update backs off for a random time of up to 100us,
+/// doubling on each retry up to `max_backoff_us` (0 disables backoff) - so
+/// that writers contending on a hot key spread out rather than all retrying at
+/// once.
+///
+/// Returns OK if the update succeeded, DATA_CONTENTION if it was still
+/// contended after MAX_UPDATE_ATTEMPTS attempts, or ERROR.
+Store::Status update_data(Store* store,
+                          const std::string& table,
+                          const std::string& key,
+                          std::function<void(std::string& data)> mutator,
+                          int expiry,
+                          SAS::TrailId trail = 0,
+                          UpdateStats* stats = NULL,
+                          int max_backoff_us = DEFAULT_MAX_BACKOFF_US);
+
+#endif
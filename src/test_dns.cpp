@@ -36,6 +36,15 @@
 #include "gmock/gmock.h"
 #include "dnscachedresolver.h"
 #include "processinstance.h"
+#include "negative_caching_resolver.h"
+#include "racing_dns_resolver.h"
+#include "snapshotting_dns_resolver.h"
+#include "cached_astaire_resolver.h"
+#include "test_interposer.hpp"
+#include "benchmark_utils.h"
+
+#include <unistd.h>
+#include <arpa/inet.h>
 
 class DNSTest : public ::testing::Test
 {
@@ -55,3 +64,380 @@ TEST_F(DNSTest, BasicQuery)
   delete r;
 }
 
+/// dnsmasq doesn't necessarily log a query before answering it, so wait (for
+/// up to a second) for it to have logged `expected` queries for `domain`.
+/// Returns the number it has logged.
+static int wait_for_query_count(DnsmasqInstance& server,
+                                const std::string& domain,
+                                int expected)
+{
+  int count = server.query_count(domain);
+
+  for (int ii = 0; (ii < 100) && (count < expected); ++ii)
+  {
+    usleep(10000);
+    count = server.query_count(domain);
+  }
+
+  return count;
+}
+
+TEST_F(DNSTest, NegativeResultsAreCached)
+{
+  DnsmasqInstance server("127.0.0.201", 5353, {{"test.query", {"1.2.3.4", "5.6.7.8"}}}, true);
+  server.start_instance();
+  server.wait_for_instance();
+
+  // Without negative caching, every lookup of a name that doesn't exist goes
+  // to the server.
+  DnsCachedResolver* plain = new DnsCachedResolver("127.0.0.201", 5353);
+
+  for (int ii = 0; ii < 3; ++ii)
+  {
+    DnsResult answer = plain->dns_query("bad.domain.invalid", ns_t_a, 0);
+    EXPECT_EQ(answer.records().size(), 0);
+  }
+
+  delete plain;
+  EXPECT_EQ(3, wait_for_query_count(server, "bad.domain.invalid", 3));
+
+  // With it, only the first lookup does until the answer expires.
+  cwtest_completely_control_time(true);
+  NegativeCachingDnsResolver* r = new NegativeCachingDnsResolver("127.0.0.201", 5353, 30, 60);
+
+  for (int ii = 0; ii < 3; ++ii)
+  {
+    DnsResult answer = r->dns_query("bad.domain.invalid", ns_t_a, 0);
+    EXPECT_EQ(answer.records().size(), 0);
+  }
+
+  EXPECT_EQ(4, wait_for_query_count(server, "bad.domain.invalid", 4));
+  EXPECT_EQ(1u, r->negative_inserts());
+  EXPECT_EQ(2u, r->negative_hits());
+
+  // dnsmasq's negative answers have no TTL, so they are kept for default_ttl.
+  cwtest_advance_time_ms(29000);
+
+  DnsResult answer = r->dns_query("bad.domain.invalid", ns_t_a, 0);
+  EXPECT_EQ(answer.records().size(), 0);
+  EXPECT_EQ(3u, r->negative_hits());
+
+  cwtest_advance_time_ms(1000);
+
+  answer = r->dns_query("bad.domain.invalid", ns_t_a, 0);
+  EXPECT_EQ(answer.records().size(), 0);
+  EXPECT_EQ(5, wait_for_query_count(server, "bad.domain.invalid", 5));
+
+  // Names that do exist aren't cached negatively.
+  answer = r->dns_query("test.query", ns_t_a, 0);
+  EXPECT_EQ(answer.records().size(), 2);
+  EXPECT_EQ(1u, r->negative_entries());
+
+  // Expired answers are removed when a new one is cached.
+  answer = r->dns_query("other.domain.invalid", ns_t_a, 0);
+  EXPECT_EQ(answer.records().size(), 0);
+  EXPECT_EQ(2u, r->negative_entries());
+
+  cwtest_advance_time_ms(60000);
+
+  answer = r->dns_query("third.domain.invalid", ns_t_a, 0);
+  EXPECT_EQ(answer.records().size(), 0);
+  EXPECT_EQ(1u, r->negative_entries());
+
+  delete r;
+  cwtest_reset_time();
+}
+
+TEST_F(DNSTest, NegativeResultsAreCappedAtMaxTTL)
+{
+  DnsmasqInstance server("127.0.0.201", 5353, {{"test.query", {"1.2.3.4"}}}, true);
+  server.start_instance();
+  server.wait_for_instance();
+
+  // A default TTL longer than the maximum is cut down to the maximum.
+  cwtest_completely_control_time(true);
+  NegativeCachingDnsResolver* r = new NegativeCachingDnsResolver("127.0.0.201", 5353, 120, 60);
+
+  DnsResult answer = r->dns_query("bad.domain.invalid", ns_t_a, 0);
+  EXPECT_EQ(answer.records().size(), 0);
+  EXPECT_EQ(1, wait_for_query_count(server, "bad.domain.invalid", 1));
+
+  cwtest_advance_time_ms(59000);
+
+  answer = r->dns_query("bad.domain.invalid", ns_t_a, 0);
+  EXPECT_EQ(answer.records().size(), 0);
+  EXPECT_EQ(1u, r->negative_hits());
+
+  cwtest_advance_time_ms(1000);
+
+  answer = r->dns_query("bad.domain.invalid", ns_t_a, 0);
+  EXPECT_EQ(answer.records().size(), 0);
+  EXPECT_EQ(2, wait_for_query_count(server, "bad.domain.invalid", 2));
+  EXPECT_EQ(1u, r->negative_hits());
+
+  delete r;
+  cwtest_reset_time();
+}
+
+/// Fixture for the nameserver racing tests, which run two dnsmasqs serving the
+/// same records.
+class RacingDNSTest : public ::testing::Test
+{
+  static const int HEDGE_MS = 500;
+
+  virtual void SetUp()
+  {
+    std::map<std::string, std::vector<std::string>> records =
+      {{"a.query", {"1.2.3.4"}}, {"b.query", {"5.6.7.8"}}, {"c.query", {"9.10.11.12"}}};
+    _servers.emplace_back(new DnsmasqInstance("127.0.0.201", 5353, records, false, 300));
+    _servers.emplace_back(new DnsmasqInstance("127.0.0.202", 5353, records, false, 300));
+
+    for (size_t ii = 0; ii < _servers.size(); ++ii)
+    {
+      _servers[ii]->start_instance();
+      _servers[ii]->wait_for_instance();
+    }
+
+    // Use a long hedge delay, so that demoted servers are reliably left out of
+    // races even when the tests are running slowly (e.g. under Valgrind).
+    _resolver = new RacingDnsResolver({"127.0.0.201", "127.0.0.202"}, 5353, HEDGE_MS);
+  }
+
+  virtual void TearDown()
+  {
+    delete _resolver; _resolver = NULL;
+    _servers.clear();
+  }
+
+  /// Wait (for up to five seconds) for the resolver to demote a server, which
+  /// happens once its outstanding queries have timed out.
+  bool wait_for_demotion(size_t ix)
+  {
+    for (int ii = 0; (ii < 500) && (!_resolver->demoted(ix)); ++ii)
+    {
+      usleep(10000);
+    }
+
+    return _resolver->demoted(ix);
+  }
+
+  std::vector<std::shared_ptr<DnsmasqInstance>> _servers;
+  RacingDnsResolver* _resolver;
+};
+
+TEST_F(RacingDNSTest, BothServersUp)
+{
+  DnsResult answer = _resolver->dns_query("a.query", ns_t_a, 0);
+  ASSERT_EQ(answer.records().size(), 1);
+  EXPECT_FALSE(_resolver->demoted(0));
+  EXPECT_FALSE(_resolver->demoted(1));
+  EXPECT_EQ(1u, _resolver->wins(0) + _resolver->wins(1));
+}
+
+TEST_F(RacingDNSTest, ServerKilled)
+{
+  DnsResult answer = _resolver->dns_query("a.query", ns_t_a, 0);
+  ASSERT_EQ(answer.records().size(), 1);
+
+  // Lookups keep working when one of the servers is killed, and the killed
+  // server is demoted.
+  _servers[0]->kill_instance();
+
+  answer = _resolver->dns_query("b.query", ns_t_a, 0);
+  ASSERT_EQ(answer.records().size(), 1);
+  EXPECT_TRUE(wait_for_demotion(0));
+  EXPECT_FALSE(_resolver->demoted(1));
+
+  // Once demoted, the killed server isn't queried unless the other server is
+  // slow.
+  uint64_t failures = _resolver->failures(0);
+  answer = _resolver->dns_query("c.query", ns_t_a, 0);
+  ASSERT_EQ(answer.records().size(), 1);
+  EXPECT_EQ(failures, _resolver->failures(0));
+
+  _servers[0]->start_instance();
+  _servers[0]->wait_for_instance();
+}
+
+TEST_F(RacingDNSTest, ServerPaused)
+{
+  // A paused server doesn't answer at all, so without racing each lookup
+  // would wait for it to time out.
+  _servers[0]->pause_instance();
+
+  uint64_t start_ns = real_time_ns();
+  DnsResult answer = _resolver->dns_query("a.query", ns_t_a, 0);
+  uint64_t elapsed_ms = (real_time_ns() - start_ns) / 1000000;
+  ASSERT_EQ(answer.records().size(), 1);
+  EXPECT_EQ(1u, _resolver->wins(1));
+
+  // Both servers were healthy, so both were queried straight away and the
+  // lookup didn't wait for the hedge delay (let alone the paused server).
+  EXPECT_LT(elapsed_ms, (uint64_t)HEDGE_MS);
+
+  EXPECT_TRUE(wait_for_demotion(0));
+
+  _servers[0]->resume_instance();
+}
+
+TEST_F(RacingDNSTest, CachedAnswerNotRaced)
+{
+  DnsResult answer = _resolver->dns_query("a.query", ns_t_a, 0);
+  ASSERT_EQ(answer.records().size(), 1);
+  uint64_t wins = _resolver->wins(0) + _resolver->wins(1);
+
+  // The winner has the answer cached, so a repeated lookup is answered from
+  // its cache without starting another race, even with both servers down.
+  _servers[0]->kill_instance();
+  _servers[1]->kill_instance();
+
+  answer = _resolver->dns_query("a.query", ns_t_a, 0);
+  ASSERT_EQ(answer.records().size(), 1);
+  EXPECT_EQ(wins, _resolver->wins(0) + _resolver->wins(1));
+  EXPECT_EQ(0u, _resolver->failures(0) + _resolver->failures(1));
+
+  _servers[0]->start_instance();
+  _servers[0]->wait_for_instance();
+  _servers[1]->start_instance();
+  _servers[1]->wait_for_instance();
+}
+
+TEST_F(DNSTest, WarmStartFromSnapshot)
+{
+  const std::string snapshot = "./dns_snapshot";
+  remove(snapshot.c_str());
+
+  DnsmasqInstance server("127.0.0.201", 5353, {{"astaire.local", {"1.2.3.4"}}}, false, 300);
+  server.start_instance();
+  server.wait_for_instance();
+
+  // Resolve the name, and write the snapshot by destroying the resolver.
+  SnapshottingDnsResolver* r = new SnapshottingDnsResolver("127.0.0.201", 5353, snapshot);
+  DnsResult answer = r->dns_query("astaire.local", ns_t_a, 0);
+  ASSERT_EQ(answer.records().size(), 1);
+  delete r;
+
+  // With DNS down, a restarted resolver still resolves the name from the
+  // snapshot.
+  server.kill_instance();
+
+  r = new SnapshottingDnsResolver("127.0.0.201", 5353, snapshot);
+  EXPECT_EQ(1u, r->loaded());
+
+  answer = r->dns_query("astaire.local", ns_t_a, 0);
+  ASSERT_EQ(answer.records().size(), 1);
+  EXPECT_EQ(inet_addr("1.2.3.4"), ((DnsARecord*)answer.records()[0])->address().s_addr);
+  EXPECT_GT(answer.ttl(), 0);
+  EXPECT_LE(answer.ttl(), 300);
+  delete r;
+
+  // Once the TTL has run out, the snapshot no longer has the name.
+  cwtest_advance_time_ms(301000);
+
+  r = new SnapshottingDnsResolver("127.0.0.201", 5353, snapshot);
+  EXPECT_EQ(0u, r->loaded());
+
+  answer = r->dns_query("astaire.local", ns_t_a, 0);
+  EXPECT_EQ(answer.records().size(), 0);
+  delete r;
+
+  cwtest_reset_time();
+  remove(snapshot.c_str());
+}
+
+TEST_F(DNSTest, AstaireIpLiteralsSkipDns)
+{
+  // Nothing is listening for DNS, so the literals must be resolved without it.
+  DnsCachedResolver* dns = new DnsCachedResolver("127.0.0.201", 5353);
+  CachedAstaireResolver* r = new CachedAstaireResolver(dns, AF_INET);
+
+  std::vector<AddrInfo> targets = r->resolve("127.0.0.1", 11311, 0);
+  ASSERT_EQ(1u, targets.size());
+  EXPECT_EQ(AF_INET, targets[0].address.af);
+  EXPECT_EQ(inet_addr("127.0.0.1"), targets[0].address.addr.ipv4.s_addr);
+  EXPECT_EQ(11311, targets[0].port);
+
+  targets = r->resolve("[::1]", 11311, 0);
+  ASSERT_EQ(1u, targets.size());
+  EXPECT_EQ(AF_INET6, targets[0].address.af);
+
+  EXPECT_EQ(2u, r->literal_hits());
+  EXPECT_EQ(0u, r->cache_misses());
+
+  delete r;
+  delete dns;
+}
+
+TEST_F(DNSTest, AstaireTargetsAreCached)
+{
+  DnsmasqInstance server("127.0.0.201", 5353, {{"astaire.local", {"1.2.3.4"}}}, false, 300);
+  server.start_instance();
+  server.wait_for_instance();
+
+  cwtest_completely_control_time(true);
+  DnsCachedResolver* dns = new DnsCachedResolver("127.0.0.201", 5353);
+  CachedAstaireResolver* r = new CachedAstaireResolver(dns, AF_INET, 5000);
+
+  // Only the first resolution does the work until the cap on the TTL passes.
+  for (int ii = 0; ii < 3; ++ii)
+  {
+    std::vector<AddrInfo> targets = r->resolve("astaire.local", 11311, 0);
+    ASSERT_EQ(1u, targets.size());
+    EXPECT_EQ(inet_addr("1.2.3.4"), targets[0].address.addr.ipv4.s_addr);
+  }
+
+  EXPECT_EQ(1u, r->cache_misses());
+  EXPECT_EQ(2u, r->cache_hits());
+
+  cwtest_advance_time_ms(5001);
+  EXPECT_EQ(1u, r->resolve("astaire.local", 11311, 0).size());
+  EXPECT_EQ(2u, r->cache_misses());
+
+  // Each port is cached separately.
+  EXPECT_EQ(1u, r->resolve("astaire.local", 11312, 0).size());
+  EXPECT_EQ(3u, r->cache_misses());
+
+  delete r;
+  delete dns;
+  cwtest_reset_time();
+}
+
+// Measure the cost of resolving the Astaire targets before each store
+// operation, with and without the fast path, for both a domain name and an IP
+// literal. This is disabled by default - use `make bench` to run it. The
+// number of resolutions can be set with ASTAIRE_RESOLVE_BENCH_OPS.
+TEST_F(DNSTest, DISABLED_AstaireResolutionOverhead)
+{
+  uint64_t ops = env_or_default("ASTAIRE_RESOLVE_BENCH_OPS", 100000);
+
+  DnsmasqInstance server("127.0.0.201", 5353, {{"astaire.local", {"1.2.3.4"}}}, false, 300);
+  server.start_instance();
+  server.wait_for_instance();
+
+  DnsCachedResolver* dns = new DnsCachedResolver("127.0.0.201", 5353);
+  AstaireResolver* plain = new AstaireResolver(dns, AF_INET);
+  CachedAstaireResolver* cached = new CachedAstaireResolver(dns, AF_INET);
+
+  const char* targets[] = {"astaire.local", "127.0.0.1"};
+
+  for (int ii = 0; ii < 2; ++ii)
+  {
+    std::string target = targets[ii];
+
+    double plain_ns = time_concurrent_ops(1, ops, [&](unsigned int thread_ix, uint64_t op)
+    {
+      plain->resolve(target, 11311, 0);
+    });
+    double cached_ns = time_concurrent_ops(1, ops, [&](unsigned int thread_ix, uint64_t op)
+    {
+      cached->resolve(target, 11311, 0);
+    });
+
+    printf("  %-20s AstaireResolver: %8.1f ns/op, CachedAstaireResolver: %8.1f ns/op\n",
+           target.c_str(), plain_ns, cached_ns);
+  }
+
+  delete cached;
+  delete plain;
+  delete dns;
+}
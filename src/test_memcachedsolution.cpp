@@ -39,15 +39,27 @@
 
 #include "memcachedstore.h"
 #include "processinstance.h"
+#include "benchmark_utils.h"
+#include "store_update.h"
+#include "fake_memcached.h"
+#include "test_interposer.hpp"
+#include "child_time.h"
+#include "direct_memcached_store.h"
+#include "coalescingstore.h"
 
 #include <vector>
 #include <iostream>
 #include <fstream>
 #include <stdio.h>
 #include <thread>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <condition_variable>
 
 static const SAS::TrailId DUMMY_TRAIL_ID = 0x12345678;
-static const int BASE_MEMCACHED_PORT = 33333;
+static const int BASE_MEMCACHED_PORT = env_or_default("MEMCACHED_BASE_PORT", 33333);
+static const int BASE_MEMCACHED_PROXY_PORT = BASE_MEMCACHED_PORT + 1000;
 static const int ASTAIRE_PORT = 11311;
 
 void signal_handler(int signal);
@@ -60,7 +72,7 @@ void signal_handler(int signal);
 // - Tidies up instances of memcached and Astaire and any config files between
 //   sets of tests.
 // - Provides helper methods for memcached operations and managing instances of
-//   memcached and Astaire
+//   memcached and Astaire (optionally behind fault-injecting proxies)
 class BaseMemcachedSolutionTest : public ::testing::Test
 {
 public:
@@ -80,6 +92,8 @@ public:
   {
     signal(SIGSEGV, SIG_DFL);
 
+    _memcached_proxies.clear();
+    _astaire_proxies.clear();
     _memcached_instances.clear();
     _astaire_instances.clear();
     _dnsmasq_instance.reset();
@@ -127,7 +141,12 @@ public:
   ///
   ///   servers=127.0.0.1:33333,127.0.0.1:33334,...
   ///
-  static void create_and_start_memcached_instances(int memcached_instances)
+  /// If `proxied` is set, each instance is put behind a ProxyInstance, and
+  /// cluster_settings points at the proxies instead. If `virtual_time` is set,
+  /// each instance runs with virtual time (see child_time.h).
+  static void create_and_start_memcached_instances(int memcached_instances,
+                                                   bool proxied = false,
+                                                   bool virtual_time = false)
   {
     std::ofstream cluster_settings("cluster_settings");
 
@@ -145,8 +164,17 @@ public:
       // Each instance should listen on a new port.
       int port = BASE_MEMCACHED_PORT + ii;
       _memcached_instances.emplace_back(new MemcachedInstance(port));
+      _memcached_instances.back()->use_virtual_time(virtual_time);
       _memcached_instances.back()->start_instance();
 
+      if (proxied)
+      {
+        int proxy_port = BASE_MEMCACHED_PROXY_PORT + ii;
+        _memcached_proxies.emplace_back(new ProxyInstance(proxy_port, port));
+        _memcached_proxies.back()->start_instance();
+        port = proxy_port;
+      }
+
       cluster_settings << "127.0.0.1:";
       cluster_settings << std::to_string(port).c_str();
     }
@@ -154,27 +182,112 @@ public:
     cluster_settings.close();
   }
 
+  /// Rewrite cluster_settings with the given servers (each of the form
+  /// "127.0.0.1:33333"). If `new_servers` is not empty, this describes a
+  /// resize from `servers` to `new_servers`, which Astaire will resynchronise
+  /// the data for once it reloads the file.
+  static void write_cluster_settings(const std::vector<std::string>& servers,
+                                     const std::vector<std::string>& new_servers = {})
+  {
+    std::ofstream cluster_settings("cluster_settings");
+    cluster_settings << "servers=" << join(servers) << "\n";
+
+    if (!new_servers.empty())
+    {
+      cluster_settings << "new_servers=" << join(new_servers) << "\n";
+    }
+
+    cluster_settings.close();
+  }
+
+  static std::string join(const std::vector<std::string>& servers)
+  {
+    std::string joined;
+
+    for (std::vector<std::string>::const_iterator server = servers.begin();
+         server != servers.end();
+         ++server)
+    {
+      joined += (joined.empty() ? "" : ",") + *server;
+    }
+
+    return joined;
+  }
+
+  /// Write `value` to every one of `keys`, split between `threads` threads.
+  /// Returns the number of writes that failed, and sets `ns_per_key` (if
+  /// given) to the average time taken per key.
+  unsigned int load_keys(const std::vector<std::string>& keys,
+                         const std::string& value,
+                         int expiry,
+                         unsigned int threads = 8,
+                         double* ns_per_key = NULL)
+  {
+    std::atomic<unsigned int> failures(0);
+    uint64_t start_ns = real_time_ns();
+
+    time_concurrent_ops(threads,
+                        (keys.size() + threads - 1) / threads,
+                        [&](unsigned int thread_ix, uint64_t op)
+    {
+      // The last round of writes may not need every thread.
+      size_t ix = (op * threads) + thread_ix;
+
+      if ((ix < keys.size()) &&
+          (set_data(keys[ix], value, 0, expiry) != Store::Status::OK))
+      {
+        failures++;
+      }
+    });
+
+    if ((ns_per_key != NULL) && (!keys.empty()))
+    {
+      *ns_per_key = (double)(real_time_ns() - start_ns) / keys.size();
+    }
+
+    return failures;
+  }
+
   /// Creates and starts up the specified number of Astaire instances. We
   /// currently only support one Astaire instance (since the port Astaire
   /// listens on is not currently configurable).
-  static void create_and_start_astaire_instances(int astaire_instances)
+  ///
+  /// If `proxied` is set, each instance is put behind a ProxyInstance. The
+  /// port Astaire listens on is fixed, so the proxies listen on the same port
+  /// on the 127.0.1.x addresses. If `virtual_time` is set, each instance runs
+  /// with virtual time (see child_time.h).
+  static void create_and_start_astaire_instances(int astaire_instances,
+                                                 bool proxied = false,
+                                                 bool virtual_time = false)
   {
     for (int ii = 0; ii < astaire_instances; ++ii)
     {
       std::string ip = "127.0.0." + std::to_string(ii + 1);
       _astaire_instances.emplace_back(new AstaireInstance(ip, ASTAIRE_PORT));
+      _astaire_instances.back()->use_virtual_time(virtual_time);
       _astaire_instances.back()->start_instance();
+
+      if (proxied)
+      {
+        std::string proxy_ip = "127.0.1." + std::to_string(ii + 1);
+        _astaire_proxies.emplace_back(
+          new ProxyInstance(proxy_ip, ASTAIRE_PORT, ip, ASTAIRE_PORT));
+        _astaire_proxies.back()->start_instance();
+      }
     }
   }
 
   /// Creates and starts up a dnsmasq instance to allow the store to find
-  /// Astaire instances.
+  /// Astaire instances (or the proxies in front of them), optionally with
+  /// virtual time.
+  template <class T>
   static void create_and_start_dns_for_astaire(
-    const std::vector<std::shared_ptr<AstaireInstance>>& astaires)
+    const std::vector<std::shared_ptr<T>>& astaires,
+    bool virtual_time = false)
   {
     std::vector<std::string> hosts;
 
-    for(std::vector<std::shared_ptr<AstaireInstance>>::const_iterator instance = astaires.begin();
+    for(typename std::vector<std::shared_ptr<T>>::const_iterator instance = astaires.begin();
         instance != astaires.end();
         ++instance)
     {
@@ -183,6 +296,7 @@ public:
 
     _dnsmasq_instance = std::shared_ptr<DnsmasqInstance>(
       new DnsmasqInstance("127.0.0.1", 5353, {{"astaire.local", hosts}}));
+    _dnsmasq_instance->use_virtual_time(virtual_time);
     _dnsmasq_instance->start_instance();
   }
 
@@ -217,6 +331,30 @@ public:
       }
     }
 
+    for (std::vector<std::shared_ptr<ProxyInstance>>::iterator inst = _memcached_proxies.begin();
+         inst != _memcached_proxies.end();
+         ++inst)
+    {
+      success = (*inst)->wait_for_instance();
+
+      if (!success)
+      {
+        return success;
+      }
+    }
+
+    for (std::vector<std::shared_ptr<ProxyInstance>>::iterator inst = _astaire_proxies.begin();
+         inst != _astaire_proxies.end();
+         ++inst)
+    {
+      success = (*inst)->wait_for_instance();
+
+      if (!success)
+      {
+        return success;
+      }
+    }
+
     if (_dnsmasq_instance)
     {
       success = _dnsmasq_instance->wait_for_instance();
@@ -282,6 +420,11 @@ public:
   static std::vector<std::shared_ptr<AstaireInstance>> _astaire_instances;
   static std::shared_ptr<DnsmasqInstance> _dnsmasq_instance;
 
+  /// The proxies in front of the memcached and Astaire instances (in the same
+  /// order). These are empty unless the fixture asks for proxies.
+  static std::vector<std::shared_ptr<ProxyInstance>> _memcached_proxies;
+  static std::vector<std::shared_ptr<ProxyInstance>> _astaire_proxies;
+
   /// Tests that use this fixture use a monotonically incrementing numerical key
   /// (so that tests are isolated from each other). This variable stores the
   /// next key to use.
@@ -295,6 +438,8 @@ public:
 std::vector<std::shared_ptr<MemcachedInstance>> BaseMemcachedSolutionTest::_memcached_instances;
 std::vector<std::shared_ptr<AstaireInstance>> BaseMemcachedSolutionTest::_astaire_instances;
 std::shared_ptr<DnsmasqInstance> BaseMemcachedSolutionTest::_dnsmasq_instance;
+std::vector<std::shared_ptr<ProxyInstance>> BaseMemcachedSolutionTest::_memcached_proxies;
+std::vector<std::shared_ptr<ProxyInstance>> BaseMemcachedSolutionTest::_astaire_proxies;
 
 unsigned int BaseMemcachedSolutionTest::_next_key;
 const std::string BaseMemcachedSolutionTest::_table = "test_table";
@@ -306,6 +451,8 @@ void signal_handler(int sig)
 {
   signal(SIGSEGV, SIG_DFL);
 
+  BaseMemcachedSolutionTest::_memcached_proxies.clear();
+  BaseMemcachedSolutionTest::_astaire_proxies.clear();
   BaseMemcachedSolutionTest::_memcached_instances.clear();
   BaseMemcachedSolutionTest::_astaire_instances.clear();
   BaseMemcachedSolutionTest::_dnsmasq_instance.reset();
@@ -331,6 +478,22 @@ class ParameterizedMemcachedSolutionTest : public BaseMemcachedSolutionTest
   }
 };
 
+/// As ParameterizedMemcachedSolutionTest, but with every memcached and Astaire
+/// behind a ProxyInstance, so that scenarios can degrade them (rather than
+/// just kill them).
+template <class T>
+class ProxiedMemcachedSolutionTest : public BaseMemcachedSolutionTest
+{
+  static void SetUpTestCase()
+  {
+    create_and_start_memcached_instances(T::num_memcached_instances(), true);
+    create_and_start_astaire_instances(T::num_astaire_instances(), true);
+    create_and_start_dns_for_astaire(_astaire_proxies);
+
+    BaseMemcachedSolutionTest::SetUpTestCase();
+  }
+};
+
 /// Useful pre-canned scenarios.
 
 /// Scenario in which everything is fine and dandy.
@@ -412,6 +575,42 @@ class AstaireRestartsScenario
   }
 };
 
+/// Scenario in which a memcached instance freezes (but its connections stay
+/// up), and later recovers.
+class MemcachedPausesScenario
+{
+  static int num_memcached_instances() { return 2; }
+  static int num_astaire_instances() { return 2; }
+
+  static void trigger_failure(BaseMemcachedSolutionTest* fixture)
+  {
+    EXPECT_TRUE(fixture->_memcached_instances.back()->pause_instance());
+  }
+
+  static void fix_failure(BaseMemcachedSolutionTest* fixture)
+  {
+    EXPECT_TRUE(fixture->_memcached_instances.back()->resume_instance());
+  }
+};
+
+/// Scenario in which an Astaire instance freezes (but its connections stay up),
+/// and later recovers.
+class AstairePausesScenario
+{
+  static int num_memcached_instances() { return 2; }
+  static int num_astaire_instances() { return 2; }
+
+  static void trigger_failure(BaseMemcachedSolutionTest* fixture)
+  {
+    EXPECT_TRUE(fixture->_astaire_instances.back()->pause_instance());
+  }
+
+  static void fix_failure(BaseMemcachedSolutionTest* fixture)
+  {
+    EXPECT_TRUE(fixture->_astaire_instances.back()->resume_instance());
+  }
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 ///
 /// SimpleMemcachedSolutionTest testcases start here.
@@ -762,6 +961,194 @@ TEST_F(SimpleMemcachedSolutionTest, DomainAndPort)
   EXPECT_EQ(Store::Status::NOT_FOUND, rc);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+///
+/// FakeMemcachedSolutionTest testcases start here.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+/// Test fixture that sets up 2 Astaires in front of 2 fake memcacheds. The
+/// fakes run in the test process, so the tests can move their clocks on rather
+/// than waiting for data to expire.
+class FakeMemcachedSolutionTest : public BaseMemcachedSolutionTest
+{
+  static void SetUpTestCase()
+  {
+    std::vector<std::string> servers;
+
+    for (int ii = 0; ii < 2; ++ii)
+    {
+      int port = BASE_MEMCACHED_PORT + ii;
+      _fake_memcached_instances.emplace_back(new FakeMemcachedServer(port));
+      _fake_memcached_instances.back()->start_instance();
+      servers.push_back("127.0.0.1:" + std::to_string(port));
+    }
+
+    write_cluster_settings(servers);
+    create_and_start_astaire_instances(2);
+    create_and_start_dns_for_astaire(_astaire_instances);
+
+    BaseMemcachedSolutionTest::SetUpTestCase();
+  }
+
+  static void TearDownTestCase()
+  {
+    BaseMemcachedSolutionTest::TearDownTestCase();
+    _fake_memcached_instances.clear();
+  }
+
+  virtual void TearDown()
+  {
+    cwtest_reset_time();
+    BaseMemcachedSolutionTest::TearDown();
+  }
+
+  static std::vector<std::shared_ptr<FakeMemcachedServer>> _fake_memcached_instances;
+};
+
+std::vector<std::shared_ptr<FakeMemcachedServer>> FakeMemcachedSolutionTest::_fake_memcached_instances;
+
+/// Add a key that expires. This mirrors SimpleMemcachedSolutionTest.AddGetExpire.
+TEST_F(FakeMemcachedSolutionTest, AddGetExpire)
+{
+  uint64_t cas = 0;
+  Store::Status rc;
+  std::string data_in = "FakeMemcachedSolutionTest.AddGetExpire";
+  std::string data_out;
+
+  cwtest_completely_control_time(true);
+
+  rc = this->set_data(data_in, cas, 1);
+  EXPECT_EQ(Store::Status::OK, rc);
+
+  rc = this->get_data(data_out, cas);
+  EXPECT_EQ(Store::Status::OK, rc);
+  EXPECT_EQ(data_out, data_in);
+
+  cwtest_advance_time_ms(2000);
+
+  rc = this->get_data(data_out, cas);
+  EXPECT_EQ(Store::Status::NOT_FOUND, rc);
+}
+
+/// Add a key that expires, and kill one of the fake memcacheds. This mirrors
+/// MemcachedSolutionFailureTest.AddKillGetExpire (with the memcached fails
+/// scenario).
+TEST_F(FakeMemcachedSolutionTest, AddKillGetExpire)
+{
+  uint64_t cas = 0;
+  Store::Status rc;
+  std::string data_in = "FakeMemcachedSolutionTest.AddKillGetExpire";
+  std::string data_out;
+
+  cwtest_completely_control_time(true);
+
+  rc = this->set_data(data_in, cas, 1);
+  EXPECT_EQ(Store::Status::OK, rc);
+
+  EXPECT_TRUE(_fake_memcached_instances.back()->kill_instance());
+
+  cwtest_advance_time_ms(2000);
+
+  rc = this->get_data(data_out, cas);
+  EXPECT_EQ(Store::Status::NOT_FOUND, rc);
+
+  EXPECT_TRUE(_fake_memcached_instances.back()->start_instance());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///
+/// VirtualTimeMemcachedSolutionTest testcases start here.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+/// Test fixture that sets up 2 Astaires and 2 memcacheds, all running with
+/// virtual time. advance_all_clocks_ms moves their clocks on along with the
+/// tests', so data can be expired without waiting for it.
+class VirtualTimeMemcachedSolutionTest : public BaseMemcachedSolutionTest
+{
+  static void SetUpTestCase()
+  {
+    create_and_start_memcached_instances(2, false, true);
+    create_and_start_astaire_instances(2, false, true);
+    create_and_start_dns_for_astaire(_astaire_instances, true);
+
+    BaseMemcachedSolutionTest::SetUpTestCase();
+  }
+
+  /// Only put the clocks back once the instances have been killed.
+  static void TearDownTestCase()
+  {
+    BaseMemcachedSolutionTest::TearDownTestCase();
+    reset_all_clocks();
+    remove(child_time_file().c_str());
+  }
+
+  /// Wait for the test's key to expire. memcached only reads its clock once a
+  /// second, so this can take up to a second after the clocks are moved on.
+  Store::Status get_data_until_expired(std::string& data, uint64_t& cas)
+  {
+    Store::Status rc = Store::Status::OK;
+
+    for (int ii = 0; (ii < 30) && (rc == Store::Status::OK); ++ii)
+    {
+      rc = this->get_data(data, cas);
+
+      if (rc == Store::Status::OK)
+      {
+        usleep(100000);
+      }
+    }
+
+    return rc;
+  }
+};
+
+/// Add a key that expires, and move the clocks on past its expiry.
+TEST_F(VirtualTimeMemcachedSolutionTest, AddGetExpire)
+{
+  uint64_t cas = 0;
+  Store::Status rc;
+  std::string data_in = "VirtualTimeMemcachedSolutionTest.AddGetExpire";
+  std::string data_out;
+
+  rc = this->set_data(data_in, cas, 60);
+  EXPECT_EQ(Store::Status::OK, rc);
+
+  advance_all_clocks_ms(30000);
+
+  rc = this->get_data(data_out, cas);
+  EXPECT_EQ(Store::Status::OK, rc);
+  EXPECT_EQ(data_out, data_in);
+
+  advance_all_clocks_ms(31000);
+
+  rc = this->get_data_until_expired(data_out, cas);
+  EXPECT_EQ(Store::Status::NOT_FOUND, rc);
+}
+
+/// Add a key that expires, kill a memcached, and move the clocks on past the
+/// key's expiry.
+TEST_F(VirtualTimeMemcachedSolutionTest, AddKillGetExpire)
+{
+  uint64_t cas = 0;
+  Store::Status rc;
+  std::string data_in = "VirtualTimeMemcachedSolutionTest.AddKillGetExpire";
+  std::string data_out;
+
+  rc = this->set_data(data_in, cas, 60);
+  EXPECT_EQ(Store::Status::OK, rc);
+
+  EXPECT_TRUE(_memcached_instances.back()->kill_instance());
+
+  advance_all_clocks_ms(61000);
+
+  rc = this->get_data_until_expired(data_out, cas);
+  EXPECT_EQ(Store::Status::NOT_FOUND, rc);
+
+  EXPECT_TRUE(_memcached_instances.back()->start_instance());
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 ///
 /// MemcachedSolutionFailureTest testcases start here.
@@ -786,7 +1173,9 @@ typedef ::testing::Types<
   MemcachedRestartsScenario,
   AstaireFailsScenario,
   AstaireRestartsScenario,
-  LoneAstaireRestartsScenario
+  LoneAstaireRestartsScenario,
+  MemcachedPausesScenario,
+  AstairePausesScenario
 > FailureScenarios;
 
 TYPED_TEST_CASE(MemcachedSolutionFailureTest, FailureScenarios);
@@ -990,6 +1379,41 @@ TYPED_TEST(MemcachedSolutionFailureTest, AddKillCASDelete)
   TypeParam::fix_failure(this);
 }
 
+/// Time each operation while an instance is failed, and check that none of
+/// them take longer than the store's timeouts should allow. A frozen instance
+/// in particular must not block the caller indefinitely. The bound can be
+/// changed with STORE_LATENCY_BOUND_MS.
+TYPED_TEST(MemcachedSolutionFailureTest, KillLatency)
+{
+  uint64_t bound_ns = env_or_default("STORE_LATENCY_BOUND_MS", 6000) * 1000000;
+  LatencyRecorder latency;
+
+  TypeParam::trigger_failure(this);
+
+  for (int ii = 0; ii < 5; ++ii)
+  {
+    this->get_new_key();
+
+    uint64_t cas = 0;
+    std::string data_in = "MemcachedSolutionFailureTest.KillLatency";
+    std::string data_out;
+    uint64_t start_ns;
+
+    start_ns = real_time_ns();
+    EXPECT_EQ(Store::Status::OK, this->set_data(data_in, cas));
+    latency.record(real_time_ns() - start_ns);
+
+    start_ns = real_time_ns();
+    EXPECT_EQ(Store::Status::OK, this->get_data(data_out, cas));
+    latency.record(real_time_ns() - start_ns);
+  }
+
+  TypeParam::fix_failure(this);
+
+  printf("Operation latency during failure: %s\n", latency.summary().c_str());
+  EXPECT_GE(bound_ns, latency.max());
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 ///
 /// LargerClustersMemcachedSolutionTest testcases start here.
@@ -1094,35 +1518,212 @@ TYPED_TEST(LargerClustersMemcachedSolutionTest, AddKillGetSet)
 }
 
 
-///////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
 ///
-/// MemcachedSolutionThrashTest tests.
+/// DegradedMemcachedSolutionTest testcases start here.
 ///
-///////////////////////////////////////////////////////////////////////////////
+/// These put a proxy in front of every memcached and Astaire, and use it to
+/// make one of them slow or unreachable (without killing it).
+///
+////////////////////////////////////////////////////////////////////////////////
 
 template <class T>
-class MemcachedSolutionThrashTest : public ParameterizedMemcachedSolutionTest<T> {};
-
-const static int NUM_INCR_PER_KEY_PER_THREAD = 10;
-
-// We would like to run the thrash test in various failure scenarios, but we
-// lose consistency in these cases due to different nodes disagreeing on which
-// memcached is the primary they should be CASing against.
-typedef ::testing::Types<
-  // MemcachedFailsScenario,
-  // MemcachedRestartsScenario,
-  // AstaireFailsScenario,
-  // AstaireRestartsScenario,
-  NoFailuresScenario
-> ThrashTestScenarios;
+class DegradedMemcachedSolutionTest : public ProxiedMemcachedSolutionTest<T> {};
 
-TYPED_TEST_CASE(MemcachedSolutionThrashTest, ThrashTestScenarios);
-
-void thrash_thread_fn(TopologyNeutralMemcachedStore* store,
-                      std::string table,
-                      std::vector<std::string> keys)
+/// Scenario in which a memcached instance becomes slow to respond.
+class SlowMemcachedScenario
 {
-  Store::Status rc;
+  static int num_memcached_instances() { return 2; }
+  static int num_astaire_instances() { return 2; }
+
+  static void trigger_failure(BaseMemcachedSolutionTest* fixture)
+  {
+    fixture->_memcached_proxies.back()->set_latency(50, 50);
+  }
+
+  static void fix_failure(BaseMemcachedSolutionTest* fixture)
+  {
+    fixture->_memcached_proxies.back()->clear_faults();
+  }
+};
+
+/// Scenario in which the link to a memcached instance has very little
+/// bandwidth.
+class ThrottledMemcachedScenario : public SlowMemcachedScenario
+{
+  static void trigger_failure(BaseMemcachedSolutionTest* fixture)
+  {
+    fixture->_memcached_proxies.back()->set_bandwidth(8 * 1024);
+  }
+};
+
+/// Scenario in which a memcached instance stops responding, but its
+/// connections stay up.
+class StalledMemcachedScenario : public SlowMemcachedScenario
+{
+  static void trigger_failure(BaseMemcachedSolutionTest* fixture)
+  {
+    fixture->_memcached_proxies.back()->set_stalled(true);
+  }
+};
+
+/// Scenario in which a memcached instance is partitioned from Astaire, leaving
+/// Astaire's connections to it half-open.
+class PartitionedMemcachedScenario : public SlowMemcachedScenario
+{
+  static void trigger_failure(BaseMemcachedSolutionTest* fixture)
+  {
+    fixture->_memcached_proxies.back()->set_half_open(true);
+  }
+};
+
+/// Scenario in which an Astaire instance becomes slow to respond.
+class SlowAstaireScenario : public SlowMemcachedScenario
+{
+  static void trigger_failure(BaseMemcachedSolutionTest* fixture)
+  {
+    fixture->_astaire_proxies.back()->set_latency(50, 50);
+  }
+
+  static void fix_failure(BaseMemcachedSolutionTest* fixture)
+  {
+    fixture->_astaire_proxies.back()->clear_faults();
+  }
+};
+
+/// Scenario in which an Astaire instance is partitioned from the store,
+/// leaving the store's connections to it half-open.
+class PartitionedAstaireScenario : public SlowAstaireScenario
+{
+  static void trigger_failure(BaseMemcachedSolutionTest* fixture)
+  {
+    fixture->_astaire_proxies.back()->set_half_open(true);
+  }
+};
+
+typedef ::testing::Types<
+  SlowMemcachedScenario,
+  ThrottledMemcachedScenario,
+  StalledMemcachedScenario,
+  PartitionedMemcachedScenario,
+  SlowAstaireScenario,
+  PartitionedAstaireScenario
+> DegradedScenarios;
+
+TYPED_TEST_CASE(DegradedMemcachedSolutionTest, DegradedScenarios);
+
+/// Degrade an instance. Add a key and retrieve it.
+TYPED_TEST(DegradedMemcachedSolutionTest, DegradeAddGet)
+{
+  TypeParam::trigger_failure(this);
+
+  uint64_t cas = 0;
+  Store::Status rc;
+  std::string data_in = "DegradedMemcachedSolutionTest.DegradeAddGet";
+  std::string data_out;
+
+  rc = this->set_data(data_in, cas);
+  EXPECT_EQ(Store::Status::OK, rc);
+
+  rc = this->get_data(data_out, cas);
+  EXPECT_EQ(Store::Status::OK, rc);
+  EXPECT_EQ(data_out, data_in);
+
+  TypeParam::fix_failure(this);
+}
+
+/// Add a key. Degrade an instance. Retrieve the key and update it.
+TYPED_TEST(DegradedMemcachedSolutionTest, AddDegradeGetSet)
+{
+  uint64_t cas = 0;
+  Store::Status rc;
+  std::string data_in = "DegradedMemcachedSolutionTest.AddDegradeGetSet";
+  std::string data_out;
+
+  rc = this->set_data(data_in, cas);
+  EXPECT_EQ(Store::Status::OK, rc);
+
+  TypeParam::trigger_failure(this);
+
+  rc = this->get_data(data_out, cas);
+  EXPECT_EQ(Store::Status::OK, rc);
+  EXPECT_EQ(data_out, data_in);
+
+  data_in = "DegradedMemcachedSolutionTest.AddDegradeGetSet_New";
+  rc = this->set_data(data_in, cas);
+  EXPECT_EQ(Store::Status::OK, rc);
+
+  rc = this->get_data(data_out, cas);
+  EXPECT_EQ(Store::Status::OK, rc);
+  EXPECT_EQ(data_out, data_in);
+
+  TypeParam::fix_failure(this);
+}
+
+/// Degrade an instance and time a series of operations through the store,
+/// checking that none of them take longer than the store's timeouts should
+/// allow. The bound can be changed with STORE_LATENCY_BOUND_MS.
+TYPED_TEST(DegradedMemcachedSolutionTest, DegradedLatency)
+{
+  uint64_t bound_ns = env_or_default("STORE_LATENCY_BOUND_MS", 6000) * 1000000;
+  LatencyRecorder latency;
+
+  TypeParam::trigger_failure(this);
+
+  for (int ii = 0; ii < 20; ++ii)
+  {
+    this->get_new_key();
+
+    uint64_t cas = 0;
+    std::string data_in = "DegradedMemcachedSolutionTest.DegradedLatency";
+    std::string data_out;
+    uint64_t start_ns;
+
+    start_ns = real_time_ns();
+    EXPECT_EQ(Store::Status::OK, this->set_data(data_in, cas));
+    latency.record(real_time_ns() - start_ns);
+
+    start_ns = real_time_ns();
+    EXPECT_EQ(Store::Status::OK, this->get_data(data_out, cas));
+    latency.record(real_time_ns() - start_ns);
+  }
+
+  TypeParam::fix_failure(this);
+
+  printf("Operation latency while degraded: %s\n", latency.summary().c_str());
+  EXPECT_GE(bound_ns, latency.max());
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// MemcachedSolutionThrashTest tests.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+class MemcachedSolutionThrashTest : public ParameterizedMemcachedSolutionTest<T> {};
+
+const static int NUM_INCR_PER_KEY_PER_THREAD = 10;
+
+// We would like to run the thrash test in various failure scenarios, but we
+// lose consistency in these cases due to different nodes disagreeing on which
+// memcached is the primary they should be CASing against.
+typedef ::testing::Types<
+  // MemcachedFailsScenario,
+  // MemcachedRestartsScenario,
+  // AstaireFailsScenario,
+  // AstaireRestartsScenario,
+  NoFailuresScenario
+> ThrashTestScenarios;
+
+TYPED_TEST_CASE(MemcachedSolutionThrashTest, ThrashTestScenarios);
+
+void thrash_thread_fn(TopologyNeutralMemcachedStore* store,
+                      std::string table,
+                      std::vector<std::string> keys)
+{
+  Store::Status rc;
 
   for (int i = 0; i < NUM_INCR_PER_KEY_PER_THREAD; ++i)
   {
@@ -1215,3 +1816,1139 @@ TYPED_TEST(MemcachedSolutionThrashTest, ThrashTest)
   }
 }
 
+// Measure how contention on a set of keys affects the cost of updating them,
+// with and without backing off between retries. Each run has a number of
+// threads each incrementing 10 keys MEMCACHED_THRASH_INCREMENTS times (default
+// 10), and reports the update rate, the retries per successful update, and
+// any updates abandoned because they were still contended after
+// MAX_UPDATE_ATTEMPTS attempts.
+TYPED_TEST(MemcachedSolutionThrashTest, DISABLED_ThrashContention)
+{
+  uint64_t increments = env_or_default("MEMCACHED_THRASH_INCREMENTS", 10);
+  const unsigned int thread_counts[] = {1, 2, 5, 10, 20};
+  const int max_backoffs_us[] = {0, DEFAULT_MAX_BACKOFF_US};
+
+  for (size_t ii = 0; ii < sizeof(thread_counts) / sizeof(thread_counts[0]); ++ii)
+  {
+    for (size_t jj = 0; jj < sizeof(max_backoffs_us) / sizeof(max_backoffs_us[0]); ++jj)
+    {
+      std::vector<std::string> keys;
+      UpdateStats stats;
+
+      for (int i = 0; i < 10; ++i)
+      {
+        this->get_new_key();
+        keys.push_back(this->_key);
+      }
+
+      double ns = time_concurrent_ops(thread_counts[ii],
+                                      increments * keys.size(),
+                                      [&](unsigned int thread_ix, uint64_t op)
+      {
+        Store::Status rc = update_data(this->_store,
+                                       this->_table,
+                                       keys[op % keys.size()],
+                                       [](std::string& data)
+                                       {
+                                         data = std::to_string(atoi(data.c_str()) + 1);
+                                       },
+                                       300,
+                                       DUMMY_TRAIL_ID,
+                                       &stats,
+                                       max_backoffs_us[jj]);
+        EXPECT_TRUE((rc == Store::Status::OK) ||
+                    (rc == Store::Status::DATA_CONTENTION));
+      });
+
+      printf("  %2u threads, max backoff %5dus: %7.0f updates/s, %5.2f retries/update, "
+             "%lu abandoned, %7.1fms backing off\n",
+             thread_counts[ii],
+             max_backoffs_us[jj],
+             stats.updates * 1e9 / (ns * thread_counts[ii] * increments * keys.size()),
+             stats.retries_per_update(),
+             (unsigned long)stats.abandoned.load(),
+             stats.backoff_us / 1000.0);
+    }
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// ClusterResizeMemcachedSolutionTest benchmarks.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+/// Fixture for resizing the memcached cluster under Astaire. This starts enough
+/// memcached instances for both the old and new cluster, but only the old ones
+/// are in cluster_settings to begin with. The sizes are set by
+/// MEMCACHED_RESIZE_FROM and MEMCACHED_RESIZE_TO.
+class ClusterResizeMemcachedSolutionTest : public BaseMemcachedSolutionTest
+{
+  static void SetUpTestCase()
+  {
+    int from = env_or_default("MEMCACHED_RESIZE_FROM", 2);
+    int to = env_or_default("MEMCACHED_RESIZE_TO", 3);
+
+    create_and_start_memcached_instances(std::max(from, to));
+    write_cluster_settings(servers(from));
+
+    // A single Astaire does all of the resynchronisation.
+    create_and_start_astaire_instances(1);
+    create_and_start_dns_for_astaire(_astaire_instances);
+
+    BaseMemcachedSolutionTest::SetUpTestCase();
+  }
+
+  /// The addresses of the first `count` memcached instances.
+  static std::vector<std::string> servers(int count)
+  {
+    std::vector<std::string> servers;
+
+    for (int ii = 0; ii < count; ++ii)
+    {
+      servers.push_back("127.0.0.1:" + std::to_string(_memcached_instances[ii]->port()));
+    }
+
+    return servers;
+  }
+
+  /// Sum a statistic across all the memcached instances.
+  static uint64_t total_stat(const std::string& name)
+  {
+    uint64_t total = 0;
+
+    for (std::vector<std::shared_ptr<MemcachedInstance>>::iterator inst = _memcached_instances.begin();
+         inst != _memcached_instances.end();
+         ++inst)
+    {
+      std::map<std::string, std::string> stats;
+
+      if ((*inst)->get_stats(stats))
+      {
+        total += strtoull(stats[name].c_str(), NULL, 10);
+      }
+    }
+
+    return total;
+  }
+};
+
+/// Load a population of keys, then resize the cluster and measure how long
+/// Astaire takes to resynchronise it, how much data it moves, and the latency
+/// of reads made while it does so. Afterwards every key must still be
+/// readable.
+///
+/// Astaire doesn't report when it has finished, so the resync is treated as
+/// complete once the memcached instances have seen no new writes for
+/// MEMCACHED_RESIZE_SETTLE_MS. The number of keys and foreground readers are
+/// set by MEMCACHED_RESIZE_KEYS and MEMCACHED_RESIZE_READERS.
+TEST_F(ClusterResizeMemcachedSolutionTest, DISABLED_ResizeUnderLoad)
+{
+  int from = env_or_default("MEMCACHED_RESIZE_FROM", 2);
+  int to = env_or_default("MEMCACHED_RESIZE_TO", 3);
+  unsigned int num_keys = env_or_default("MEMCACHED_RESIZE_KEYS", 100000);
+  unsigned int num_readers = env_or_default("MEMCACHED_RESIZE_READERS", 2);
+  uint64_t settle_ns = env_or_default("MEMCACHED_RESIZE_SETTLE_MS", 2000) * 1000000;
+  const unsigned int num_loaders = 8;
+  const std::string value(100, 'x');
+
+  std::vector<std::string> keys;
+
+  for (unsigned int ii = 0; ii < num_keys; ++ii)
+  {
+    keys.push_back(_key + "_" + std::to_string(ii));
+  }
+
+  // Load the keys.
+  double load_ns_per_key = 0;
+  unsigned int load_failures = load_keys(keys, value, 3600, num_loaders, &load_ns_per_key);
+
+  printf("Loaded %u keys (%.0f keys/s), %u failures\n",
+         num_keys, 1e9 / load_ns_per_key, load_failures);
+
+  // Start reading random keys in the foreground.
+  std::atomic<bool> resizing(true);
+  std::vector<LatencyRecorder> read_latency(num_readers);
+  std::atomic<unsigned int> read_failures(0);
+  std::vector<std::thread> readers;
+
+  for (unsigned int ii = 0; ii < num_readers; ++ii)
+  {
+    readers.push_back(std::thread([&, ii]()
+    {
+      unsigned int seed = ii;
+
+      while (resizing)
+      {
+        std::string data;
+        uint64_t cas;
+        std::string key = keys[rand_r(&seed) % keys.size()];
+        uint64_t start_ns = real_time_ns();
+
+        if (get_data(key, data, cas) != Store::Status::OK)
+        {
+          read_failures++;
+        }
+
+        read_latency[ii].record(real_time_ns() - start_ns);
+      }
+    }));
+  }
+
+  // Move to the new cluster and wait for the writes to settle.
+  uint64_t bytes_before = total_stat("bytes_read");
+  uint64_t sets_before = total_stat("cmd_set");
+  uint64_t start_ns = real_time_ns();
+  uint64_t last_change_ns = start_ns;
+  uint64_t sets = sets_before;
+
+  write_cluster_settings(servers(from), servers(to));
+  EXPECT_TRUE(_astaire_instances.front()->reload_instance());
+
+  while (real_time_ns() - last_change_ns < settle_ns)
+  {
+    usleep(100000);
+    uint64_t now_sets = total_stat("cmd_set");
+
+    if (now_sets != sets)
+    {
+      sets = now_sets;
+      last_change_ns = real_time_ns();
+    }
+  }
+
+  uint64_t resync_ns = last_change_ns - start_ns;
+  uint64_t bytes_moved = total_stat("bytes_read") - bytes_before;
+
+  // Complete the resize.
+  write_cluster_settings(servers(to));
+  EXPECT_TRUE(_astaire_instances.front()->reload_instance());
+
+  resizing = false;
+
+  for (std::vector<std::thread>::iterator reader = readers.begin();
+       reader != readers.end();
+       ++reader)
+  {
+    reader->join();
+  }
+
+  LatencyRecorder latency;
+
+  for (std::vector<LatencyRecorder>::iterator recorder = read_latency.begin();
+       recorder != read_latency.end();
+       ++recorder)
+  {
+    latency.merge(*recorder);
+  }
+
+  // Bytes moved includes the (small) read requests made during the resync.
+  printf("Resized from %d to %d memcacheds in %lums\n",
+         from, to, (unsigned long)(resync_ns / 1000000));
+  printf("Moved %lu keys, %lu bytes (%.1f bytes/key)\n",
+         (unsigned long)(sets - sets_before),
+         (unsigned long)bytes_moved,
+         (double)bytes_moved / num_keys);
+  printf("Reads during resize: %s, %u failures\n",
+         latency.summary().c_str(),
+         read_failures.load());
+
+  EXPECT_EQ(0u, load_failures);
+  EXPECT_EQ(0u, read_failures.load());
+
+  // Check that none of the keys have been lost.
+  unsigned int lost = 0;
+
+  for (std::vector<std::string>::iterator key = keys.begin();
+       key != keys.end();
+       ++key)
+  {
+    std::string data;
+    uint64_t cas;
+
+    if (get_data(*key, data, cas) != Store::Status::OK)
+    {
+      lost++;
+    }
+  }
+
+  EXPECT_EQ(0u, lost);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// ValueSizeMemcachedSolutionTest testcases start here.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+/// Test fixture that sets up 1 Astaire and 2 memcacheds, and is parameterized
+/// over the size of the values stored.
+class ValueSizeMemcachedSolutionTest : public BaseMemcachedSolutionTest,
+                                       public ::testing::WithParamInterface<size_t>
+{
+  static void SetUpTestCase()
+  {
+    create_and_start_memcached_instances(2);
+    create_and_start_astaire_instances(1);
+    create_and_start_dns_for_astaire(_astaire_instances);
+
+    BaseMemcachedSolutionTest::SetUpTestCase();
+  }
+};
+
+INSTANTIATE_TEST_CASE_P(ValueSizes,
+                        ValueSizeMemcachedSolutionTest,
+                        ::testing::ValuesIn(VALUE_SIZES));
+
+/// Add a value, update it and retrieve it through Astaire.
+TEST_P(ValueSizeMemcachedSolutionTest, AddUpdateGet)
+{
+  uint64_t cas = 0;
+  Store::Status rc;
+  std::string data_in1 = patterned_value(GetParam(), 0);
+  std::string data_in2 = patterned_value(GetParam(), 1);
+  std::string data_out;
+
+  rc = set_data(data_in1, cas);
+  EXPECT_EQ(Store::Status::OK, rc);
+
+  rc = get_data(data_out, cas);
+  EXPECT_EQ(Store::Status::OK, rc);
+  EXPECT_TRUE(data_out == data_in1);
+
+  rc = set_data(data_in2, cas);
+  EXPECT_EQ(Store::Status::OK, rc);
+
+  rc = get_data(data_out, cas);
+  EXPECT_EQ(Store::Status::OK, rc);
+  EXPECT_TRUE(data_out == data_in2);
+}
+
+/// Compare the cost of writing and reading a value through Astaire (with
+/// TopologyNeutralMemcachedStore) against writing and reading it directly
+/// (with a MemcachedStore using the same cluster_settings). The difference per
+/// byte is the cost of Astaire proxying the value. The number of writes and
+/// reads can be set with MEMCACHED_VALUE_BENCH_OPS.
+TEST_P(ValueSizeMemcachedSolutionTest, DISABLED_Throughput)
+{
+  uint64_t ops = env_or_default("MEMCACHED_VALUE_BENCH_OPS", 1000);
+  std::string data_in = patterned_value(GetParam(), 0);
+  std::string data_out;
+  uint64_t cas;
+  std::atomic<unsigned int> failures(0);
+  MemcachedStore direct_store(false,
+                              new MemcachedConfigFileReader("./cluster_settings"),
+                              true);
+
+  // Write each value to a new key. Writing with a CAS of 0 adds the key, so
+  // rewriting the same key would fail.
+  std::vector<std::string> direct_keys;
+  std::vector<std::string> astaire_keys;
+
+  for (uint64_t op = 0; op < ops; ++op)
+  {
+    direct_keys.push_back(_key + "_direct_" + std::to_string(op));
+    astaire_keys.push_back(_key + "_astaire_" + std::to_string(op));
+  }
+
+  double direct_set_ns = time_concurrent_ops(1, ops, [&](unsigned int thread_ix, uint64_t op)
+  {
+    if (direct_store.set_data(_table, direct_keys[op], data_in, 0, 60, DUMMY_TRAIL_ID) !=
+        Store::Status::OK)
+    {
+      failures++;
+    }
+  });
+
+  double direct_get_ns = time_concurrent_ops(1, ops, [&](unsigned int thread_ix, uint64_t op)
+  {
+    if (direct_store.get_data(_table, direct_keys[op], data_out, cas, DUMMY_TRAIL_ID) !=
+        Store::Status::OK)
+    {
+      failures++;
+    }
+  });
+
+  double astaire_set_ns = time_concurrent_ops(1, ops, [&](unsigned int thread_ix, uint64_t op)
+  {
+    if (set_data(astaire_keys[op], data_in, 0) != Store::Status::OK)
+    {
+      failures++;
+    }
+  });
+
+  double astaire_get_ns = time_concurrent_ops(1, ops, [&](unsigned int thread_ix, uint64_t op)
+  {
+    if (get_data(astaire_keys[op], data_out, cas) != Store::Status::OK)
+    {
+      failures++;
+    }
+  });
+
+  EXPECT_EQ(0u, failures.load());
+  EXPECT_TRUE(data_out == data_in);
+
+  printf("  %8zu bytes: set %9.1f us (direct %9.1f us, +%6.2f ns/byte, %7.1f MB/s)\n",
+         GetParam(),
+         astaire_set_ns / 1000,
+         direct_set_ns / 1000,
+         (astaire_set_ns - direct_set_ns) / GetParam(),
+         GetParam() * 1000.0 / astaire_set_ns);
+  printf("  %8zu bytes: get %9.1f us (direct %9.1f us, +%6.2f ns/byte, %7.1f MB/s)\n",
+         GetParam(),
+         astaire_get_ns / 1000,
+         direct_get_ns / 1000,
+         (astaire_get_ns - direct_get_ns) / GetParam(),
+         GetParam() * 1000.0 / astaire_get_ns);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// ShardedMemcachedSolutionTest benchmarks.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+/// Fixture for a large cluster - MEMCACHED_SHARD_INSTANCES memcached instances
+/// (default 16) behind MEMCACHED_SHARD_ASTAIRES Astaire instances (default 1).
+/// The memcached instances listen on consecutive ports from MEMCACHED_BASE_PORT.
+class ShardedMemcachedSolutionTest : public BaseMemcachedSolutionTest
+{
+  static void SetUpTestCase()
+  {
+    create_and_start_memcached_instances(env_or_default("MEMCACHED_SHARD_INSTANCES", 16));
+    create_and_start_astaire_instances(env_or_default("MEMCACHED_SHARD_ASTAIRES", 1));
+    create_and_start_dns_for_astaire(_astaire_instances);
+
+    BaseMemcachedSolutionTest::SetUpTestCase();
+  }
+
+  /// Get the number of requests each memcached instance has handled.
+  static std::vector<uint64_t> requests_per_server()
+  {
+    std::vector<uint64_t> requests;
+
+    for (std::vector<std::shared_ptr<MemcachedInstance>>::iterator inst = _memcached_instances.begin();
+         inst != _memcached_instances.end();
+         ++inst)
+    {
+      std::map<std::string, std::string> stats;
+      (*inst)->get_stats(stats);
+      requests.push_back(strtoull(stats["cmd_get"].c_str(), NULL, 10) +
+                         strtoull(stats["cmd_set"].c_str(), NULL, 10));
+    }
+
+    return requests;
+  }
+
+  /// Run a workload of reads and writes (1 in 10 operations) over `keys`,
+  /// choosing keys with `zipf`, and report the aggregate throughput and how
+  /// evenly the load is spread over the memcached instances. Each write goes
+  /// to both replicas of a key, so is counted on two instances.
+  void run_workload(const std::string& name,
+                    const std::vector<std::string>& keys,
+                    const ZipfGenerator& zipf)
+  {
+    unsigned int threads = env_or_default("MEMCACHED_SHARD_THREADS", 8);
+    uint64_t ops = env_or_default("MEMCACHED_SHARD_OPS", 2000);
+    std::atomic<uint64_t> failures(0);
+    std::vector<unsigned int> seeds(threads);
+
+    for (unsigned int ii = 0; ii < threads; ++ii)
+    {
+      seeds[ii] = std::rand();
+    }
+
+    std::vector<uint64_t> before = requests_per_server();
+
+    double ns_per_op = time_concurrent_ops(threads, ops, [&](unsigned int thread_ix, uint64_t op)
+    {
+      std::string key = keys[zipf.next(seeds[thread_ix])];
+      std::string data;
+      uint64_t cas;
+      Store::Status rc = get_data(key, data, cas);
+
+      if ((rc == Store::Status::OK) && (op % 10 == 0))
+      {
+        // Writes may contend with other threads' writes to the same (hot)
+        // key, which isn't a failure.
+        rc = set_data(key, data, cas, 3600);
+        rc = (rc == Store::Status::DATA_CONTENTION) ? Store::Status::OK : rc;
+      }
+
+      if (rc != Store::Status::OK)
+      {
+        failures++;
+      }
+    });
+
+    std::vector<uint64_t> after = requests_per_server();
+
+    EXPECT_EQ(0u, failures.load());
+
+    uint64_t total = 0;
+    uint64_t max = 0;
+    std::vector<uint64_t> load;
+
+    for (size_t ii = 0; ii < after.size(); ++ii)
+    {
+      load.push_back(after[ii] - before[ii]);
+      total += load.back();
+      max = std::max(max, load.back());
+    }
+
+    double mean = (double)total / load.size();
+    double variance = 0;
+
+    for (size_t ii = 0; ii < load.size(); ++ii)
+    {
+      variance += (load[ii] - mean) * (load[ii] - mean) / load.size();
+    }
+
+    printf("%s: %.0f ops/s, %lu memcached requests\n",
+           name.c_str(), 1e9 / ns_per_op, (unsigned long)total);
+    printf("  per server: mean %.0f, max/mean %.2f, stddev/mean %.2f\n",
+           mean, max / mean, sqrt(variance) / mean);
+
+    for (size_t ii = 0; ii < load.size(); ++ii)
+    {
+      printf("  127.0.0.1:%d %8lu (%5.1f%%)\n",
+             _memcached_instances[ii]->port(),
+             (unsigned long)load[ii],
+             100.0 * load[ii] / total);
+    }
+  }
+};
+
+/// Spread a set of keys over a large cluster, then report the load on each
+/// server under a uniform and a Zipfian workload. The number of keys and the
+/// Zipf exponent (in hundredths) are set by MEMCACHED_SHARD_KEYS and
+/// MEMCACHED_SHARD_ZIPF_THETA.
+TEST_F(ShardedMemcachedSolutionTest, DISABLED_KeyDistribution)
+{
+  unsigned int num_keys = env_or_default("MEMCACHED_SHARD_KEYS", 10000);
+  double theta = env_or_default("MEMCACHED_SHARD_ZIPF_THETA", 99) / 100.0;
+  std::vector<std::string> keys;
+
+  for (unsigned int ii = 0; ii < num_keys; ++ii)
+  {
+    keys.push_back(_key + "_" + std::to_string(ii));
+  }
+
+  std::vector<uint64_t> before = requests_per_server();
+  EXPECT_EQ(0u, load_keys(keys, "ShardedMemcachedSolutionTest", 3600));
+
+  std::vector<uint64_t> after = requests_per_server();
+  printf("Loaded %u keys over %zu servers:", num_keys, after.size());
+
+  for (size_t ii = 0; ii < after.size(); ++ii)
+  {
+    printf(" %lu", (unsigned long)(after[ii] - before[ii]));
+  }
+
+  printf("\n");
+
+  run_workload("Uniform", keys, ZipfGenerator(num_keys, 0));
+  run_workload("Zipf (theta " + std::to_string(theta) + ")",
+               keys,
+               ZipfGenerator(num_keys, theta));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// DirectMemcachedSolutionTest testcases start here.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+/// Test fixture that sets up 1 Astaire and 4 memcacheds, and a
+/// DirectMemcachedStore for the same cluster alongside the usual
+/// TopologyNeutralMemcachedStore. With 2 replicas of each key, two keys can
+/// be on entirely different memcacheds, so a store that picks the wrong
+/// replicas can't read the other's data.
+class DirectMemcachedSolutionTest : public BaseMemcachedSolutionTest
+{
+  static void SetUpTestCase()
+  {
+    create_and_start_memcached_instances(4);
+    create_and_start_astaire_instances(1);
+    create_and_start_dns_for_astaire(_astaire_instances);
+
+    BaseMemcachedSolutionTest::SetUpTestCase();
+  }
+
+  virtual void SetUp()
+  {
+    BaseMemcachedSolutionTest::SetUp();
+
+    // Check cluster_settings before every operation, so the tests see changes
+    // to it straight away.
+    _direct_store = new DirectMemcachedStore(
+      "./cluster_settings",
+      new TopologyNeutralMemcachedStore("astaire.local", _resolver, true),
+      true,
+      0);
+  }
+
+  virtual void TearDown()
+  {
+    delete _direct_store; _direct_store = NULL;
+    BaseMemcachedSolutionTest::TearDown();
+  }
+
+  /// The addresses of the memcached instances.
+  static std::vector<std::string> servers()
+  {
+    std::vector<std::string> servers;
+
+    for (std::vector<std::shared_ptr<MemcachedInstance>>::iterator inst = _memcached_instances.begin();
+         inst != _memcached_instances.end();
+         ++inst)
+    {
+      servers.push_back("127.0.0.1:" + std::to_string((*inst)->port()));
+    }
+
+    return servers;
+  }
+
+  DirectMemcachedStore* _direct_store;
+};
+
+/// Data written directly can be read through Astaire and vice versa, as both
+/// pick the same replicas for each key.
+TEST_F(DirectMemcachedSolutionTest, AgreesWithAstaire)
+{
+  const int NUM_KEYS = 20;
+  uint64_t cas = 0;
+  Store::Status rc;
+  std::string data_out;
+
+  // Use enough keys that they are spread across all the memcacheds.
+  for (int ii = 0; ii < NUM_KEYS; ++ii)
+  {
+    std::string key = _key + "_direct_" + std::to_string(ii);
+    std::string data_in = "DirectMemcachedSolutionTest.AgreesWithAstaire " + key;
+    SCOPED_TRACE("Key " + key);
+
+    rc = _direct_store->set_data(_table, key, data_in, 0, 60, DUMMY_TRAIL_ID);
+    EXPECT_EQ(Store::Status::OK, rc);
+
+    rc = _store->get_data(_table, key, data_out, cas, DUMMY_TRAIL_ID);
+    EXPECT_EQ(Store::Status::OK, rc);
+    EXPECT_EQ(data_in, data_out);
+
+    // Update the key through Astaire using the CAS it returned, and check the
+    // direct store sees the update.
+    data_in += " updated";
+    rc = _store->set_data(_table, key, data_in, cas, 60, DUMMY_TRAIL_ID);
+    EXPECT_EQ(Store::Status::OK, rc);
+
+    rc = _direct_store->get_data(_table, key, data_out, cas, DUMMY_TRAIL_ID);
+    EXPECT_EQ(Store::Status::OK, rc);
+    EXPECT_EQ(data_in, data_out);
+  }
+
+  for (int ii = 0; ii < NUM_KEYS; ++ii)
+  {
+    std::string key = _key + "_astaire_" + std::to_string(ii);
+    std::string data_in = "DirectMemcachedSolutionTest.AgreesWithAstaire " + key;
+    SCOPED_TRACE("Key " + key);
+
+    rc = _store->set_data(_table, key, data_in, 0, 60, DUMMY_TRAIL_ID);
+    EXPECT_EQ(Store::Status::OK, rc);
+
+    rc = _direct_store->get_data(_table, key, data_out, cas, DUMMY_TRAIL_ID);
+    EXPECT_EQ(Store::Status::OK, rc);
+    EXPECT_EQ(data_in, data_out);
+
+    // Update the key directly using the CAS it returned, and check Astaire
+    // sees the update.
+    data_in += " updated";
+    rc = _direct_store->set_data(_table, key, data_in, cas, 60, DUMMY_TRAIL_ID);
+    EXPECT_EQ(Store::Status::OK, rc);
+
+    rc = _store->get_data(_table, key, data_out, cas, DUMMY_TRAIL_ID);
+    EXPECT_EQ(Store::Status::OK, rc);
+    EXPECT_EQ(data_in, data_out);
+  }
+
+  EXPECT_EQ(4u * NUM_KEYS, _direct_store->direct_ops());
+  EXPECT_EQ(0u, _direct_store->astaire_ops());
+}
+
+/// The direct store doesn't need Astaire.
+TEST_F(DirectMemcachedSolutionTest, AstaireDown)
+{
+  uint64_t cas = 0;
+  Store::Status rc;
+  std::string data_in = "DirectMemcachedSolutionTest.AstaireDown";
+  std::string data_out;
+
+  _astaire_instances[0]->kill_instance();
+
+  rc = _direct_store->set_data(_table, _key, data_in, cas, 60, DUMMY_TRAIL_ID);
+  EXPECT_EQ(Store::Status::OK, rc);
+
+  rc = _direct_store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(Store::Status::OK, rc);
+  EXPECT_EQ(data_in, data_out);
+
+  _astaire_instances[0]->restart_instance();
+}
+
+/// While the cluster is being resized, operations go through Astaire.
+TEST_F(DirectMemcachedSolutionTest, FallsBackDuringResize)
+{
+  uint64_t cas = 0;
+  Store::Status rc;
+  std::string data_in = "DirectMemcachedSolutionTest.FallsBackDuringResize";
+  std::string data_out;
+  std::vector<std::string> from = servers();
+  std::vector<std::string> to(from.begin(), from.begin() + 1);
+
+  // Astaire isn't told about the resize, so still uses the original cluster.
+  write_cluster_settings(from, to);
+
+  rc = _direct_store->set_data(_table, _key, data_in, cas, 60, DUMMY_TRAIL_ID);
+  EXPECT_EQ(Store::Status::OK, rc);
+  EXPECT_FALSE(_direct_store->direct());
+  EXPECT_EQ(1u, _direct_store->astaire_ops());
+
+  rc = get_data(data_out, cas);
+  EXPECT_EQ(Store::Status::OK, rc);
+  EXPECT_EQ(data_in, data_out);
+
+  // Once the resize is complete, operations go directly to memcached again.
+  write_cluster_settings(from);
+
+  rc = _direct_store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(Store::Status::OK, rc);
+  EXPECT_EQ(data_in, data_out);
+  EXPECT_TRUE(_direct_store->direct());
+  EXPECT_EQ(1u, _direct_store->direct_ops());
+}
+
+/// Compare the latency of writes and reads made directly and through Astaire,
+/// against the same cluster. The number of operations and threads can be set
+/// with MEMCACHED_DIRECT_BENCH_OPS and MEMCACHED_DIRECT_BENCH_THREADS.
+TEST_F(DirectMemcachedSolutionTest, DISABLED_DirectVsAstaire)
+{
+  uint64_t ops = env_or_default("MEMCACHED_DIRECT_BENCH_OPS", 10000);
+  unsigned int threads = env_or_default("MEMCACHED_DIRECT_BENCH_THREADS", 1);
+  const std::string data_in(100, 'x');
+
+  Store* stores[] = {_store, _direct_store};
+  const char* names[] = {"Astaire", "Direct"};
+
+  for (int ii = 0; ii < 2; ++ii)
+  {
+    Store* store = stores[ii];
+    std::vector<LatencyRecorder> set_latency(threads);
+    std::vector<LatencyRecorder> get_latency(threads);
+    std::atomic<unsigned int> failures(0);
+
+    double ns_per_op = time_concurrent_ops(threads, ops, [&](unsigned int thread_ix, uint64_t op)
+    {
+      std::string key = _key + "_" + std::to_string(thread_ix) + "_" + std::to_string(op);
+      std::string data_out;
+      uint64_t cas;
+
+      uint64_t start_ns = real_time_ns();
+
+      if (store->set_data(_table, key, data_in, 0, 60, DUMMY_TRAIL_ID) != Store::Status::OK)
+      {
+        failures++;
+      }
+
+      uint64_t mid_ns = real_time_ns();
+
+      if (store->get_data(_table, key, data_out, cas, DUMMY_TRAIL_ID) != Store::Status::OK)
+      {
+        failures++;
+      }
+
+      set_latency[thread_ix].record(mid_ns - start_ns);
+      get_latency[thread_ix].record(real_time_ns() - mid_ns);
+    });
+
+    LatencyRecorder set_total;
+    LatencyRecorder get_total;
+
+    for (unsigned int jj = 0; jj < threads; ++jj)
+    {
+      set_total.merge(set_latency[jj]);
+      get_total.merge(get_latency[jj]);
+    }
+
+    printf("%s: %.0f set+get/s, %u failures\n",
+           names[ii], 1e9 / ns_per_op, failures.load());
+    printf("  set: %s\n", set_total.summary().c_str());
+    printf("  get: %s\n", get_total.summary().c_str());
+
+    EXPECT_EQ(0u, failures.load());
+    get_new_key();
+  }
+
+  EXPECT_EQ(0u, _direct_store->astaire_ops());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// CoalescingMemcachedSolutionTest testcases start here.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+/// A store that passes operations on to another store, but can hold a read
+/// until the test releases it, so tests can control which reads overlap.
+class GatedStore : public Store
+{
+public:
+  GatedStore(Store* store) :
+    _store(store), _hold_next(false), _holding(false), _released(false) {};
+  virtual ~GatedStore() { delete _store; _store = NULL; }
+
+  /// Hold the next read until release is called.
+  void hold_next_get()
+  {
+    std::unique_lock<std::mutex> lock(_lock);
+    _hold_next = true;
+    _released = false;
+  }
+
+  /// Wait (for up to 5s) for a read to be held.
+  bool wait_for_held()
+  {
+    std::unique_lock<std::mutex> lock(_lock);
+    return _cond.wait_for(lock,
+                          std::chrono::seconds(5),
+                          [this]() { return _holding; });
+  }
+
+  void release()
+  {
+    std::unique_lock<std::mutex> lock(_lock);
+    _released = true;
+    _cond.notify_all();
+  }
+
+  virtual Status get_data(const std::string& table,
+                          const std::string& key,
+                          std::string& data,
+                          uint64_t& cas,
+                          SAS::TrailId trail = 0)
+  {
+    std::unique_lock<std::mutex> lock(_lock);
+
+    if (_hold_next)
+    {
+      _hold_next = false;
+      _holding = true;
+      _cond.notify_all();
+      _cond.wait(lock, [this]() { return _released; });
+      _holding = false;
+    }
+
+    lock.unlock();
+    return _store->get_data(table, key, data, cas, trail);
+  }
+
+  virtual Status set_data(const std::string& table,
+                          const std::string& key,
+                          const std::string& data,
+                          uint64_t cas,
+                          int expiry,
+                          SAS::TrailId trail = 0)
+  {
+    return _store->set_data(table, key, data, cas, expiry, trail);
+  }
+
+  virtual Status delete_data(const std::string& table,
+                             const std::string& key,
+                             SAS::TrailId trail = 0)
+  {
+    return _store->delete_data(table, key, trail);
+  }
+
+private:
+  Store* _store;
+  std::mutex _lock;
+  std::condition_variable _cond;
+  bool _hold_next;
+  bool _holding;
+  bool _released;
+};
+
+/// Test fixture that sets up 1 Astaire and 2 memcacheds, and a CoalescingStore
+/// on top of a TopologyNeutralMemcachedStore. The tests can hold reads between
+/// the two, to make other reads coalesce with them.
+class CoalescingMemcachedSolutionTest : public BaseMemcachedSolutionTest
+{
+  static void SetUpTestCase()
+  {
+    create_and_start_memcached_instances(2);
+    create_and_start_astaire_instances(1);
+    create_and_start_dns_for_astaire(_astaire_instances);
+
+    BaseMemcachedSolutionTest::SetUpTestCase();
+  }
+
+  virtual void SetUp()
+  {
+    BaseMemcachedSolutionTest::SetUp();
+
+    _gated_store = new GatedStore(
+      new TopologyNeutralMemcachedStore("astaire.local", _resolver, true));
+    _coalescing_store = new CoalescingStore(_gated_store);
+  }
+
+  virtual void TearDown()
+  {
+    delete _coalescing_store; _coalescing_store = NULL; _gated_store = NULL;
+    BaseMemcachedSolutionTest::TearDown();
+  }
+
+  /// Wait (for up to 5s) for `count` reads to have joined a fetch.
+  bool wait_for_coalesced(uint64_t count)
+  {
+    for (int ii = 0; (ii < 500) && (_coalescing_store->coalesced() < count); ++ii)
+    {
+      usleep(10000);
+    }
+
+    return (_coalescing_store->coalesced() == count);
+  }
+
+  GatedStore* _gated_store;
+  CoalescingStore* _coalescing_store;
+};
+
+/// Concurrent reads of a key share one fetch and its CAS, and only one of them
+/// can write the key back with that CAS.
+TEST_F(CoalescingMemcachedSolutionTest, ConcurrentGetsShareFetch)
+{
+  const int num_readers = 8;
+  std::string data_in = "CoalescingMemcachedSolutionTest.ConcurrentGetsShareFetch";
+  Store::Status rc;
+
+  rc = set_data(data_in, 0);
+  EXPECT_EQ(Store::Status::OK, rc);
+
+  std::vector<Store::Status> statuses(num_readers);
+  std::vector<std::string> data_out(num_readers);
+  std::vector<uint64_t> cas(num_readers);
+  std::vector<std::thread> readers;
+
+  // Hold the first read, so the rest join it.
+  _gated_store->hold_next_get();
+
+  for (int ii = 0; ii < num_readers; ++ii)
+  {
+    readers.push_back(std::thread([&, ii]()
+    {
+      statuses[ii] = _coalescing_store->get_data(_table, _key, data_out[ii], cas[ii], DUMMY_TRAIL_ID);
+    }));
+
+    if (ii == 0)
+    {
+      EXPECT_TRUE(_gated_store->wait_for_held());
+    }
+  }
+
+  EXPECT_TRUE(wait_for_coalesced(num_readers - 1));
+  _gated_store->release();
+
+  for (std::vector<std::thread>::iterator reader = readers.begin();
+       reader != readers.end();
+       ++reader)
+  {
+    reader->join();
+  }
+
+  EXPECT_EQ(1u, _coalescing_store->fetches());
+
+  for (int ii = 0; ii < num_readers; ++ii)
+  {
+    EXPECT_EQ(Store::Status::OK, statuses[ii]);
+    EXPECT_EQ(data_in, data_out[ii]);
+    EXPECT_EQ(cas[0], cas[ii]);
+  }
+
+  // Each reader tries to write back with the shared CAS. Only the first
+  // succeeds.
+  for (int ii = 0; ii < num_readers; ++ii)
+  {
+    rc = _coalescing_store->set_data(_table, _key, data_in + std::to_string(ii), cas[ii], 60, DUMMY_TRAIL_ID);
+    EXPECT_EQ((ii == 0) ? Store::Status::OK : Store::Status::DATA_CONTENTION, rc);
+  }
+
+  std::string data;
+  uint64_t new_cas;
+  rc = _coalescing_store->get_data(_table, _key, data, new_cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(Store::Status::OK, rc);
+  EXPECT_EQ(data_in + "0", data);
+  EXPECT_NE(cas[0], new_cas);
+}
+
+/// A read that starts after a write doesn't join a fetch that started before
+/// it, so never sees the data from before the write.
+TEST_F(CoalescingMemcachedSolutionTest, WriteDetachesInFlightFetch)
+{
+  std::string data_in1 = "CoalescingMemcachedSolutionTest.WriteDetachesInFlightFetch1";
+  std::string data_in2 = "CoalescingMemcachedSolutionTest.WriteDetachesInFlightFetch2";
+  std::string data_out;
+  uint64_t cas;
+  Store::Status rc;
+
+  rc = set_data(data_in1, 0);
+  EXPECT_EQ(Store::Status::OK, rc);
+  rc = get_data(data_out, cas);
+  EXPECT_EQ(Store::Status::OK, rc);
+
+  // Start a read and hold it.
+  _gated_store->hold_next_get();
+  std::thread reader([&]()
+  {
+    std::string reader_data;
+    uint64_t reader_cas;
+    _coalescing_store->get_data(_table, _key, reader_data, reader_cas, DUMMY_TRAIL_ID);
+  });
+  EXPECT_TRUE(_gated_store->wait_for_held());
+
+  rc = _coalescing_store->set_data(_table, _key, data_in2, cas, 60, DUMMY_TRAIL_ID);
+  EXPECT_EQ(Store::Status::OK, rc);
+
+  // This read makes its own fetch, rather than waiting for the held one.
+  rc = _coalescing_store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(Store::Status::OK, rc);
+  EXPECT_EQ(data_in2, data_out);
+
+  _gated_store->release();
+  reader.join();
+
+  EXPECT_EQ(2u, _coalescing_store->fetches());
+  EXPECT_EQ(0u, _coalescing_store->coalesced());
+}
+
+/// Concurrent read-modify-write updates through the coalescing store aren't
+/// lost, even though readers share CASes.
+TEST_F(CoalescingMemcachedSolutionTest, ConcurrentUpdatesAreNotLost)
+{
+  const int num_threads = 10;
+  const int increments = 10;
+  Store::Status rc;
+
+  rc = set_data(_key, "0", 0);
+  EXPECT_EQ(Store::Status::OK, rc);
+
+  UpdateStats stats;
+  std::vector<std::thread> threads;
+
+  for (int ii = 0; ii < num_threads; ++ii)
+  {
+    threads.push_back(std::thread([&]()
+    {
+      for (int jj = 0; jj < increments; ++jj)
+      {
+        Store::Status update_rc = update_data(_coalescing_store,
+                                              _table,
+                                              _key,
+                                              [](std::string& data)
+                                              {
+                                                data = std::to_string(atoi(data.c_str()) + 1);
+                                              },
+                                              60,
+                                              DUMMY_TRAIL_ID,
+                                              &stats);
+        EXPECT_EQ(Store::Status::OK, update_rc);
+      }
+    }));
+  }
+
+  for (std::vector<std::thread>::iterator thread = threads.begin();
+       thread != threads.end();
+       ++thread)
+  {
+    thread->join();
+  }
+
+  std::string data_out;
+  uint64_t cas;
+  rc = get_data(data_out, cas);
+  EXPECT_EQ(Store::Status::OK, rc);
+  EXPECT_EQ(num_threads * increments, atoi(data_out.c_str()));
+  EXPECT_EQ((uint64_t)(num_threads * increments), stats.updates.load());
+}
+
+/// Compare reads of a set of keys through TopologyNeutralMemcachedStore with
+/// and without coalescing, with many threads reading a Zipfian mix of keys.
+/// The number of threads, reads per thread and keys, and the Zipf exponent
+/// (in hundredths), are set by MEMCACHED_COALESCE_BENCH_THREADS,
+/// MEMCACHED_COALESCE_BENCH_OPS, MEMCACHED_COALESCE_BENCH_KEYS and
+/// MEMCACHED_COALESCE_ZIPF_THETA.
+TEST_F(CoalescingMemcachedSolutionTest, DISABLED_HotKeyReads)
+{
+  unsigned int threads = env_or_default("MEMCACHED_COALESCE_BENCH_THREADS", 64);
+  uint64_t ops = env_or_default("MEMCACHED_COALESCE_BENCH_OPS", 1000);
+  unsigned int num_keys = env_or_default("MEMCACHED_COALESCE_BENCH_KEYS", 1000);
+  double theta = env_or_default("MEMCACHED_COALESCE_ZIPF_THETA", 99) / 100.0;
+  ZipfGenerator zipf(num_keys, theta);
+  std::vector<std::string> keys;
+
+  for (unsigned int ii = 0; ii < num_keys; ++ii)
+  {
+    keys.push_back(_key + "_" + std::to_string(ii));
+  }
+
+  EXPECT_EQ(0u, load_keys(keys, "CoalescingMemcachedSolutionTest", 3600));
+
+  CoalescingStore coalescing_store(
+    new TopologyNeutralMemcachedStore("astaire.local", _resolver, true));
+  Store* stores[] = {_store, &coalescing_store};
+  const char* names[] = {"TopologyNeutralMemcachedStore", "CoalescingStore"};
+
+  printf("%u threads reading %u keys (Zipf theta %.2f)\n", threads, num_keys, theta);
+
+  for (int ii = 0; ii < 2; ++ii)
+  {
+    Store* store = stores[ii];
+    std::vector<unsigned int> seeds(threads);
+    std::vector<LatencyRecorder> latency(threads);
+    std::atomic<unsigned int> failures(0);
+
+    for (unsigned int jj = 0; jj < threads; ++jj)
+    {
+      seeds[jj] = jj;
+    }
+
+    double ns_per_op = time_concurrent_ops(threads, ops, [&](unsigned int thread_ix, uint64_t op)
+    {
+      std::string data;
+      uint64_t cas;
+      uint64_t start_ns = real_time_ns();
+
+      if (store->get_data(_table, keys[zipf.next(seeds[thread_ix])], data, cas, DUMMY_TRAIL_ID) !=
+          Store::Status::OK)
+      {
+        failures++;
+      }
+
+      latency[thread_ix].record(real_time_ns() - start_ns);
+    });
+
+    LatencyRecorder total;
+
+    for (unsigned int jj = 0; jj < threads; ++jj)
+    {
+      total.merge(latency[jj]);
+    }
+
+    printf("  %-30s %9.0f reads/s, %s, %u failures\n",
+           names[ii], 1e9 / ns_per_op, total.summary().c_str(), failures.load());
+    EXPECT_EQ(0u, failures.load());
+  }
+
+  printf("  %lu fetches, %lu reads coalesced (%.1f%%)\n",
+         (unsigned long)coalescing_store.fetches(),
+         (unsigned long)coalescing_store.coalesced(),
+         100.0 * coalescing_store.coalesced() /
+           (coalescing_store.fetches() + coalescing_store.coalesced()));
+}
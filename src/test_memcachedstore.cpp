@@ -37,6 +37,19 @@
 #include "gtest/gtest.h"
 
 #include "memcachedstore.h"
+#include "benchmark_utils.h"
+#include "memcached_value.h"
+#include "allocation_counter.h"
+#include "compressingstore.h"
+#include "cachingstore.h"
+#include "memcached_pipeline.h"
+#include "store_update.h"
+#include "fake_memcached.h"
+#include "test_interposer.hpp"
+#include "processinstance.h"
+#include "unix_socket_memcached_store.h"
+
+#include <atomic>
 
 // Helper macro that expects a "success" memcached return code, but prints out
 // a more useful error message if this fails.
@@ -174,6 +187,9 @@ const std::string MemcachedTest::_table = "test_table";
 class StaticConfigReader : public MemcachedConfigReader
 {
 public:
+  // Whether the store should use the binary protocol (rather than ASCII).
+  static const bool BINARY = false;
+
   bool read_config(MemcachedConfig& config)
   {
     config = _cfg;
@@ -195,6 +211,28 @@ class TombstoneConfig : public StaticConfigReader
 };
 
 
+// Config reader that configures MemcachedStore to use tombstones, and the
+// binary protocol.
+class BinaryTombstoneConfig : public TombstoneConfig
+{
+public:
+  static const bool BINARY = true;
+};
+
+
+// Config reader that configures MemcachedStore to use tombstones with the
+// given lifetime (in seconds).
+class TombstoneLifetimeConfig : public StaticConfigReader
+{
+public:
+  TombstoneLifetimeConfig(int tombstone_lifetime) : StaticConfigReader()
+  {
+    _cfg.servers.push_back("127.0.0.1:" + std::to_string(memcached_port()));
+    _cfg.tombstone_lifetime = tombstone_lifetime;
+  }
+};
+
+
 // Config reader that configures MemcachedStore to NOT use tombstones.
 class NoTombstoneConfig : public StaticConfigReader
 {
@@ -205,6 +243,15 @@ class NoTombstoneConfig : public StaticConfigReader
   }
 };
 
+
+// Config reader that configures MemcachedStore to NOT use tombstones, and to
+// use the binary protocol.
+class BinaryNoTombstoneConfig : public NoTombstoneConfig
+{
+public:
+  static const bool BINARY = true;
+};
+
 //
 // Basic MemcachedStore tests.
 //
@@ -222,7 +269,7 @@ public:
   virtual void SetUp()
   {
     MemcachedTest::SetUp();
-    _store = new MemcachedStore(false, new T(), true);
+    _store = new MemcachedStore(T::BINARY, new T(), true);
   }
 
   virtual void TearDown()
@@ -237,7 +284,10 @@ public:
   }
 };
 
-typedef ::testing::Types<TombstoneConfig, NoTombstoneConfig> StoreConfigs;
+typedef ::testing::Types<TombstoneConfig,
+                         NoTombstoneConfig,
+                         BinaryTombstoneConfig,
+                         BinaryNoTombstoneConfig> StoreConfigs;
 TYPED_TEST_CASE(SingleMemcachedStoreTest, StoreConfigs);
 
 
@@ -369,6 +419,256 @@ TYPED_TEST(SingleMemcachedStoreTest, KeyCanBeDeletedThenAdded)
   EXPECT_EQ(status, Store::OK);
 }
 
+//
+// MemcachedStore tests that sweep the size of the stored value.
+//
+
+// Test fixture that creates a single MemcachedStore and is parameterized over
+// the size of the values it stores.
+class ValueSizeMemcachedStoreTest : public MemcachedTest,
+                                    public ::testing::WithParamInterface<size_t>
+{
+public:
+  MemcachedStore* _store;
+
+  virtual void SetUp()
+  {
+    MemcachedTest::SetUp();
+    _store = new MemcachedStore(false, new TombstoneConfig(), true);
+  }
+
+  virtual void TearDown()
+  {
+    delete _store; _store = NULL;
+    MemcachedTest::TearDown();
+  }
+
+  static void SetUpTestCase()
+  {
+    MemcachedTest::SetUpTestCase();
+  }
+};
+
+INSTANTIATE_TEST_CASE_P(ValueSizes,
+                        ValueSizeMemcachedStoreTest,
+                        ::testing::ValuesIn(VALUE_SIZES));
+
+
+TEST_P(ValueSizeMemcachedStoreTest, SetUpdateDeleteSequence)
+{
+  Store::Status status;
+  const std::string data_in1 = patterned_value(GetParam(), 0);
+  const std::string data_in2 = patterned_value(GetParam(), 1);
+  std::string data_out;
+  uint64_t cas;
+
+  status = _store->set_data(_table, _key, data_in1, 0, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  status = _store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+  EXPECT_TRUE(data_out == data_in1);
+
+  status = _store->set_data(_table, _key, data_in2, cas, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  status = _store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+  EXPECT_TRUE(data_out == data_in2);
+
+  status = _store->delete_data(_table, _key, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+}
+
+
+// Compare the cost of writing and reading a value through MemcachedStore with
+// the cost of doing the same directly with libmemcached (plus the one copy
+// needed to return the value in a std::string). The difference per byte is
+// the cost of MemcachedStore's own copies of the value. This is disabled by
+// default - use `make bench` to run it. The number of writes and reads can be
+// set with MEMCACHED_VALUE_BENCH_OPS.
+TEST_P(ValueSizeMemcachedStoreTest, DISABLED_Throughput)
+{
+  uint64_t ops = env_or_default("MEMCACHED_VALUE_BENCH_OPS", 1000);
+  const std::string data_in = patterned_value(GetParam(), 0);
+  std::string data_out;
+  uint64_t cas;
+  std::atomic<unsigned int> failures(0);
+
+  // Write each value to a new key. Writing with a CAS of 0 adds the key, so
+  // rewriting the same key would fail.
+  std::vector<std::string> raw_keys;
+  std::vector<std::string> store_keys;
+
+  for (uint64_t op = 0; op < ops; ++op)
+  {
+    raw_keys.push_back(fqkey() + "_raw_" + std::to_string(op));
+    store_keys.push_back(_key + "_store_" + std::to_string(op));
+  }
+
+  double raw_set_ns = time_concurrent_ops(1, ops, [&](unsigned int thread_ix, uint64_t op)
+  {
+    memcached_return_t rc = memcached_set(_memcached_client,
+                                          raw_keys[op].c_str(),
+                                          raw_keys[op].length(),
+                                          data_in.c_str(),
+                                          data_in.length(),
+                                          300,
+                                          0);
+
+    if (!memcached_success(rc))
+    {
+      failures++;
+    }
+  });
+
+  double raw_get_ns = time_concurrent_ops(1, ops, [&](unsigned int thread_ix, uint64_t op)
+  {
+    size_t length;
+    uint32_t flags;
+    memcached_return_t rc;
+    char* value = memcached_get(_memcached_client,
+                                raw_keys[op].c_str(),
+                                raw_keys[op].length(),
+                                &length,
+                                &flags,
+                                &rc);
+
+    if (value != NULL)
+    {
+      data_out.assign(value, length);
+      free(value);
+    }
+    else
+    {
+      failures++;
+    }
+  });
+
+  double store_set_ns = time_concurrent_ops(1, ops, [&](unsigned int thread_ix, uint64_t op)
+  {
+    if (_store->set_data(_table, store_keys[op], data_in, 0, 300, DUMMY_TRAIL_ID) != Store::OK)
+    {
+      failures++;
+    }
+  });
+
+  double store_get_ns = time_concurrent_ops(1, ops, [&](unsigned int thread_ix, uint64_t op)
+  {
+    if (_store->get_data(_table, store_keys[op], data_out, cas, DUMMY_TRAIL_ID) != Store::OK)
+    {
+      failures++;
+    }
+  });
+
+  EXPECT_EQ(0u, failures.load());
+  EXPECT_TRUE(data_out == data_in);
+
+  printf("  %8zu bytes: set %9.1f us (raw %9.1f us, +%6.2f ns/byte, %7.1f MB/s)\n",
+         GetParam(),
+         store_set_ns / 1000,
+         raw_set_ns / 1000,
+         (store_set_ns - raw_set_ns) / GetParam(),
+         GetParam() * 1000.0 / store_set_ns);
+  printf("  %8zu bytes: get %9.1f us (raw %9.1f us, +%6.2f ns/byte, %7.1f MB/s)\n",
+         GetParam(),
+         store_get_ns / 1000,
+         raw_get_ns / 1000,
+         (store_get_ns - raw_get_ns) / GetParam(),
+         GetParam() * 1000.0 / store_get_ns);
+}
+
+
+TEST_P(ValueSizeMemcachedStoreTest, GetValueWithoutCopying)
+{
+  Store::Status status;
+  memcached_return_t rc;
+  const std::string data_in = patterned_value(GetParam(), 0);
+  MemcachedValue value;
+  uint64_t cas = 0;
+
+  status = _store->set_data(_table, _key, data_in, 0, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  rc = memcached_get_value(_memcached_client, fqkey(), value, cas);
+  EXPECT_MEMCACHED_SUCCESS(rc, _memcached_client);
+  EXPECT_TRUE(value == data_in);
+  EXPECT_NE(0u, cas);
+
+  // Copies of the value share its buffer.
+  MemcachedValue copy = value;
+  EXPECT_EQ(value.data(), copy.data());
+  EXPECT_EQ(data_in.length(), copy.length());
+
+  // The store leaves an empty tombstone in place of a deleted key.
+  status = _store->delete_data(_table, _key, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  rc = memcached_get_value(_memcached_client, fqkey(), value, cas);
+  EXPECT_MEMCACHED_SUCCESS(rc, _memcached_client);
+  EXPECT_TRUE(value.empty());
+
+  // A key that doesn't exist isn't found.
+  rc = memcached_get_value(_memcached_client, fqkey() + "_missing", value, cas);
+  EXPECT_EQ(MEMCACHED_NOTFOUND, rc);
+}
+
+
+static void report_gets(const std::string& name,
+                        size_t size,
+                        uint64_t ops,
+                        double ns_per_get,
+                        const AllocationCounter& counter)
+{
+  printf("  %8zu bytes: %-26s %9.1f us/get %6.2f allocs/get %10.1f bytes/get\n",
+         size,
+         name.c_str(),
+         ns_per_get / 1000,
+         (double)counter.allocations() / ops,
+         (double)counter.bytes() / ops);
+}
+
+// Count the allocations libmemcached makes for each way of reading a value
+// with it. Reading the result and copying it into a std::string also makes
+// that copy, which isn't counted; memcached_get_value doesn't. MemcachedStore
+// isn't included, as it doesn't expose its clients. This is disabled by
+// default - use `make bench` to run it. The number of reads can be set with
+// MEMCACHED_VALUE_BENCH_OPS.
+TEST_P(ValueSizeMemcachedStoreTest, DISABLED_GetCopies)
+{
+  uint64_t ops = env_or_default("MEMCACHED_VALUE_BENCH_OPS", 1000);
+  const std::string data_in = patterned_value(GetParam(), 0);
+  const std::string key = fqkey();
+  std::string data_out;
+  MemcachedValue value;
+  uint64_t cas;
+
+  Store::Status status = _store->set_data(_table, _key, data_in, 0, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+  AllocationCounter::count_memcached_client(_memcached_client);
+
+  {
+    AllocationCounter counter;
+    double ns = time_concurrent_ops(1, ops, [&](unsigned int thread_ix, uint64_t op)
+    {
+      simple_get(key, data_out, cas);
+    });
+    report_gets("result + std::string copy", GetParam(), ops, ns, counter);
+  }
+
+  {
+    AllocationCounter counter;
+    double ns = time_concurrent_ops(1, ops, [&](unsigned int thread_ix, uint64_t op)
+    {
+      memcached_get_value(_memcached_client, key, value, cas);
+    });
+    report_gets("memcached_get_value", GetParam(), ops, ns, counter);
+  }
+
+  EXPECT_TRUE(data_out == data_in);
+  EXPECT_TRUE(value == data_in);
+}
+
 //
 // MemcachedStore tests that only apply to when the store uses tombstone
 // records.
@@ -419,6 +719,118 @@ TEST_F(MemcachedStoreTombstoneTest, TombstonesPreventSimpleAdds)
   EXPECT_MEMCACHED_SUCCESS(rc, _memcached_client);
 }
 
+TEST_F(MemcachedStoreTombstoneTest, TombstonesHaveNoPayload)
+{
+  Store::Status status;
+  memcached_return_t rc;
+  const std::string data_in = patterned_value(4096, 0);
+  std::string data_out;
+  uint64_t cas;
+
+  status = _store->set_data(_table, _key, data_in, 0, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  status = _store->delete_data(_table, _key, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  // The tombstone replaces the data with an empty record, so only costs
+  // memcached the item header and key.
+  rc = simple_get(fqkey(), data_out, cas);
+  EXPECT_MEMCACHED_SUCCESS(rc, _memcached_client);
+  EXPECT_EQ("", data_out);
+
+  status = _store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::NOT_FOUND);
+}
+
+TEST_F(MemcachedStoreTombstoneTest, TombstonesExpire)
+{
+  Store::Status status;
+  memcached_return_t rc;
+  const std::string data_in1 = "kermit";
+  const std::string data_in2 = "gonzo";
+  MemcachedStore short_lived_store(false, new TombstoneLifetimeConfig(1), true);
+
+  status = short_lived_store.set_data(_table, _key, data_in1, 0, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  status = short_lived_store.delete_data(_table, _key, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  // Once the tombstone expires it no longer blocks adds. memcached's clock
+  // ticks once a second, so allow an extra second.
+  sleep(2);
+
+  rc = simple_add(fqkey(), data_in2);
+  EXPECT_MEMCACHED_SUCCESS(rc, _memcached_client);
+}
+
+// Measure the throughput and memory cost of tombstones, for a workload that
+// repeatedly registers and deregisters short-lived keys, over a range of
+// tombstone lifetimes (0 meaning no tombstones). This is disabled by default -
+// use `make bench` to run it. The number of keys churned can be set with
+// MEMCACHED_CHURN_KEYS.
+TEST_F(MemcachedStoreTombstoneTest, DISABLED_TombstoneChurn)
+{
+  unsigned int num_keys = env_or_default("MEMCACHED_CHURN_KEYS", 10000);
+  const int lifetimes[] = {0, 10, 60, 300};
+  const std::string data_in = patterned_value(1024, 0);
+
+  for (size_t ii = 0; ii < sizeof(lifetimes) / sizeof(lifetimes[0]); ++ii)
+  {
+    MemcachedStore store(false, new TombstoneLifetimeConfig(lifetimes[ii]), true);
+    std::string prefix = _key + "_" + std::to_string(lifetimes[ii]) + "_";
+    std::map<std::string, std::string> before;
+    std::map<std::string, std::string> after;
+    std::atomic<uint64_t> failures(0);
+
+    get_memcached_stats("127.0.0.1", memcached_port(), before);
+
+    // Register and deregister each key.
+    double churn_ns = time_concurrent_ops(1, num_keys, [&](unsigned int thread_ix, uint64_t op)
+    {
+      std::string key = prefix + std::to_string(op);
+
+      if ((store.set_data(_table, key, data_in, 0, 300, DUMMY_TRAIL_ID) != Store::OK) ||
+          (store.delete_data(_table, key, DUMMY_TRAIL_ID) != Store::OK))
+      {
+        failures++;
+      }
+    });
+
+    get_memcached_stats("127.0.0.1", memcached_port(), after);
+
+    // Then churn the same keys again, so each registration has to replace a
+    // tombstone (if they're still there).
+    double rechurn_ns = time_concurrent_ops(1, num_keys, [&](unsigned int thread_ix, uint64_t op)
+    {
+      std::string key = prefix + std::to_string(op);
+
+      if ((store.set_data(_table, key, data_in, 0, 300, DUMMY_TRAIL_ID) != Store::OK) ||
+          (store.delete_data(_table, key, DUMMY_TRAIL_ID) != Store::OK))
+      {
+        failures++;
+      }
+    });
+
+    EXPECT_EQ(0u, failures.load());
+
+    long items = strtol(after["curr_items"].c_str(), NULL, 10) -
+                 strtol(before["curr_items"].c_str(), NULL, 10);
+    long bytes = strtol(after["bytes"].c_str(), NULL, 10) -
+                 strtol(before["bytes"].c_str(), NULL, 10);
+
+    printf("  tombstone lifetime %3ds: churn %7.1f us/key, re-churn %7.1f us/key, "
+           "%6ld tombstones, %9ld bytes (%.1f bytes/tombstone)\n",
+           lifetimes[ii],
+           churn_ns / 1000,
+           rechurn_ns / 1000,
+           items,
+           bytes,
+           (items == 0) ? 0.0 : (double)bytes / items);
+  }
+}
+
 //
 // MemcachedStoreTests that use an uplevel store (one that uses tombstones) and
 // a downlevel store (that does not).
@@ -506,3 +918,1194 @@ TEST_F(MemcachedStoreUpgradeTest, DownlevelDeletesData)
   status = _uplevel_store->delete_data(_table, _key, DUMMY_TRAIL_ID);
   EXPECT_EQ(status, Store::OK);
 }
+
+//
+// MemcachedStore tests that use a store that compresses large values (the
+// "uplevel" store) and one that does not (the "downlevel" store).
+//
+
+class MemcachedStoreCompressionTest : public MemcachedTest
+{
+public:
+  CompressingStore* _uplevel_store;
+  MemcachedStore* _downlevel_store;
+
+  // Values in _table of at least this size are compressed.
+  static const size_t MIN_COMPRESSED_SIZE = 256;
+
+  virtual void SetUp()
+  {
+    MemcachedTest::SetUp();
+    _uplevel_store = new CompressingStore(new MemcachedStore(false, new TombstoneConfig(), true));
+    _uplevel_store->compress_table(_table, MIN_COMPRESSED_SIZE);
+    _downlevel_store = new MemcachedStore(false, new TombstoneConfig(), true);
+  }
+
+  virtual void TearDown()
+  {
+    delete _uplevel_store; _uplevel_store = NULL;
+    delete _downlevel_store; _downlevel_store = NULL;
+    MemcachedTest::TearDown();
+  }
+
+  static void SetUpTestCase()
+  {
+    MemcachedTest::SetUpTestCase();
+  }
+
+  // Build a value that looks like a set of registration bindings, so
+  // compresses about as well as real data.
+  static std::string binding_value(size_t size)
+  {
+    std::string value;
+    unsigned int seed = size;
+
+    while (value.length() < size)
+    {
+      value += "{\"uri\":\"sip:" + std::to_string(rand_r(&seed)) +
+               "@10.0.0.1:5060;transport=tcp\",\"expires\":" +
+               std::to_string(rand_r(&seed) % 3600) + ",\"cid\":\"" +
+               std::to_string(rand_r(&seed)) + "\"}";
+    }
+
+    value.resize(size);
+    return value;
+  }
+
+  // Build a value that doesn't compress (random bytes, other than the first,
+  // which is never NUL).
+  static std::string random_value(size_t size)
+  {
+    std::string value(size, '\0');
+    unsigned int seed = size;
+
+    for (size_t ii = 0; ii < size; ++ii)
+    {
+      value[ii] = (char)(rand_r(&seed) & 0xFF);
+    }
+
+    if (size > 0)
+    {
+      value[0] = 'a';
+    }
+
+    return value;
+  }
+};
+
+TEST_F(MemcachedStoreCompressionTest, UplevelCompressesLargeData)
+{
+  Store::Status status;
+  const std::string data_in1 = binding_value(4096);
+  const std::string data_in2 = binding_value(8192);
+  std::string data_out;
+  uint64_t cas;
+
+  status = _uplevel_store->set_data(_table, _key, data_in1, 0, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  // The value in memcached is smaller than the value written.
+  status = _downlevel_store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+  EXPECT_LT(data_out.length(), data_in1.length());
+
+  status = _uplevel_store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+  EXPECT_EQ(data_out, data_in1);
+
+  // CAS works as normal.
+  status = _uplevel_store->set_data(_table, _key, data_in2, cas, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  status = _uplevel_store->set_data(_table, _key, data_in1, cas, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::DATA_CONTENTION);
+
+  status = _uplevel_store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+  EXPECT_EQ(data_out, data_in2);
+
+  status = _uplevel_store->delete_data(_table, _key, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+}
+
+TEST_F(MemcachedStoreCompressionTest, UplevelReadsDownlevelData)
+{
+  Store::Status status;
+  const std::string data_in = binding_value(4096);
+  std::string data_out;
+  uint64_t cas;
+
+  status = _downlevel_store->set_data(_table, _key, data_in, 0, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  status = _uplevel_store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+  EXPECT_EQ(data_out, data_in);
+
+  status = _downlevel_store->delete_data(_table, _key, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+}
+
+TEST_F(MemcachedStoreCompressionTest, DownlevelReadsSmallUplevelData)
+{
+  Store::Status status;
+  const std::string data_in = binding_value(MIN_COMPRESSED_SIZE - 1);
+  std::string data_out;
+  uint64_t cas;
+
+  status = _uplevel_store->set_data(_table, _key, data_in, 0, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  status = _downlevel_store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+  EXPECT_EQ(data_out, data_in);
+
+  status = _uplevel_store->delete_data(_table, _key, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+}
+
+TEST_F(MemcachedStoreCompressionTest, DownlevelReadsUplevelDataInOtherTables)
+{
+  Store::Status status;
+  const std::string other_table = "other_table";
+  const std::string data_in = binding_value(4096);
+  std::string data_out;
+  uint64_t cas;
+
+  status = _uplevel_store->set_data(other_table, _key, data_in, 0, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  status = _downlevel_store->get_data(other_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+  EXPECT_EQ(data_out, data_in);
+
+  status = _uplevel_store->delete_data(other_table, _key, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+}
+
+TEST_F(MemcachedStoreCompressionTest, IncompressibleDataStoredAsIs)
+{
+  Store::Status status;
+  const std::string data_in = random_value(4096);
+  std::string data_out;
+  uint64_t cas;
+
+  status = _uplevel_store->set_data(_table, _key, data_in, 0, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  status = _downlevel_store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+  EXPECT_EQ(data_out, data_in);
+
+  status = _uplevel_store->delete_data(_table, _key, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+}
+
+// Compare the cost of writing and reading values through the compressing and
+// non-compressing stores, and the memcached memory each value uses. This is
+// disabled by default - use `make bench` to run it. The number of writes and
+// reads can be set with MEMCACHED_VALUE_BENCH_OPS.
+TEST_F(MemcachedStoreCompressionTest, DISABLED_CompressionCost)
+{
+  uint64_t ops = env_or_default("MEMCACHED_VALUE_BENCH_OPS", 1000);
+  std::string data_out;
+  uint64_t cas;
+  std::atomic<unsigned int> failures(0);
+
+  for (size_t ii = 0; ii < sizeof(VALUE_SIZES) / sizeof(VALUE_SIZES[0]); ++ii)
+  {
+    size_t size = VALUE_SIZES[ii];
+    std::string values[] = {binding_value(size), random_value(size)};
+    const char* names[] = {"bindings", "random"};
+
+    for (int jj = 0; jj < 2; ++jj)
+    {
+      const std::string& data_in = values[jj];
+
+      // Write each value to a new key. Writing with a CAS of 0 adds the key,
+      // so rewriting the same key would fail.
+      std::string prefix = _key + "_" + std::to_string(size) + "_" + names[jj];
+
+      Store* stores[] = {_downlevel_store, _uplevel_store};
+      const char* store_names[] = {"_plain_", "_compressed_"};
+      double ns[2];
+
+      for (int kk = 0; kk < 2; ++kk)
+      {
+        ns[kk] = time_concurrent_ops(1, ops, [&](unsigned int thread_ix, uint64_t op)
+        {
+          std::string key = prefix + store_names[kk] + std::to_string(op);
+
+          if ((stores[kk]->set_data(_table, key, data_in, 0, 300, DUMMY_TRAIL_ID) != Store::OK) ||
+              (stores[kk]->get_data(_table, key, data_out, cas, DUMMY_TRAIL_ID) != Store::OK))
+          {
+            failures++;
+          }
+        });
+
+        EXPECT_EQ(data_out, data_in);
+      }
+
+      // Read back the last compressed value as stored in memcached to see how
+      // big it is.
+      std::string stored;
+      _downlevel_store->get_data(_table,
+                                 prefix + store_names[1] + std::to_string(ops - 1),
+                                 stored,
+                                 cas,
+                                 DUMMY_TRAIL_ID);
+
+      printf("  %8zu bytes %-8s: set+get %9.1f us (plain %9.1f us), stored %8zu bytes (%5.1f%%)\n",
+             size,
+             names[jj],
+             ns[1] / 1000,
+             ns[0] / 1000,
+             stored.length(),
+             100.0 * stored.length() / size);
+    }
+  }
+
+  EXPECT_EQ(0u, failures.load());
+}
+
+//
+// MemcachedStore tests that read through an in-process cache (the "caching"
+// stores), while another store writes to the same keys.
+//
+
+class MemcachedStoreCachingTest : public MemcachedTest
+{
+public:
+  CachingStore* _ttl_store;
+  CachingStore* _validating_store;
+  MemcachedStore* _other_store;
+
+  static const int TTL_MS = 1000;
+
+  virtual void SetUp()
+  {
+    MemcachedTest::SetUp();
+    _ttl_store = new CachingStore(new MemcachedStore(false, new TombstoneConfig(), true),
+                                  CachingStore::TTL,
+                                  100,
+                                  TTL_MS);
+
+    // Validate the cached CAS with our own libmemcached client, which doesn't
+    // copy the value out.
+    _validating_store = new CachingStore(new MemcachedStore(false, new TombstoneConfig(), true),
+                                         CachingStore::VALIDATE,
+                                         100,
+                                         60000,
+                                         16,
+                                         [this](const std::string& table,
+                                                const std::string& key,
+                                                uint64_t& cas) -> Store::Status
+    {
+      MemcachedValue value;
+      memcached_return_t rc = memcached_get_value(_memcached_client,
+                                                  table + "\\\\" + key,
+                                                  value,
+                                                  cas);
+      return memcached_success(rc) ? Store::OK : Store::NOT_FOUND;
+    });
+
+    _other_store = new MemcachedStore(false, new TombstoneConfig(), true);
+  }
+
+  virtual void TearDown()
+  {
+    delete _ttl_store; _ttl_store = NULL;
+    delete _validating_store; _validating_store = NULL;
+    delete _other_store; _other_store = NULL;
+    MemcachedTest::TearDown();
+  }
+
+  static void SetUpTestCase()
+  {
+    MemcachedTest::SetUpTestCase();
+  }
+};
+
+TEST_F(MemcachedStoreCachingTest, OwnWritesInvalidateCache)
+{
+  Store::Status status;
+  const std::string data_in1 = "kermit";
+  const std::string data_in2 = "gonzo";
+  std::string data_out;
+  uint64_t cas;
+
+  status = _ttl_store->set_data(_table, _key, data_in1, 0, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  status = _ttl_store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+  EXPECT_EQ(data_out, data_in1);
+
+  // The second read is served from the cache.
+  status = _ttl_store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+  EXPECT_EQ(data_out, data_in1);
+  EXPECT_EQ(1u, _ttl_store->hits());
+
+  status = _ttl_store->set_data(_table, _key, data_in2, cas, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  status = _ttl_store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+  EXPECT_EQ(data_out, data_in2);
+
+  status = _ttl_store->delete_data(_table, _key, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  status = _ttl_store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::NOT_FOUND);
+}
+
+TEST_F(MemcachedStoreCachingTest, OtherWritesSeenAfterTTL)
+{
+  cwtest_completely_control_time(true);
+
+  Store::Status status;
+  const std::string data_in1 = "kermit";
+  const std::string data_in2 = "gonzo";
+  std::string data_out;
+  uint64_t cas;
+
+  status = _other_store->set_data(_table, _key, data_in1, 0, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  status = _ttl_store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+  EXPECT_EQ(data_out, data_in1);
+
+  status = _other_store->set_data(_table, _key, data_in2, cas, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  // Until the TTL passes, the caching store returns the stale value.
+  status = _ttl_store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+  EXPECT_EQ(data_out, data_in1);
+
+  cwtest_advance_time_ms(TTL_MS);
+
+  status = _ttl_store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+  EXPECT_EQ(data_out, data_in2);
+
+  status = _other_store->delete_data(_table, _key, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  cwtest_advance_time_ms(TTL_MS);
+
+  status = _ttl_store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::NOT_FOUND);
+
+  cwtest_reset_time();
+}
+
+TEST_F(MemcachedStoreCachingTest, StaleCasWriteInvalidatesCache)
+{
+  Store::Status status;
+  const std::string data_in1 = "kermit";
+  const std::string data_in2 = "gonzo";
+  std::string data_out;
+  uint64_t cas;
+
+  status = _other_store->set_data(_table, _key, data_in1, 0, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  status = _ttl_store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  status = _other_store->set_data(_table, _key, data_in2, cas, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  // Writing with the stale CAS fails, and invalidates the cached value.
+  status = _ttl_store->set_data(_table, _key, data_in1, cas, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::DATA_CONTENTION);
+
+  status = _ttl_store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+  EXPECT_EQ(data_out, data_in2);
+
+  status = _other_store->delete_data(_table, _key, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+}
+
+TEST_F(MemcachedStoreCachingTest, ValidatingStoreSeesOtherWrites)
+{
+  Store::Status status;
+  const std::string data_in1 = "kermit";
+  const std::string data_in2 = "gonzo";
+  std::string data_out;
+  uint64_t cas;
+
+  status = _other_store->set_data(_table, _key, data_in1, 0, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  status = _validating_store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+  EXPECT_EQ(data_out, data_in1);
+
+  // The CAS hasn't changed, so the second read is served from the cache.
+  status = _validating_store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+  EXPECT_EQ(data_out, data_in1);
+  EXPECT_EQ(1u, _validating_store->hits());
+
+  // Another store's write is seen straight away.
+  status = _other_store->set_data(_table, _key, data_in2, cas, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  status = _validating_store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+  EXPECT_EQ(data_out, data_in2);
+  EXPECT_EQ(1u, _validating_store->hits());
+
+  // As is another store's delete.
+  status = _other_store->delete_data(_table, _key, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  status = _validating_store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::NOT_FOUND);
+}
+
+// Compare reading a small set of hot keys through a plain MemcachedStore and
+// through the caching stores. This is disabled by default - use `make bench`
+// to run it. The number of keys, threads and reads per thread can be set with
+// MEMCACHED_CACHE_BENCH_KEYS, MEMCACHED_CACHE_BENCH_THREADS and
+// MEMCACHED_CACHE_BENCH_OPS.
+TEST_F(MemcachedStoreCachingTest, DISABLED_HotKeyReads)
+{
+  unsigned int num_keys = env_or_default("MEMCACHED_CACHE_BENCH_KEYS", 100);
+  unsigned int threads = env_or_default("MEMCACHED_CACHE_BENCH_THREADS", 4);
+  uint64_t ops = env_or_default("MEMCACHED_CACHE_BENCH_OPS", 10000);
+  const std::string data_in = patterned_value(4096, 0);
+  std::vector<std::string> keys;
+
+  for (unsigned int ii = 0; ii < num_keys; ++ii)
+  {
+    keys.push_back(_key + "_" + std::to_string(ii));
+    _other_store->set_data(_table, keys.back(), data_in, 0, 300, DUMMY_TRAIL_ID);
+  }
+
+  // The validating store's validator uses the fixture's libmemcached client,
+  // which isn't thread-safe, so use one that validates through the store.
+  CachingStore validating_store(new MemcachedStore(false, new TombstoneConfig(), true),
+                                CachingStore::VALIDATE,
+                                num_keys,
+                                60000);
+
+  Store* stores[] = {_other_store, _ttl_store, &validating_store};
+  const char* names[] = {"MemcachedStore", "CachingStore (TTL)", "CachingStore (VALIDATE)"};
+
+  for (int ii = 0; ii < 3; ++ii)
+  {
+    std::atomic<uint64_t> failures(0);
+    double ns = time_concurrent_ops(threads, ops, [&](unsigned int thread_ix, uint64_t op)
+    {
+      std::string data_out;
+      uint64_t cas;
+
+      if (stores[ii]->get_data(_table,
+                               keys[(op * threads + thread_ix) % num_keys],
+                               data_out,
+                               cas,
+                               DUMMY_TRAIL_ID) != Store::OK)
+      {
+        failures++;
+      }
+    });
+
+    EXPECT_EQ(0u, failures.load());
+    printf("  %-26s %2u threads: %9.1f us/get\n", names[ii], threads, ns / 1000);
+  }
+
+  printf("  TTL cache hit rate: %.1f%%, VALIDATE cache hit rate: %.1f%%\n",
+         100.0 * _ttl_store->hits() / (_ttl_store->hits() + _ttl_store->misses()),
+         100.0 * validating_store.hits() / (validating_store.hits() + validating_store.misses()));
+}
+
+//
+// Tests for pipelined best-effort writes.
+//
+
+class MemcachedPipelineTest : public MemcachedTest
+{
+public:
+  MemcachedPipeline* _pipeline;
+  MemcachedStore* _store;
+
+  virtual void SetUp()
+  {
+    MemcachedTest::SetUp();
+    _pipeline = new MemcachedPipeline("127.0.0.1", memcached_port());
+    _store = new MemcachedStore(false, new TombstoneConfig(), true);
+  }
+
+  virtual void TearDown()
+  {
+    delete _pipeline; _pipeline = NULL;
+    delete _store; _store = NULL;
+    MemcachedTest::TearDown();
+  }
+
+  static void SetUpTestCase()
+  {
+    MemcachedTest::SetUpTestCase();
+  }
+};
+
+TEST_F(MemcachedPipelineTest, PipelinedWritesArrive)
+{
+  memcached_return_t rc;
+  std::string data_out;
+  uint64_t cas;
+
+  for (int ii = 0; ii < 100; ++ii)
+  {
+    _pipeline->set_data(_table, _key + "_" + std::to_string(ii), "kermit" + std::to_string(ii), 300);
+  }
+
+  _pipeline->sync();
+
+  for (int ii = 0; ii < 100; ++ii)
+  {
+    rc = simple_get(_table + "\\\\" + _key + "_" + std::to_string(ii), data_out, cas);
+    EXPECT_MEMCACHED_SUCCESS(rc, _memcached_client);
+    EXPECT_EQ("kermit" + std::to_string(ii), data_out);
+  }
+}
+
+TEST_F(MemcachedPipelineTest, PipelinedDeletesCleanUpTombstones)
+{
+  Store::Status status;
+  memcached_return_t rc;
+  std::string data_out;
+  uint64_t cas;
+
+  status = _store->set_data(_table, _key, "kermit", 0, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  status = _store->delete_data(_table, _key, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  // Remove the tombstone.
+  _pipeline->delete_data(_table, _key);
+  _pipeline->sync();
+
+  rc = simple_get(fqkey(), data_out, cas);
+  EXPECT_NE(MEMCACHED_SUCCESS, rc);
+
+  rc = simple_add(fqkey(), "gonzo");
+  EXPECT_MEMCACHED_SUCCESS(rc, _memcached_client);
+}
+
+// Compare the throughput of writes through MemcachedStore with the ASCII and
+// binary protocols, and pipelined through MemcachedPipeline. This is disabled
+// by default - use `make bench` to run it. The number of writes can be set
+// with MEMCACHED_WRITE_BENCH_OPS.
+TEST_F(MemcachedPipelineTest, DISABLED_WriteThroughput)
+{
+  uint64_t ops = env_or_default("MEMCACHED_WRITE_BENCH_OPS", 10000);
+  const std::string data_in = patterned_value(1024, 0);
+  MemcachedStore binary_store(true, new TombstoneConfig(), true);
+
+  Store* stores[] = {_store, &binary_store};
+  const char* names[] = {"MemcachedStore (ASCII)", "MemcachedStore (binary)"};
+
+  for (int ii = 0; ii < 2; ++ii)
+  {
+    std::string prefix = _key + "_" + std::to_string(ii) + "_";
+    double ns = time_concurrent_ops(1, ops, [&](unsigned int thread_ix, uint64_t op)
+    {
+      stores[ii]->set_data(_table, prefix + std::to_string(op), data_in, 0, 300, DUMMY_TRAIL_ID);
+    });
+
+    printf("  %-30s %9.1f us/write %9.0f writes/s\n", names[ii], ns / 1000, 1e9 / ns);
+  }
+
+  // The pipelined writes aren't done until memcached has processed them all,
+  // so include syncing in the time.
+  std::string prefix = _key + "_pipelined_";
+  uint64_t start_ns = real_time_ns();
+
+  for (uint64_t op = 0; op < ops; ++op)
+  {
+    _pipeline->set_data(_table, prefix + std::to_string(op), data_in, 300);
+  }
+
+  _pipeline->sync();
+  double ns = (double)(real_time_ns() - start_ns) / ops;
+
+  printf("  %-30s %9.1f us/write %9.0f writes/s\n", "MemcachedPipeline", ns / 1000, 1e9 / ns);
+
+  // Check the last write arrived.
+  std::string data_out;
+  uint64_t cas;
+  memcached_return_t rc = simple_get(_table + "\\\\" + prefix + std::to_string(ops - 1),
+                                     data_out,
+                                     cas);
+  EXPECT_MEMCACHED_SUCCESS(rc, _memcached_client);
+  EXPECT_EQ(data_in, data_out);
+}
+
+//
+// Tests for read-modify-write updates.
+//
+
+class MemcachedStoreUpdateTest : public MemcachedTest
+{
+public:
+  MemcachedStore* _store;
+
+  virtual void SetUp()
+  {
+    MemcachedTest::SetUp();
+    _store = new MemcachedStore(false, new TombstoneConfig(), true);
+  }
+
+  virtual void TearDown()
+  {
+    delete _store; _store = NULL;
+    MemcachedTest::TearDown();
+  }
+
+  static void SetUpTestCase()
+  {
+    MemcachedTest::SetUpTestCase();
+  }
+};
+
+TEST_F(MemcachedStoreUpdateTest, UpdateCreatesAndModifies)
+{
+  Store::Status status;
+  std::string data_out;
+  uint64_t cas;
+  UpdateStats stats;
+
+  auto append_kermit = [](std::string& data) { data += "kermit"; };
+
+  status = update_data(_store, _table, _key, append_kermit, 300, DUMMY_TRAIL_ID, &stats);
+  EXPECT_EQ(status, Store::OK);
+
+  status = update_data(_store, _table, _key, append_kermit, 300, DUMMY_TRAIL_ID, &stats);
+  EXPECT_EQ(status, Store::OK);
+
+  status = _store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+  EXPECT_EQ("kermitkermit", data_out);
+
+  EXPECT_EQ(2u, stats.updates.load());
+  EXPECT_EQ(0u, stats.retries.load());
+}
+
+TEST_F(MemcachedStoreUpdateTest, ConcurrentUpdatesAreNotLost)
+{
+  Store::Status status;
+  std::string data_out;
+  uint64_t cas;
+  UpdateStats stats;
+
+  time_concurrent_ops(10, 20, [&](unsigned int thread_ix, uint64_t op)
+  {
+    EXPECT_EQ(Store::OK, update_data(_store,
+                                     _table,
+                                     _key,
+                                     [](std::string& data)
+                                     {
+                                       data = std::to_string(atoi(data.c_str()) + 1);
+                                     },
+                                     300,
+                                     DUMMY_TRAIL_ID,
+                                     &stats));
+  });
+
+  status = _store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+  EXPECT_EQ("200", data_out);
+  EXPECT_EQ(200u, stats.updates.load());
+}
+
+//
+// Tests that run MemcachedStore against an in-process fake memcached, whose
+// clock the tests control.
+//
+
+int fake_memcached_port()
+{
+  return env_or_default("FAKE_MEMCACHED_PORT", 44445);
+}
+
+
+// Config reader that points MemcachedStore at the fake memcached.
+class FakeMemcachedConfig : public StaticConfigReader
+{
+public:
+  FakeMemcachedConfig(int tombstone_lifetime = 300) : StaticConfigReader()
+  {
+    _cfg.servers.push_back("127.0.0.1:" + std::to_string(fake_memcached_port()));
+    _cfg.tombstone_lifetime = tombstone_lifetime;
+  }
+};
+
+
+// Test fixture that runs a fake memcached for the test case, and creates a
+// MemcachedStore that uses it. This is parameterized over whether the store
+// uses the binary protocol.
+class FakeMemcachedStoreTest : public MemcachedTest,
+                               public ::testing::WithParamInterface<bool>
+{
+public:
+  MemcachedStore* _store;
+  static FakeMemcachedServer* _server;
+
+  virtual void SetUp()
+  {
+    MemcachedTest::SetUp();
+    _store = new MemcachedStore(GetParam(), new FakeMemcachedConfig(), true);
+  }
+
+  virtual void TearDown()
+  {
+    cwtest_reset_time();
+    delete _store; _store = NULL;
+    MemcachedTest::TearDown();
+  }
+
+  static void SetUpTestCase()
+  {
+    MemcachedTest::SetUpTestCase();
+    _server = new FakeMemcachedServer(fake_memcached_port());
+    _server->start_instance();
+  }
+
+  static void TearDownTestCase()
+  {
+    delete _server; _server = NULL;
+  }
+};
+
+FakeMemcachedServer* FakeMemcachedStoreTest::_server;
+
+INSTANTIATE_TEST_CASE_P(Protocols,
+                        FakeMemcachedStoreTest,
+                        ::testing::Values(false, true));
+
+TEST_P(FakeMemcachedStoreTest, SetUpdateDeleteSequence)
+{
+  Store::Status status;
+  const std::string data_in1 = "kermit";
+  const std::string data_in2 = "gonzo";
+  std::string data_out;
+  uint64_t cas;
+
+  status = _store->set_data(_table, _key, data_in1, 0, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  // Adding the key again fails.
+  status = _store->set_data(_table, _key, data_in2, 0, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::DATA_CONTENTION);
+
+  status = _store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+  EXPECT_EQ(data_out, data_in1);
+
+  // Updating it with a stale CAS fails, but with the right one succeeds.
+  status = _store->set_data(_table, _key, data_in2, (cas - 1), 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::DATA_CONTENTION);
+
+  status = _store->set_data(_table, _key, data_in2, cas, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  status = _store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+  EXPECT_EQ(data_out, data_in2);
+
+  status = _store->delete_data(_table, _key, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  status = _store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::NOT_FOUND);
+}
+
+TEST_P(FakeMemcachedStoreTest, DataExpires)
+{
+  Store::Status status;
+  const std::string data_in = "kermit";
+  std::string data_out;
+  uint64_t cas;
+
+  cwtest_completely_control_time(true);
+
+  status = _store->set_data(_table, _key, data_in, 0, 1, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  // The data is there until exactly a second has passed.
+  cwtest_advance_time_ms(999);
+  status = _store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+  EXPECT_EQ(data_out, data_in);
+
+  cwtest_advance_time_ms(1);
+  status = _store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::NOT_FOUND);
+}
+
+TEST_P(FakeMemcachedStoreTest, TombstonesExpire)
+{
+  Store::Status status;
+  const std::string data_in = "kermit";
+  MemcachedStore short_lived_store(GetParam(), new FakeMemcachedConfig(1), true);
+
+  cwtest_completely_control_time(true);
+  size_t items = _server->item_count();
+
+  status = short_lived_store.set_data(_table, _key, data_in, 0, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  // Deleting the data leaves a tombstone, which lasts for a second.
+  status = short_lived_store.delete_data(_table, _key, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+  EXPECT_EQ(items + 1, _server->item_count());
+
+  cwtest_advance_time_ms(1000);
+  EXPECT_EQ(items, _server->item_count());
+}
+
+TEST_P(FakeMemcachedStoreTest, FlushAll)
+{
+  Store::Status status;
+  std::string data_out;
+  uint64_t cas;
+
+  status = _store->set_data(_table, _key, "kermit", 0, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  std::string options("--CONNECT-TIMEOUT=10");
+  memcached_st* client = memcached(options.c_str(), options.length());
+  memcached_server_add(client, "127.0.0.1", fake_memcached_port());
+  memcached_return_t rc = memcached_flush(client, 0);
+  EXPECT_MEMCACHED_SUCCESS(rc, client);
+  memcached_free(client);
+
+  status = _store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::NOT_FOUND);
+}
+
+// Compare MemcachedStore's throughput against the fake memcached with its
+// throughput against a real one. The fake does much less work per request,
+// so this shows how much of the time is spent in the client. This is
+// disabled by default - use `make bench` to run it. The number of writes and
+// reads can be set with MEMCACHED_FAKE_BENCH_OPS.
+TEST_P(FakeMemcachedStoreTest, DISABLED_ClientOverhead)
+{
+  uint64_t ops = env_or_default("MEMCACHED_FAKE_BENCH_OPS", 10000);
+  const std::string data_in = patterned_value(1024, 0);
+  MemcachedStore real_store(GetParam(), new TombstoneConfig(), true);
+
+  Store* stores[] = {&real_store, _store};
+  const char* names[] = {"memcached", "fake memcached"};
+
+  printf("  %s protocol\n", GetParam() ? "Binary" : "ASCII");
+
+  for (int ii = 0; ii < 2; ++ii)
+  {
+    std::string prefix = _key + "_" + std::to_string(ii) + "_";
+
+    double write_ns = time_concurrent_ops(1, ops, [&](unsigned int thread_ix, uint64_t op)
+    {
+      stores[ii]->set_data(_table, prefix + std::to_string(op), data_in, 0, 300, DUMMY_TRAIL_ID);
+    });
+
+    double read_ns = time_concurrent_ops(1, ops, [&](unsigned int thread_ix, uint64_t op)
+    {
+      std::string data_out;
+      uint64_t cas;
+      stores[ii]->get_data(_table, prefix + std::to_string(op), data_out, cas, DUMMY_TRAIL_ID);
+    });
+
+    printf("  %-16s %9.1f us/write %9.1f us/read\n",
+           names[ii],
+           write_ns / 1000,
+           read_ns / 1000);
+  }
+}
+
+//
+// Tests for reaching a co-located memcached over a Unix domain socket rather
+// than loopback TCP.
+//
+
+std::string memcached_socket_path()
+{
+  const char* path = getenv("MEMCACHED_SOCKET");
+  return (path != NULL) ? path : "./memcached.sock";
+}
+
+
+// Test fixture that runs a memcached listening on a Unix domain socket for the
+// test case, and connects to it (and to the usual memcached over TCP) with
+// libmemcached and with stores. This is parameterized over whether the clients
+// use the binary protocol.
+class UnixSocketMemcachedTest : public MemcachedTest,
+                                public ::testing::WithParamInterface<bool>
+{
+public:
+  memcached_st* _tcp_client;
+  memcached_st* _unix_client;
+  MemcachedStore* _tcp_store;
+  UnixSocketMemcachedStore* _unix_store;
+  static MemcachedInstance* _instance;
+
+  virtual void SetUp()
+  {
+    MemcachedTest::SetUp();
+    _tcp_client = new_client(false);
+    _unix_client = new_client(true);
+    _tcp_store = new MemcachedStore(GetParam(), new TombstoneConfig(), true);
+    _unix_store = new UnixSocketMemcachedStore(memcached_socket_path(), GetParam());
+  }
+
+  virtual void TearDown()
+  {
+    delete _tcp_store; _tcp_store = NULL;
+    delete _unix_store; _unix_store = NULL;
+    memcached_free(_tcp_client); _tcp_client = NULL;
+    memcached_free(_unix_client); _unix_client = NULL;
+    MemcachedTest::TearDown();
+  }
+
+  static void SetUpTestCase()
+  {
+    MemcachedTest::SetUpTestCase();
+    _instance = new MemcachedInstance(memcached_socket_path());
+    _instance->start_instance();
+    _instance->wait_for_instance();
+  }
+
+  static void TearDownTestCase()
+  {
+    delete _instance; _instance = NULL;
+    remove(memcached_socket_path().c_str());
+  }
+
+  memcached_st* new_client(bool unix_socket)
+  {
+    std::string options("--CONNECT-TIMEOUT=10 --SUPPORT-CAS");
+    memcached_st* client = memcached(options.c_str(), options.length());
+    memcached_behavior_set(client, MEMCACHED_BEHAVIOR_BINARY_PROTOCOL, GetParam());
+
+    if (unix_socket)
+    {
+      memcached_server_add_unix_socket(client, memcached_socket_path().c_str());
+    }
+    else
+    {
+      memcached_server_add(client, "127.0.0.1", memcached_port());
+    }
+
+    return client;
+  }
+};
+
+MemcachedInstance* UnixSocketMemcachedTest::_instance;
+
+INSTANTIATE_TEST_CASE_P(Protocols,
+                        UnixSocketMemcachedTest,
+                        ::testing::Values(false, true));
+
+TEST_P(UnixSocketMemcachedTest, SetGetDelete)
+{
+  memcached_return_t rc;
+  const std::string data_in = "kermit";
+
+  rc = memcached_set(_unix_client,
+                     fqkey().c_str(),
+                     fqkey().length(),
+                     data_in.c_str(),
+                     data_in.length(),
+                     300,
+                     0);
+  EXPECT_MEMCACHED_SUCCESS(rc, _unix_client);
+
+  size_t len;
+  uint32_t flags;
+  char* data_out = memcached_get(_unix_client,
+                                 fqkey().c_str(),
+                                 fqkey().length(),
+                                 &len,
+                                 &flags,
+                                 &rc);
+  EXPECT_MEMCACHED_SUCCESS(rc, _unix_client);
+  ASSERT_TRUE(data_out != NULL);
+  EXPECT_EQ(data_in, std::string(data_out, len));
+  free(data_out);
+
+  rc = memcached_delete(_unix_client, fqkey().c_str(), fqkey().length(), 0);
+  EXPECT_MEMCACHED_SUCCESS(rc, _unix_client);
+
+  data_out = memcached_get(_unix_client,
+                           fqkey().c_str(),
+                           fqkey().length(),
+                           &len,
+                           &flags,
+                           &rc);
+  EXPECT_TRUE(data_out == NULL);
+}
+
+TEST_P(UnixSocketMemcachedTest, StoreSetGetDelete)
+{
+  Store::Status status;
+  const std::string data_in1 = "kermit";
+  const std::string data_in2 = "gonzo";
+  std::string data_out;
+  uint64_t cas;
+
+  status = _unix_store->set_data(_table, _key, data_in1, 0, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  // A write with a CAS of 0 fails if the key exists.
+  status = _unix_store->set_data(_table, _key, data_in2, 0, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::DATA_CONTENTION);
+
+  status = _unix_store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+  EXPECT_EQ(data_out, data_in1);
+
+  status = _unix_store->set_data(_table, _key, data_in2, cas - 1, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::DATA_CONTENTION);
+
+  status = _unix_store->set_data(_table, _key, data_in2, cas, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  status = _unix_store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+  EXPECT_EQ(data_out, data_in2);
+
+  status = _unix_store->delete_data(_table, _key, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  status = _unix_store->get_data(_table, _key, data_out, cas, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::NOT_FOUND);
+}
+
+TEST_P(UnixSocketMemcachedTest, GetStats)
+{
+  Store::Status status;
+  std::map<std::string, std::string> before;
+  std::map<std::string, std::string> after;
+
+  ASSERT_TRUE(_instance->get_stats(before));
+
+  status = _unix_store->set_data(_table, _key, "kermit", 0, 300, DUMMY_TRAIL_ID);
+  EXPECT_EQ(status, Store::OK);
+
+  // The stats come from the memcached on the socket, which has seen the write.
+  ASSERT_TRUE(_instance->get_stats(after));
+  EXPECT_EQ(atoi(before["cmd_set"].c_str()) + 1, atoi(after["cmd_set"].c_str()));
+}
+
+// Compare the latency of writes and reads to a co-located memcached over
+// loopback TCP with a Unix domain socket, both with libmemcached and through
+// stores (a MemcachedStore and a UnixSocketMemcachedStore). This is disabled
+// by default - use
+// `make bench` to run it. The number of writes and reads can be set with
+// MEMCACHED_UDS_BENCH_OPS.
+TEST_P(UnixSocketMemcachedTest, DISABLED_TcpVsUnixSocket)
+{
+  uint64_t ops = env_or_default("MEMCACHED_UDS_BENCH_OPS", 10000);
+  const std::string data_in = patterned_value(100, 0);
+
+  memcached_st* clients[] = {_tcp_client, _unix_client};
+  const char* names[] = {"loopback TCP", "Unix domain socket"};
+
+  printf("  %s protocol\n", GetParam() ? "Binary" : "ASCII");
+
+  for (int ii = 0; ii < 2; ++ii)
+  {
+    memcached_st* client = clients[ii];
+    std::string prefix = fqkey() + "_" + std::to_string(ii) + "_";
+    LatencyRecorder write_latency;
+    LatencyRecorder read_latency;
+    std::atomic<unsigned int> failures(0);
+
+    time_concurrent_ops(1, ops, [&](unsigned int thread_ix, uint64_t op)
+    {
+      std::string key = prefix + std::to_string(op);
+      memcached_return_t rc;
+      uint64_t start_ns = real_time_ns();
+
+      rc = memcached_set(client,
+                         key.c_str(),
+                         key.length(),
+                         data_in.c_str(),
+                         data_in.length(),
+                         300,
+                         0);
+      write_latency.record(real_time_ns() - start_ns);
+
+      if (!memcached_success(rc))
+      {
+        failures++;
+      }
+
+      size_t len;
+      uint32_t flags;
+      start_ns = real_time_ns();
+      char* data_out = memcached_get(client, key.c_str(), key.length(), &len, &flags, &rc);
+      read_latency.record(real_time_ns() - start_ns);
+
+      if (data_out == NULL)
+      {
+        failures++;
+      }
+
+      free(data_out);
+    });
+
+    printf("  %-20s write: %s\n", names[ii], write_latency.summary().c_str());
+    printf("  %-20s read:  %s\n", "", read_latency.summary().c_str());
+    EXPECT_EQ(0u, failures.load());
+  }
+
+  // Repeat through stores, as a client of a co-located Astaire would.
+  Store* stores[] = {_tcp_store, _unix_store};
+  const char* store_names[] = {"TCP store", "Unix socket store"};
+
+  for (int ii = 0; ii < 2; ++ii)
+  {
+    Store* store = stores[ii];
+    std::string prefix = _key + "_store_" + std::to_string(ii) + "_";
+    LatencyRecorder write_latency;
+    LatencyRecorder read_latency;
+    std::atomic<unsigned int> failures(0);
+
+    time_concurrent_ops(1, ops, [&](unsigned int thread_ix, uint64_t op)
+    {
+      std::string key = prefix + std::to_string(op);
+      std::string data_out;
+      uint64_t cas;
+      uint64_t start_ns = real_time_ns();
+
+      if (store->set_data(_table, key, data_in, 0, 300, DUMMY_TRAIL_ID) != Store::OK)
+      {
+        failures++;
+      }
+
+      write_latency.record(real_time_ns() - start_ns);
+      start_ns = real_time_ns();
+
+      if (store->get_data(_table, key, data_out, cas, DUMMY_TRAIL_ID) != Store::OK)
+      {
+        failures++;
+      }
+
+      read_latency.record(real_time_ns() - start_ns);
+    });
+
+    printf("  %-20s write: %s\n", store_names[ii], write_latency.summary().c_str());
+    printf("  %-20s read:  %s\n", "", read_latency.summary().c_str());
+    EXPECT_EQ(0u, failures.load());
+  }
+}
@@ -36,9 +36,12 @@
 #error "netsnmp includes have polluted the namespace!"
 #endif
 
-#include "test_snmp.h"
+#include "inprocess_snmp_test.h"
+#include "snmp_table_schema.h"
 
-TEST_F(SNMPTest, ScalarValue)
+using SNMP::CounterPeriod;
+
+TEST_F(InProcessSNMPTest, ScalarValue)
 {
   // Create a scalar
   SNMP::U32Scalar scalar("answer", test_oid);
@@ -50,12 +53,12 @@ TEST_F(SNMPTest, ScalarValue)
   ASSERT_EQ(42, snmp_get(".1.2.2.0"));
 }
 
-TEST_F(SNMPTest, TableOrdering)
+TEST_F(InProcessSNMPTest, TableOrdering)
 {
   // Create a table
   SNMP::EventAccumulatorTable* tbl = SNMP::EventAccumulatorTable::create("latency", test_oid);
 
-  // Shell out to snmpwalk to find all entries in that table
+  // Walk the table to find all its entries
   std::vector<std::string> entries = snmp_walk(".1.2.2");
 
   // Check that the table has the right number of entries (3 time periods * five
@@ -73,7 +76,7 @@ TEST_F(SNMPTest, TableOrdering)
   delete tbl;
 }
 
-TEST_F(SNMPTest, LatencyCalculations)
+TEST_F(InProcessSNMPTest, LatencyCalculations)
 {
   cwtest_completely_control_time(true);
 
@@ -111,7 +114,7 @@ TEST_F(SNMPTest, LatencyCalculations)
   delete tbl;
 }
 
-TEST_F(SNMPTest, CounterTimePeriods)
+TEST_F(InProcessSNMPTest, CounterTimePeriods)
 {
   cwtest_completely_control_time(true);
   // Create a table indexed by time period
@@ -162,14 +165,14 @@ TEST_F(SNMPTest, CounterTimePeriods)
   delete tbl;
 }
 
-TEST_F(SNMPTest, IPCountTable)
+TEST_F(InProcessSNMPTest, IPCountTable)
 {
   // Create a table
   SNMP::IPCountTable* tbl = SNMP::IPCountTable::create("ip-counter", test_oid);
 
   tbl->get("127.0.0.1")->increment();
 
-  // Shell out to snmpwalk to find all entries in that table
+  // Walk the table to find all its entries
   std::vector<std::string> entries = snmp_walk(".1.2.2");
 
   ASSERT_EQ(1, entries.size());
@@ -177,7 +180,7 @@ TEST_F(SNMPTest, IPCountTable)
   delete tbl;
 }
 
-TEST_F(SNMPTest, SuccessFailCountTable)
+TEST_F(InProcessSNMPTest, SuccessFailCountTable)
 {
   cwtest_completely_control_time(true);
 
@@ -204,90 +207,104 @@ TEST_F(SNMPTest, SuccessFailCountTable)
   delete tbl;
 }
 
-TEST_F(SNMPTest, SingleCountByNodeTypeTable)
+TEST_F(InProcessSNMPTest, SingleCountByNodeTypeTable)
 {
   cwtest_completely_control_time(true);
 
+  typedef SNMP::Schema::SingleCountByNodeTypeTableSchema Schema;
+  auto count_oid = [&](CounterPeriod period, SNMP::NodeTypes type)
+  {
+    return Schema::oid_string(test_oid, Schema::COUNT, period, type);
+  };
+
   // Create a table
   SNMP::SingleCountByNodeTypeTable* tbl = SNMP::SingleCountByNodeTypeTable::create("single-count", test_oid, {SNMP::NodeTypes::SCSCF, SNMP::NodeTypes::ICSCF});
 
   // To start with, all values should be 0.
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.3.1.0"));
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.3.1.2"));
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.3.2.0"));
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.3.2.2"));
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.3.3.0"));
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.3.3.2"));
+  ASSERT_EQ(0, snmp_get(count_oid(CounterPeriod::PREVIOUS_5_SECONDS, SNMP::NodeTypes::SCSCF)));
+  ASSERT_EQ(0, snmp_get(count_oid(CounterPeriod::PREVIOUS_5_SECONDS, SNMP::NodeTypes::ICSCF)));
+  ASSERT_EQ(0, snmp_get(count_oid(CounterPeriod::CURRENT_5_MINUTES, SNMP::NodeTypes::SCSCF)));
+  ASSERT_EQ(0, snmp_get(count_oid(CounterPeriod::CURRENT_5_MINUTES, SNMP::NodeTypes::ICSCF)));
+  ASSERT_EQ(0, snmp_get(count_oid(CounterPeriod::PREVIOUS_5_MINUTES, SNMP::NodeTypes::SCSCF)));
+  ASSERT_EQ(0, snmp_get(count_oid(CounterPeriod::PREVIOUS_5_MINUTES, SNMP::NodeTypes::ICSCF)));
 
   // Add an entry for each supported node type. Only the current five minutes
   // should have a count.
   tbl->increment(SNMP::NodeTypes::SCSCF);
   tbl->increment(SNMP::NodeTypes::ICSCF);
 
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.3.1.0"));
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.3.1.2"));
-  ASSERT_EQ(1, snmp_get(".1.2.2.1.3.2.0"));
-  ASSERT_EQ(1, snmp_get(".1.2.2.1.3.2.2"));
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.3.3.0"));
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.3.3.2"));
+  ASSERT_EQ(0, snmp_get(count_oid(CounterPeriod::PREVIOUS_5_SECONDS, SNMP::NodeTypes::SCSCF)));
+  ASSERT_EQ(0, snmp_get(count_oid(CounterPeriod::PREVIOUS_5_SECONDS, SNMP::NodeTypes::ICSCF)));
+  ASSERT_EQ(1, snmp_get(count_oid(CounterPeriod::CURRENT_5_MINUTES, SNMP::NodeTypes::SCSCF)));
+  ASSERT_EQ(1, snmp_get(count_oid(CounterPeriod::CURRENT_5_MINUTES, SNMP::NodeTypes::ICSCF)));
+  ASSERT_EQ(0, snmp_get(count_oid(CounterPeriod::PREVIOUS_5_MINUTES, SNMP::NodeTypes::SCSCF)));
+  ASSERT_EQ(0, snmp_get(count_oid(CounterPeriod::PREVIOUS_5_MINUTES, SNMP::NodeTypes::ICSCF)));
 
   // Move on five seconds. The "previous five seconds" stat should now also reflect the increment.
   cwtest_advance_time_ms(5000);
 
-  ASSERT_EQ(1, snmp_get(".1.2.2.1.3.1.0"));
-  ASSERT_EQ(1, snmp_get(".1.2.2.1.3.1.2"));
-  ASSERT_EQ(1, snmp_get(".1.2.2.1.3.2.0"));
-  ASSERT_EQ(1, snmp_get(".1.2.2.1.3.2.2"));
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.3.3.0"));
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.3.3.2"));
+  ASSERT_EQ(1, snmp_get(count_oid(CounterPeriod::PREVIOUS_5_SECONDS, SNMP::NodeTypes::SCSCF)));
+  ASSERT_EQ(1, snmp_get(count_oid(CounterPeriod::PREVIOUS_5_SECONDS, SNMP::NodeTypes::ICSCF)));
+  ASSERT_EQ(1, snmp_get(count_oid(CounterPeriod::CURRENT_5_MINUTES, SNMP::NodeTypes::SCSCF)));
+  ASSERT_EQ(1, snmp_get(count_oid(CounterPeriod::CURRENT_5_MINUTES, SNMP::NodeTypes::ICSCF)));
+  ASSERT_EQ(0, snmp_get(count_oid(CounterPeriod::PREVIOUS_5_MINUTES, SNMP::NodeTypes::SCSCF)));
+  ASSERT_EQ(0, snmp_get(count_oid(CounterPeriod::PREVIOUS_5_MINUTES, SNMP::NodeTypes::ICSCF)));
 
   cwtest_reset_time();
   delete tbl;
 }
 
-TEST_F(SNMPTest, SuccessFailCountByRequestTypeTable)
+TEST_F(InProcessSNMPTest, SuccessFailCountByRequestTypeTable)
 {
   cwtest_completely_control_time(true);
 
+  typedef SNMP::Schema::SuccessFailCountByRequestTypeTableSchema Schema;
+  auto request_oid = [&](Schema::Column column,
+                         CounterPeriod period,
+                         SNMP::SIPRequestTypes type)
+  {
+    return Schema::oid_string(test_oid, column, period, type);
+  };
+
   // Create a table
   SNMP::SuccessFailCountByRequestTypeTable* tbl = SNMP::SuccessFailCountByRequestTypeTable::create("success_fail_by_request", test_oid);
 
   // To start with, all values should be 0 (check the INVITE and ACK entries).
   // Check previous 5 second attempts.
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.3.1.0"));
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.3.1.1"));
+  ASSERT_EQ(0, snmp_get(request_oid(Schema::ATTEMPTS, CounterPeriod::PREVIOUS_5_SECONDS, SNMP::SIPRequestTypes::INVITE)));
+  ASSERT_EQ(0, snmp_get(request_oid(Schema::ATTEMPTS, CounterPeriod::PREVIOUS_5_SECONDS, SNMP::SIPRequestTypes::ACK)));
 
   // Check previous 5 second period successes.
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.4.1.0"));
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.4.1.1"));
+  ASSERT_EQ(0, snmp_get(request_oid(Schema::SUCCESSES, CounterPeriod::PREVIOUS_5_SECONDS, SNMP::SIPRequestTypes::INVITE)));
+  ASSERT_EQ(0, snmp_get(request_oid(Schema::SUCCESSES, CounterPeriod::PREVIOUS_5_SECONDS, SNMP::SIPRequestTypes::ACK)));
 
   // Check previous 5 second period failures.
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.5.1.0"));
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.5.1.1"));
+  ASSERT_EQ(0, snmp_get(request_oid(Schema::FAILURES, CounterPeriod::PREVIOUS_5_SECONDS, SNMP::SIPRequestTypes::INVITE)));
+  ASSERT_EQ(0, snmp_get(request_oid(Schema::FAILURES, CounterPeriod::PREVIOUS_5_SECONDS, SNMP::SIPRequestTypes::ACK)));
 
   // Check current 5 minute period attempts.
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.3.2.0"));
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.3.2.1"));
+  ASSERT_EQ(0, snmp_get(request_oid(Schema::ATTEMPTS, CounterPeriod::CURRENT_5_MINUTES, SNMP::SIPRequestTypes::INVITE)));
+  ASSERT_EQ(0, snmp_get(request_oid(Schema::ATTEMPTS, CounterPeriod::CURRENT_5_MINUTES, SNMP::SIPRequestTypes::ACK)));
 
   // Check current 5 minute period successes.
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.4.2.0"));
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.4.2.1"));
+  ASSERT_EQ(0, snmp_get(request_oid(Schema::SUCCESSES, CounterPeriod::CURRENT_5_MINUTES, SNMP::SIPRequestTypes::INVITE)));
+  ASSERT_EQ(0, snmp_get(request_oid(Schema::SUCCESSES, CounterPeriod::CURRENT_5_MINUTES, SNMP::SIPRequestTypes::ACK)));
 
   // Check current 5 minute period failures.
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.5.2.0"));
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.5.2.1"));
+  ASSERT_EQ(0, snmp_get(request_oid(Schema::FAILURES, CounterPeriod::CURRENT_5_MINUTES, SNMP::SIPRequestTypes::INVITE)));
+  ASSERT_EQ(0, snmp_get(request_oid(Schema::FAILURES, CounterPeriod::CURRENT_5_MINUTES, SNMP::SIPRequestTypes::ACK)));
 
   // Check previous 5 minute period attempts.
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.3.3.0"));
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.3.3.1"));
+  ASSERT_EQ(0, snmp_get(request_oid(Schema::ATTEMPTS, CounterPeriod::PREVIOUS_5_MINUTES, SNMP::SIPRequestTypes::INVITE)));
+  ASSERT_EQ(0, snmp_get(request_oid(Schema::ATTEMPTS, CounterPeriod::PREVIOUS_5_MINUTES, SNMP::SIPRequestTypes::ACK)));
 
   // Check previous 5 minute period successes.
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.4.3.0"));
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.4.3.1"));
+  ASSERT_EQ(0, snmp_get(request_oid(Schema::SUCCESSES, CounterPeriod::PREVIOUS_5_MINUTES, SNMP::SIPRequestTypes::INVITE)));
+  ASSERT_EQ(0, snmp_get(request_oid(Schema::SUCCESSES, CounterPeriod::PREVIOUS_5_MINUTES, SNMP::SIPRequestTypes::ACK)));
 
   // Check previous 5 minute period failures.
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.5.3.0"));
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.5.3.1"));
+  ASSERT_EQ(0, snmp_get(request_oid(Schema::FAILURES, CounterPeriod::PREVIOUS_5_MINUTES, SNMP::SIPRequestTypes::INVITE)));
+  ASSERT_EQ(0, snmp_get(request_oid(Schema::FAILURES, CounterPeriod::PREVIOUS_5_MINUTES, SNMP::SIPRequestTypes::ACK)));
 
   // Increment an attempt and success for INVITE, and an attempt and failure for ACK. Only the current five minutes should have a count.
   tbl->increment_attempts(SNMP::SIPRequestTypes::INVITE);
@@ -296,43 +313,43 @@ TEST_F(SNMPTest, SuccessFailCountByRequestTypeTable)
   tbl->increment_failures(SNMP::SIPRequestTypes::ACK);
 
   // Check previous 5 second period attempts.
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.3.1.0"));
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.3.1.1"));
+  ASSERT_EQ(0, snmp_get(request_oid(Schema::ATTEMPTS, CounterPeriod::PREVIOUS_5_SECONDS, SNMP::SIPRequestTypes::INVITE)));
+  ASSERT_EQ(0, snmp_get(request_oid(Schema::ATTEMPTS, CounterPeriod::PREVIOUS_5_SECONDS, SNMP::SIPRequestTypes::ACK)));
 
   // Check previous 5 second period successes.
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.4.1.0"));
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.4.1.1"));
+  ASSERT_EQ(0, snmp_get(request_oid(Schema::SUCCESSES, CounterPeriod::PREVIOUS_5_SECONDS, SNMP::SIPRequestTypes::INVITE)));
+  ASSERT_EQ(0, snmp_get(request_oid(Schema::SUCCESSES, CounterPeriod::PREVIOUS_5_SECONDS, SNMP::SIPRequestTypes::ACK)));
 
   // Check previous 5 second period failures.
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.5.1.0"));
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.5.1.1"));
+  ASSERT_EQ(0, snmp_get(request_oid(Schema::FAILURES, CounterPeriod::PREVIOUS_5_SECONDS, SNMP::SIPRequestTypes::INVITE)));
+  ASSERT_EQ(0, snmp_get(request_oid(Schema::FAILURES, CounterPeriod::PREVIOUS_5_SECONDS, SNMP::SIPRequestTypes::ACK)));
 
   // Check current 5 minute period attempts.
-  ASSERT_EQ(1, snmp_get(".1.2.2.1.3.2.0"));
-  ASSERT_EQ(1, snmp_get(".1.2.2.1.3.2.1"));
+  ASSERT_EQ(1, snmp_get(request_oid(Schema::ATTEMPTS, CounterPeriod::CURRENT_5_MINUTES, SNMP::SIPRequestTypes::INVITE)));
+  ASSERT_EQ(1, snmp_get(request_oid(Schema::ATTEMPTS, CounterPeriod::CURRENT_5_MINUTES, SNMP::SIPRequestTypes::ACK)));
 
   // Check current 5 minute period successes.
-  ASSERT_EQ(1, snmp_get(".1.2.2.1.4.2.0"));
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.4.2.1"));
+  ASSERT_EQ(1, snmp_get(request_oid(Schema::SUCCESSES, CounterPeriod::CURRENT_5_MINUTES, SNMP::SIPRequestTypes::INVITE)));
+  ASSERT_EQ(0, snmp_get(request_oid(Schema::SUCCESSES, CounterPeriod::CURRENT_5_MINUTES, SNMP::SIPRequestTypes::ACK)));
 
   // Check current 5 minute period failures.
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.5.2.0"));
-  ASSERT_EQ(1, snmp_get(".1.2.2.1.5.2.1"));
+  ASSERT_EQ(0, snmp_get(request_oid(Schema::FAILURES, CounterPeriod::CURRENT_5_MINUTES, SNMP::SIPRequestTypes::INVITE)));
+  ASSERT_EQ(1, snmp_get(request_oid(Schema::FAILURES, CounterPeriod::CURRENT_5_MINUTES, SNMP::SIPRequestTypes::ACK)));
 
   // Move on five seconds. The "previous five seconds" stat should now also reflect the increment.
   cwtest_advance_time_ms(5000);
 
   // Check previous 5 second period attempts.
-  ASSERT_EQ(1, snmp_get(".1.2.2.1.3.1.0"));
-  ASSERT_EQ(1, snmp_get(".1.2.2.1.3.1.1"));
+  ASSERT_EQ(1, snmp_get(request_oid(Schema::ATTEMPTS, CounterPeriod::PREVIOUS_5_SECONDS, SNMP::SIPRequestTypes::INVITE)));
+  ASSERT_EQ(1, snmp_get(request_oid(Schema::ATTEMPTS, CounterPeriod::PREVIOUS_5_SECONDS, SNMP::SIPRequestTypes::ACK)));
 
   // Check previous 5 second period successes.
-  ASSERT_EQ(1, snmp_get(".1.2.2.1.4.1.0"));
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.4.1.1"));
+  ASSERT_EQ(1, snmp_get(request_oid(Schema::SUCCESSES, CounterPeriod::PREVIOUS_5_SECONDS, SNMP::SIPRequestTypes::INVITE)));
+  ASSERT_EQ(0, snmp_get(request_oid(Schema::SUCCESSES, CounterPeriod::PREVIOUS_5_SECONDS, SNMP::SIPRequestTypes::ACK)));
 
   // Check previous 5 second period failures.
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.5.1.0"));
-  ASSERT_EQ(1, snmp_get(".1.2.2.1.5.1.1"));
+  ASSERT_EQ(0, snmp_get(request_oid(Schema::FAILURES, CounterPeriod::PREVIOUS_5_SECONDS, SNMP::SIPRequestTypes::INVITE)));
+  ASSERT_EQ(1, snmp_get(request_oid(Schema::FAILURES, CounterPeriod::PREVIOUS_5_SECONDS, SNMP::SIPRequestTypes::ACK)));
 
   cwtest_reset_time();
   delete tbl;
@@ -352,7 +369,7 @@ void jump_to_next_periodstart(uint32_t interval_ms)
   cwtest_advance_time_ms(interval_ms - (ms_since_epoch % interval_ms));
 }
 
-TEST_F(SNMPTest, ContinuousAccumulatorTable)
+TEST_F(InProcessSNMPTest, ContinuousAccumulatorTable)
 {
   cwtest_completely_control_time(true);
 
@@ -430,10 +447,22 @@ TEST_F(SNMPTest, ContinuousAccumulatorTable)
   delete tbl;
 }
 
-TEST_F(SNMPTest, CxCounterTable)
+TEST_F(InProcessSNMPTest, CxCounterTable)
 {
   cwtest_completely_control_time(true);
 
+  typedef SNMP::Schema::CxCounterTableSchema Schema;
+  auto cx_oid = [&](CounterPeriod period, SNMP::DiameterAppId app_id, int result_code)
+  {
+    return Schema::oid_string(test_oid, Schema::COUNT, period, app_id, result_code);
+  };
+  auto walk_position = [](SNMP::DiameterAppId app_id, int result_code)
+  {
+    return Schema::walk_position(Schema::COUNT,
+                                 CounterPeriod::PREVIOUS_5_SECONDS,
+                                 Schema::Index::position(app_id, result_code));
+  };
+
   // Create table
   SNMP::CxCounterTable* tbl = SNMP::CxCounterTable::create("cx_counter", test_oid);
 
@@ -443,40 +472,46 @@ TEST_F(SNMPTest, CxCounterTable)
 
   // Check that there are the right number of entries in the table (3 time
   // periods * (33 base result-codes plus 14 3GPP result-codes plus 1 timeout)
-  ASSERT_EQ(144, entries.size());
+  ASSERT_EQ(Schema::cells(), entries.size());
 
   // Check the first base protocol rows.
-  ASSERT_EQ(".1.2.2.1.4.1.0.1001 = 0", entries[0]);
-  ASSERT_EQ(".1.2.2.1.4.1.0.2001 = 0", entries[1]);
-  ASSERT_EQ(".1.2.2.1.4.1.0.2002 = 0", entries[2]);
+  ASSERT_EQ(cx_oid(CounterPeriod::PREVIOUS_5_SECONDS, SNMP::DiameterAppId::BASE, 1001) + " = 0",
+            entries[walk_position(SNMP::DiameterAppId::BASE, 1001)]);
+  ASSERT_EQ(cx_oid(CounterPeriod::PREVIOUS_5_SECONDS, SNMP::DiameterAppId::BASE, 2001) + " = 0",
+            entries[walk_position(SNMP::DiameterAppId::BASE, 2001)]);
+  ASSERT_EQ(cx_oid(CounterPeriod::PREVIOUS_5_SECONDS, SNMP::DiameterAppId::BASE, 2002) + " = 0",
+            entries[walk_position(SNMP::DiameterAppId::BASE, 2002)]);
 
   // Check the first 3GPP rows.
-  ASSERT_EQ(".1.2.2.1.4.1.1.2001 = 0", entries[33]);
-  ASSERT_EQ(".1.2.2.1.4.1.1.2002 = 0", entries[34]);
-  ASSERT_EQ(".1.2.2.1.4.1.1.2003 = 0", entries[35]);
+  ASSERT_EQ(cx_oid(CounterPeriod::PREVIOUS_5_SECONDS, SNMP::DiameterAppId::_3GPP, 2001) + " = 0",
+            entries[walk_position(SNMP::DiameterAppId::_3GPP, 2001)]);
+  ASSERT_EQ(cx_oid(CounterPeriod::PREVIOUS_5_SECONDS, SNMP::DiameterAppId::_3GPP, 2002) + " = 0",
+            entries[walk_position(SNMP::DiameterAppId::_3GPP, 2002)]);
+  ASSERT_EQ(cx_oid(CounterPeriod::PREVIOUS_5_SECONDS, SNMP::DiameterAppId::_3GPP, 2003) + " = 0",
+            entries[walk_position(SNMP::DiameterAppId::_3GPP, 2003)]);
 
   tbl->increment(SNMP::DiameterAppId::BASE, 2001);
   tbl->increment(SNMP::DiameterAppId::_3GPP, 5011);
 
   // Only the current five minute values should reflect the increment.
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.4.1.0.2001"));
-  ASSERT_EQ(1, snmp_get(".1.2.2.1.4.2.0.2001"));
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.4.3.0.2001"));
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.4.1.1.5011"));
-  ASSERT_EQ(1, snmp_get(".1.2.2.1.4.2.1.5011"));
-  ASSERT_EQ(0, snmp_get(".1.2.2.1.4.3.1.5011"));
+  ASSERT_EQ(0, snmp_get(cx_oid(CounterPeriod::PREVIOUS_5_SECONDS, SNMP::DiameterAppId::BASE, 2001)));
+  ASSERT_EQ(1, snmp_get(cx_oid(CounterPeriod::CURRENT_5_MINUTES, SNMP::DiameterAppId::BASE, 2001)));
+  ASSERT_EQ(0, snmp_get(cx_oid(CounterPeriod::PREVIOUS_5_MINUTES, SNMP::DiameterAppId::BASE, 2001)));
+  ASSERT_EQ(0, snmp_get(cx_oid(CounterPeriod::PREVIOUS_5_SECONDS, SNMP::DiameterAppId::_3GPP, 5011)));
+  ASSERT_EQ(1, snmp_get(cx_oid(CounterPeriod::CURRENT_5_MINUTES, SNMP::DiameterAppId::_3GPP, 5011)));
+  ASSERT_EQ(0, snmp_get(cx_oid(CounterPeriod::PREVIOUS_5_MINUTES, SNMP::DiameterAppId::_3GPP, 5011)));
 
   // Move on five seconds. The "previous five seconds" stat should now also
   // reflect the increment.
   cwtest_advance_time_ms(5000);
-  ASSERT_EQ(1, snmp_get(".1.2.2.1.4.1.0.2001"));
-  ASSERT_EQ(1, snmp_get(".1.2.2.1.4.1.1.5011"));
+  ASSERT_EQ(1, snmp_get(cx_oid(CounterPeriod::PREVIOUS_5_SECONDS, SNMP::DiameterAppId::BASE, 2001)));
+  ASSERT_EQ(1, snmp_get(cx_oid(CounterPeriod::PREVIOUS_5_SECONDS, SNMP::DiameterAppId::_3GPP, 5011)));
 
   cwtest_reset_time();
   delete tbl;
 }
 
-TEST_F(SNMPTest, IPTimeBasedCounterTableSingleIPZeroCount)
+TEST_F(InProcessSNMPTest, IPTimeBasedCounterTableSingleIPZeroCount)
 {
   cwtest_completely_control_time(true);
 
@@ -502,7 +537,7 @@ TEST_F(SNMPTest, IPTimeBasedCounterTableSingleIPZeroCount)
   delete tbl;
 }
 
-TEST_F(SNMPTest, IPTimeBasedCounterTableRefcountIP)
+TEST_F(InProcessSNMPTest, IPTimeBasedCounterTableRefcountIP)
 {
   cwtest_completely_control_time(true);
 
@@ -535,7 +570,7 @@ TEST_F(SNMPTest, IPTimeBasedCounterTableRefcountIP)
   delete tbl;
 }
 
-TEST_F(SNMPTest, IPTimeBasedCounterTableRefcountDeleteIP)
+TEST_F(InProcessSNMPTest, IPTimeBasedCounterTableRefcountDeleteIP)
 {
   cwtest_completely_control_time(true);
 
@@ -565,7 +600,7 @@ TEST_F(SNMPTest, IPTimeBasedCounterTableRefcountDeleteIP)
   delete tbl;
 }
 
-TEST_F(SNMPTest, IPTimeBasedCounterTableSingleIP)
+TEST_F(InProcessSNMPTest, IPTimeBasedCounterTableSingleIP)
 {
   cwtest_completely_control_time(true);
 
@@ -593,7 +628,7 @@ TEST_F(SNMPTest, IPTimeBasedCounterTableSingleIP)
   delete tbl;
 }
 
-TEST_F(SNMPTest, IPTimeBasedCounterTableMultipleIPs)
+TEST_F(InProcessSNMPTest, IPTimeBasedCounterTableMultipleIPs)
 {
   cwtest_completely_control_time(true);
 
@@ -635,7 +670,7 @@ TEST_F(SNMPTest, IPTimeBasedCounterTableMultipleIPs)
   delete tbl;
 }
 
-TEST_F(SNMPTest, IPTimeBasedCounterTableRemoveIP)
+TEST_F(InProcessSNMPTest, IPTimeBasedCounterTableRemoveIP)
 {
   cwtest_completely_control_time(true);
 
@@ -679,7 +714,7 @@ TEST_F(SNMPTest, IPTimeBasedCounterTableRemoveIP)
 }
 
 
-TEST_F(SNMPTest, IPTimeBasedCounterTableAddCountsAgeOut)
+TEST_F(InProcessSNMPTest, IPTimeBasedCounterTableAddCountsAgeOut)
 {
   cwtest_completely_control_time(true);
 
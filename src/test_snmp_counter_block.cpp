@@ -0,0 +1,247 @@
+/**
+ * @file test_snmp_counter_block.cpp - tests and benchmarks for the compact
+ * SNMP counter storage.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+#ifdef READ
+#error "netsnmp includes have polluted the namespace!"
+#endif
+
+#include "inprocess_snmp_test.h"
+#include "snmp_counter_block.h"
+#include "benchmark_utils.h"
+
+#include <memory>
+#include <cstdio>
+
+using SNMP::CounterPeriod;
+
+static const int ATTEMPTS = 0;
+static const int SUCCESSES = 1;
+static const int FAILURES = 2;
+
+TEST(TimeBasedCounterBlockTest, Layout)
+{
+  // A group of up to three counters fits in a single cache line, and blocks in
+  // an array never share one.
+  EXPECT_EQ(SNMP::CACHE_LINE_SIZE, sizeof(SNMP::TimeBasedCounterBlock<1>));
+  EXPECT_EQ(SNMP::CACHE_LINE_SIZE, sizeof(SNMP::TimeBasedCounterBlock<3>));
+
+  SNMP::TimeBasedCounterBlockArray<3> blocks(4);
+  for (size_t ii = 0; ii < blocks.size(); ++ii)
+  {
+    EXPECT_EQ(0u, (uintptr_t)&blocks[ii] % SNMP::CACHE_LINE_SIZE);
+  }
+}
+
+// This mirrors the CounterTimePeriods test for CounterTable, but checks the
+// success/fail counters together.
+TEST(TimeBasedCounterBlockTest, TimePeriods)
+{
+  cwtest_completely_control_time(true);
+
+  SNMP::TimeBasedCounterBlock<3> block;
+
+  block.increment(ATTEMPTS);
+  block.increment(SUCCESSES);
+  block.increment(ATTEMPTS);
+  block.increment(FAILURES);
+
+  // Only the current five minutes reflect the increments.
+  EXPECT_EQ(0u, block.value(ATTEMPTS, CounterPeriod::PREVIOUS_5_SECONDS));
+  EXPECT_EQ(2u, block.value(ATTEMPTS, CounterPeriod::CURRENT_5_MINUTES));
+  EXPECT_EQ(1u, block.value(SUCCESSES, CounterPeriod::CURRENT_5_MINUTES));
+  EXPECT_EQ(1u, block.value(FAILURES, CounterPeriod::CURRENT_5_MINUTES));
+  EXPECT_EQ(0u, block.value(ATTEMPTS, CounterPeriod::PREVIOUS_5_MINUTES));
+
+  // Move on five seconds. The "previous five seconds" stat should now also
+  // reflect the increments.
+  cwtest_advance_time_ms(5000);
+  EXPECT_EQ(2u, block.value(ATTEMPTS, CounterPeriod::PREVIOUS_5_SECONDS));
+  EXPECT_EQ(1u, block.value(SUCCESSES, CounterPeriod::PREVIOUS_5_SECONDS));
+  EXPECT_EQ(2u, block.value(ATTEMPTS, CounterPeriod::CURRENT_5_MINUTES));
+
+  // Move on five more seconds. The "previous five seconds" stat should no
+  // longer reflect the increments.
+  cwtest_advance_time_ms(5000);
+  EXPECT_EQ(0u, block.value(ATTEMPTS, CounterPeriod::PREVIOUS_5_SECONDS));
+  EXPECT_EQ(2u, block.value(ATTEMPTS, CounterPeriod::CURRENT_5_MINUTES));
+
+  // Move on five minutes. Only the "previous five minutes" stat should now
+  // reflect the increments.
+  cwtest_advance_time_ms(300000);
+  EXPECT_EQ(0u, block.value(ATTEMPTS, CounterPeriod::PREVIOUS_5_SECONDS));
+  EXPECT_EQ(0u, block.value(ATTEMPTS, CounterPeriod::CURRENT_5_MINUTES));
+  EXPECT_EQ(2u, block.value(ATTEMPTS, CounterPeriod::PREVIOUS_5_MINUTES));
+  EXPECT_EQ(1u, block.value(FAILURES, CounterPeriod::PREVIOUS_5_MINUTES));
+
+  // Increment again and move on ten seconds. The increment shouldn't be in the
+  // "previous 5 seconds" stat as it was made 10 seconds ago.
+  block.increment(ATTEMPTS);
+  cwtest_advance_time_ms(10000);
+  EXPECT_EQ(0u, block.value(ATTEMPTS, CounterPeriod::PREVIOUS_5_SECONDS));
+
+  cwtest_reset_time();
+}
+
+TEST(TimeBasedCounterBlockTest, ConcurrentIncrements)
+{
+  // Freeze time so that the buckets can't roll over part way through.
+  cwtest_completely_control_time(true);
+
+  SNMP::TimeBasedCounterBlock<3> block;
+
+  time_concurrent_ops(4, 10000, [&](unsigned int thread_ix, uint64_t op)
+  {
+    block.increment(ATTEMPTS);
+    block.increment((op % 2 == 0) ? SUCCESSES : FAILURES);
+  });
+
+  // None of the increments should have been lost.
+  EXPECT_EQ(40000u, block.value(ATTEMPTS, CounterPeriod::CURRENT_5_MINUTES));
+  EXPECT_EQ(20000u, block.value(SUCCESSES, CounterPeriod::CURRENT_5_MINUTES));
+  EXPECT_EQ(20000u, block.value(FAILURES, CounterPeriod::CURRENT_5_MINUTES));
+
+  cwtest_reset_time();
+}
+
+static void report(const std::string& name, unsigned int threads, double ns_per_op)
+{
+  printf("  %-60s %2u threads: %8.1f ns/op\n", name.c_str(), threads, ns_per_op);
+}
+
+// Compare the per-update cost of today's counter tables against the compact
+// block layout. Each comparison is run with every thread updating the same
+// counter, and with every thread updating its own. This is disabled by
+// default - use `make bench` to run it. The thread count and number of
+// updates per thread can be set with SNMP_BENCH_THREADS and SNMP_BENCH_OPS.
+TEST_F(InProcessSNMPTest, DISABLED_BenchmarkCounterLayout)
+{
+  unsigned int threads = env_or_default("SNMP_BENCH_THREADS", 4);
+  uint64_t ops = env_or_default("SNMP_BENCH_OPS", 1000000);
+
+  printf("CounterTable::increment\n");
+
+  {
+    std::unique_ptr<SNMP::CounterTable> tbl(SNMP::CounterTable::create("counter", test_oid));
+    report("CounterTable, shared", threads,
+           time_concurrent_ops(threads, ops, [&](unsigned int thread_ix, uint64_t op)
+           {
+             tbl->increment();
+           }));
+  }
+
+  {
+    std::vector<std::unique_ptr<SNMP::CounterTable>> tbls;
+    for (unsigned int ii = 0; ii < threads; ++ii)
+    {
+      tbls.emplace_back(SNMP::CounterTable::create("counter" + std::to_string(ii),
+                                                   test_oid + "." + std::to_string(ii + 1)));
+    }
+
+    report("CounterTable, per-thread", threads,
+           time_concurrent_ops(threads, ops, [&](unsigned int thread_ix, uint64_t op)
+           {
+             tbls[thread_ix]->increment();
+           }));
+  }
+
+  {
+    SNMP::TimeBasedCounterBlock<1> block;
+    report("TimeBasedCounterBlock<1>, shared", threads,
+           time_concurrent_ops(threads, ops, [&](unsigned int thread_ix, uint64_t op)
+           {
+             block.increment(0);
+           }));
+  }
+
+  {
+    SNMP::TimeBasedCounterBlockArray<1> blocks(threads);
+    report("TimeBasedCounterBlock<1>, per-thread", threads,
+           time_concurrent_ops(threads, ops, [&](unsigned int thread_ix, uint64_t op)
+           {
+             blocks[thread_ix].increment(0);
+           }));
+  }
+
+  printf("SuccessFailCountTable::increment_*\n");
+
+  {
+    std::unique_ptr<SNMP::SuccessFailCountTable> tbl(SNMP::SuccessFailCountTable::create("success_fail_count", test_oid));
+    report("SuccessFailCountTable, shared", threads,
+           time_concurrent_ops(threads, ops, [&](unsigned int thread_ix, uint64_t op)
+           {
+             tbl->increment_attempts();
+             (op % 2 == 0) ? tbl->increment_successes() : tbl->increment_failures();
+           }));
+  }
+
+  {
+    std::vector<std::unique_ptr<SNMP::SuccessFailCountTable>> tbls;
+    for (unsigned int ii = 0; ii < threads; ++ii)
+    {
+      tbls.emplace_back(SNMP::SuccessFailCountTable::create("success_fail_count" + std::to_string(ii),
+                                                            test_oid + "." + std::to_string(ii + 1)));
+    }
+
+    report("SuccessFailCountTable, per-thread", threads,
+           time_concurrent_ops(threads, ops, [&](unsigned int thread_ix, uint64_t op)
+           {
+             tbls[thread_ix]->increment_attempts();
+             (op % 2 == 0) ? tbls[thread_ix]->increment_successes() :
+                             tbls[thread_ix]->increment_failures();
+           }));
+  }
+
+  {
+    SNMP::TimeBasedCounterBlock<3> block;
+    report("TimeBasedCounterBlock<3>, shared", threads,
+           time_concurrent_ops(threads, ops, [&](unsigned int thread_ix, uint64_t op)
+           {
+             block.increment(ATTEMPTS);
+             block.increment((op % 2 == 0) ? SUCCESSES : FAILURES);
+           }));
+  }
+
+  {
+    SNMP::TimeBasedCounterBlockArray<3> blocks(threads);
+    report("TimeBasedCounterBlock<3>, per-thread", threads,
+           time_concurrent_ops(threads, ops, [&](unsigned int thread_ix, uint64_t op)
+           {
+             blocks[thread_ix].increment(ATTEMPTS);
+             blocks[thread_ix].increment((op % 2 == 0) ? SUCCESSES : FAILURES);
+           }));
+  }
+}
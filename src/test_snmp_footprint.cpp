@@ -0,0 +1,219 @@
+/**
+ * @file test_snmp_footprint.cpp - tests for the memory used by SNMP tables.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+#ifdef READ
+#error "netsnmp includes have polluted the namespace!"
+#endif
+
+#include "inprocess_snmp_test.h"
+#include "snmp_footprint.h"
+#include "benchmark_utils.h"
+
+#include <cstdio>
+
+/// Generate a distinct IPv4 address for each row of an IP based table.
+static std::string nth_ip(unsigned int n)
+{
+  return "10." + std::to_string((n >> 16) & 0xff) +
+         "." + std::to_string((n >> 8) & 0xff) +
+         "." + std::to_string(n & 0xff);
+}
+
+static void report(const std::string& name, const SNMPTableFootprint& footprint)
+{
+  printf("%s: %s\n", name.c_str(), footprint.summary().c_str());
+}
+
+// Measure every type of table at its default size and check that the rows we
+// have measured are the ones we expect.
+TEST_F(InProcessSNMPTest, TableFootprints)
+{
+  SNMPTableFootprint footprint;
+
+  SNMP::EventAccumulatorTable* event_tbl = NULL;
+  footprint = measure_table_footprint(
+    [&]() { event_tbl = SNMP::EventAccumulatorTable::create("latency", test_oid); },
+    *_client,
+    test_oid);
+  EXPECT_EQ(3u, footprint.rows);
+  delete event_tbl;
+
+  SNMP::ContinuousAccumulatorTable* continuous_tbl = NULL;
+  footprint = measure_table_footprint(
+    [&]() { continuous_tbl = SNMP::ContinuousAccumulatorTable::create("continuous", test_oid); },
+    *_client,
+    test_oid);
+  EXPECT_EQ(3u, footprint.rows);
+  delete continuous_tbl;
+
+  SNMP::CounterTable* counter_tbl = NULL;
+  footprint = measure_table_footprint(
+    [&]() { counter_tbl = SNMP::CounterTable::create("counter", test_oid); },
+    *_client,
+    test_oid);
+  EXPECT_EQ(3u, footprint.rows);
+  delete counter_tbl;
+
+  SNMP::SuccessFailCountTable* success_fail_tbl = NULL;
+  footprint = measure_table_footprint(
+    [&]() { success_fail_tbl = SNMP::SuccessFailCountTable::create("success_fail_count", test_oid); },
+    *_client,
+    test_oid);
+  EXPECT_EQ(3u, footprint.rows);
+  delete success_fail_tbl;
+
+  // Three time periods for each of the two node types.
+  SNMP::SingleCountByNodeTypeTable* node_type_tbl = NULL;
+  footprint = measure_table_footprint(
+    [&]() { node_type_tbl = SNMP::SingleCountByNodeTypeTable::create("single-count", test_oid, {SNMP::NodeTypes::SCSCF, SNMP::NodeTypes::ICSCF}); },
+    *_client,
+    test_oid);
+  EXPECT_EQ(6u, footprint.rows);
+  delete node_type_tbl;
+
+  // Three time periods for each of the 15 request types.
+  SNMP::SuccessFailCountByRequestTypeTable* request_type_tbl = NULL;
+  footprint = measure_table_footprint(
+    [&]() { request_type_tbl = SNMP::SuccessFailCountByRequestTypeTable::create("success_fail_by_request", test_oid); },
+    *_client,
+    test_oid);
+  EXPECT_EQ(45u, footprint.rows);
+  delete request_type_tbl;
+
+  // Three time periods for each of the 48 result codes.
+  SNMP::CxCounterTable* cx_tbl = NULL;
+  footprint = measure_table_footprint(
+    [&]() { cx_tbl = SNMP::CxCounterTable::create("cx_counter", test_oid); },
+    *_client,
+    test_oid);
+  EXPECT_EQ(144u, footprint.rows);
+  delete cx_tbl;
+
+  SNMP::IPCountTable* ip_count_tbl = NULL;
+  footprint = measure_table_footprint(
+    [&]() {
+      ip_count_tbl = SNMP::IPCountTable::create("ip-counter", test_oid);
+      ip_count_tbl->get("127.0.0.1")->increment();
+    },
+    *_client,
+    test_oid);
+  EXPECT_EQ(1u, footprint.rows);
+  delete ip_count_tbl;
+
+  SNMP::IPTimeBasedCounterTable* ip_time_tbl = NULL;
+  footprint = measure_table_footprint(
+    [&]() {
+      ip_time_tbl = SNMP::IPTimeBasedCounterTable::create("ip_time_based_counter", test_oid);
+      ip_time_tbl->add_ip("192.168.0.1");
+    },
+    *_client,
+    test_oid);
+  EXPECT_EQ(3u, footprint.rows);
+  delete ip_time_tbl;
+}
+
+// Create tables at production scale and check that they fit within their
+// memory budgets. This is disabled by default as the tables take a while to
+// build and walk - use `make bench` to run it. The scale and budgets can be
+// overridden with the SNMP_FOOTPRINT_IPS, SNMP_IP_ROW_BUDGET_BYTES and
+// SNMP_CX_TABLE_BUDGET_BYTES environment variables.
+TEST_F(InProcessSNMPTest, DISABLED_ProductionScaleFootprint)
+{
+  unsigned int num_ips = env_or_default("SNMP_FOOTPRINT_IPS", 10000);
+  size_t ip_row_budget = env_or_default("SNMP_IP_ROW_BUDGET_BYTES", 2048);
+  size_t cx_table_budget = env_or_default("SNMP_CX_TABLE_BUDGET_BYTES", 256 * 1024);
+  SNMPTableFootprint footprint;
+
+  // Every Cx result code, in each time period.
+  SNMP::CxCounterTable* cx_tbl = NULL;
+  footprint = measure_table_footprint(
+    [&]() { cx_tbl = SNMP::CxCounterTable::create("cx_counter", test_oid); },
+    *_client,
+    test_oid);
+  report("CxCounterTable", footprint);
+  EXPECT_EQ(144u, footprint.rows);
+  EXPECT_GE(cx_table_budget, footprint.total_bytes);
+  delete cx_tbl;
+
+  // Three rows per IP.
+  SNMP::IPTimeBasedCounterTable* ip_time_tbl = NULL;
+  footprint = measure_table_footprint(
+    [&]() {
+      ip_time_tbl = SNMP::IPTimeBasedCounterTable::create("ip_time_based_counter", test_oid);
+
+      for (unsigned int ii = 0; ii < num_ips; ++ii)
+      {
+        ip_time_tbl->add_ip(nth_ip(ii));
+      }
+    },
+    *_client,
+    test_oid);
+  report("IPTimeBasedCounterTable (" + std::to_string(num_ips) + " IPs)", footprint);
+  EXPECT_EQ(num_ips * 3, footprint.rows);
+  EXPECT_GE(ip_row_budget, footprint.bytes_per_row());
+
+  // Check that removing the IPs gives most of the memory back (the allocator
+  // may hold on to some of it).
+  size_t before_remove = heap_bytes_in_use();
+  for (unsigned int ii = 0; ii < num_ips; ++ii)
+  {
+    ip_time_tbl->remove_ip(nth_ip(ii));
+  }
+  size_t after_remove = heap_bytes_in_use();
+  size_t freed = (before_remove > after_remove) ? (before_remove - after_remove) : 0;
+  printf("IPTimeBasedCounterTable: %zu bytes freed by removing %u IPs\n",
+         freed,
+         num_ips);
+  EXPECT_LE(footprint.total_bytes / 2, freed);
+  delete ip_time_tbl;
+
+  SNMP::IPCountTable* ip_count_tbl = NULL;
+  footprint = measure_table_footprint(
+    [&]() {
+      ip_count_tbl = SNMP::IPCountTable::create("ip-counter", test_oid);
+
+      for (unsigned int ii = 0; ii < num_ips; ++ii)
+      {
+        ip_count_tbl->get(nth_ip(ii))->increment();
+      }
+    },
+    *_client,
+    test_oid);
+  report("IPCountTable (" + std::to_string(num_ips) + " IPs)", footprint);
+  EXPECT_EQ(num_ips, footprint.rows);
+  EXPECT_GE(ip_row_budget, footprint.bytes_per_row());
+  delete ip_count_tbl;
+}
@@ -0,0 +1,681 @@
+/**
+ * @file test_snmp_stress.cpp - stress tests for the SNMP tables, updating them
+ * concurrently with the agent walking them.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+#ifdef READ
+#error "netsnmp includes have polluted the namespace!"
+#endif
+
+#include "inprocess_snmp_test.h"
+#include "benchmark_utils.h"
+
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <functional>
+#include <cstdio>
+#include <unistd.h>
+
+// The "current five minutes" row of the time-based tables. The stress tests
+// run with time frozen, so all updates land in this row and no row ever rolls
+// over part way through a walk.
+static const uint32_t CURRENT_5_MINS = 2;
+
+/// Get the index of a table entry, i.e. the components of its OID after
+/// "<table>.1.<column>". Returns an empty index for entries in other columns.
+static std::vector<uint32_t> entry_index(const SNMPVarBind& var,
+                                         const std::string& table_oid,
+                                         uint32_t column)
+{
+  std::vector<uint32_t> index;
+  std::string prefix = table_oid + ".1." + std::to_string(column) + ".";
+
+  if (var.oid.compare(0, prefix.length(), prefix) == 0)
+  {
+    const char* p = var.oid.c_str() + prefix.length();
+
+    while (*p != '\0')
+    {
+      char* end;
+      index.push_back(strtoul(p, &end, 10));
+      p = (*end == '.') ? end + 1 : end;
+    }
+  }
+
+  return index;
+}
+
+/// Sum a column of a table over the rows whose index matches the predicate.
+static uint64_t sum_column(const std::vector<SNMPVarBind>& walk,
+                           const std::string& table_oid,
+                           uint32_t column,
+                           std::function<bool(const std::vector<uint32_t>&)> match)
+{
+  uint64_t total = 0;
+
+  for (std::vector<SNMPVarBind>::const_iterator var = walk.begin();
+       var != walk.end();
+       ++var)
+  {
+    std::vector<uint32_t> index = entry_index(*var, table_oid, column);
+
+    if ((!index.empty()) && (match(index)))
+    {
+      total += var->integer;
+    }
+  }
+
+  return total;
+}
+
+/// Matches rows indexed by time period first (the common case).
+static bool current_period_first(const std::vector<uint32_t>& index)
+{
+  return index.front() == CURRENT_5_MINS;
+}
+
+/// Matches rows indexed by time period last (the IP based tables).
+static bool current_period_last(const std::vector<uint32_t>& index)
+{
+  return index.back() == CURRENT_5_MINS;
+}
+
+/// Matches every row.
+static bool any_row(const std::vector<uint32_t>& index)
+{
+  return true;
+}
+
+/// A table under stress. Subclasses create one type of table, know how to
+/// update it and how to sanity check the results of walking it.
+class StressTarget
+{
+public:
+  StressTarget(const std::string& table_oid) : _oid(table_oid) {};
+  virtual ~StressTarget() {};
+
+  virtual std::string name() const = 0;
+
+  /// Perform a single update. This is called concurrently from all of the
+  /// writer threads.
+  virtual void update(unsigned int thread_ix, uint64_t op) = 0;
+
+  /// Count the rows in a walk whose values are inconsistent with each other.
+  /// This is called while the writers are running, so must only check
+  /// invariants that hold however the reads and writes interleave.
+  virtual int torn_rows(const std::vector<SNMPVarBind>& walk) const { return 0; }
+
+  /// A total over the table that only ever increases while the writers are
+  /// running.
+  virtual uint64_t monotonic_total(const std::vector<SNMPVarBind>& walk) const = 0;
+
+  /// Count the inconsistencies in a walk taken once the writers have stopped,
+  /// given the total number of updates they made.
+  virtual int final_mismatches(const std::vector<SNMPVarBind>& walk,
+                               uint64_t updates) const
+  {
+    return (monotonic_total(walk) == updates) ? 0 : 1;
+  }
+
+protected:
+  std::string _oid;
+};
+
+class EventAccumulatorTarget : public StressTarget
+{
+public:
+  EventAccumulatorTarget(const std::string& oid) :
+    StressTarget(oid),
+    _tbl(SNMP::EventAccumulatorTable::create("stress_latency", oid)) {};
+  ~EventAccumulatorTarget() { delete _tbl; }
+
+  std::string name() const { return "EventAccumulatorTable"; }
+
+  void update(unsigned int thread_ix, uint64_t op)
+  {
+    _tbl->accumulate(100 + (op % 1000));
+  }
+
+  // The columns are average (2), variance (3), HWM (4), LWM (5) and count (6).
+  // The agent reads them in that order, so even if the writers update the
+  // row mid-read, LWM <= average <= HWM should always hold for a non-empty
+  // row.
+  int torn_rows(const std::vector<SNMPVarBind>& walk) const
+  {
+    uint64_t avg = sum_column(walk, _oid, 2, current_period_first);
+    uint64_t hwm = sum_column(walk, _oid, 4, current_period_first);
+    uint64_t lwm = sum_column(walk, _oid, 5, current_period_first);
+    uint64_t count = sum_column(walk, _oid, 6, current_period_first);
+
+    return ((count > 0) && ((hwm < lwm) || (avg > hwm) || (avg < lwm))) ? 1 : 0;
+  }
+
+  uint64_t monotonic_total(const std::vector<SNMPVarBind>& walk) const
+  {
+    return sum_column(walk, _oid, 6, current_period_first);
+  }
+
+private:
+  SNMP::EventAccumulatorTable* _tbl;
+};
+
+class ContinuousAccumulatorTarget : public StressTarget
+{
+public:
+  ContinuousAccumulatorTarget(const std::string& oid) :
+    StressTarget(oid),
+    _tbl(SNMP::ContinuousAccumulatorTable::create("stress_continuous", oid)) {};
+  ~ContinuousAccumulatorTarget() { delete _tbl; }
+
+  std::string name() const { return "ContinuousAccumulatorTable"; }
+
+  void update(unsigned int thread_ix, uint64_t op)
+  {
+    _tbl->accumulate(100 + (op % 1000));
+  }
+
+  // The columns are average (2), variance (3), HWM (4) and LWM (5). There's no
+  // count, so the only thing we can check is that the watermarks are
+  // consistent once any value has been accumulated.
+  int torn_rows(const std::vector<SNMPVarBind>& walk) const
+  {
+    uint64_t hwm = sum_column(walk, _oid, 4, current_period_first);
+    uint64_t lwm = sum_column(walk, _oid, 5, current_period_first);
+
+    return ((hwm != 0) && (hwm < lwm)) ? 1 : 0;
+  }
+
+  // The average of a continuous accumulator isn't a count, so there's nothing
+  // that must increase monotonically.
+  uint64_t monotonic_total(const std::vector<SNMPVarBind>& walk) const
+  {
+    return 0;
+  }
+
+  int final_mismatches(const std::vector<SNMPVarBind>& walk,
+                       uint64_t updates) const
+  {
+    return torn_rows(walk);
+  }
+
+private:
+  SNMP::ContinuousAccumulatorTable* _tbl;
+};
+
+class CounterTarget : public StressTarget
+{
+public:
+  CounterTarget(const std::string& oid) :
+    StressTarget(oid),
+    _tbl(SNMP::CounterTable::create("stress_counter", oid)) {};
+  ~CounterTarget() { delete _tbl; }
+
+  std::string name() const { return "CounterTable"; }
+
+  void update(unsigned int thread_ix, uint64_t op)
+  {
+    _tbl->increment();
+  }
+
+  uint64_t monotonic_total(const std::vector<SNMPVarBind>& walk) const
+  {
+    return sum_column(walk, _oid, 2, current_period_first);
+  }
+
+private:
+  SNMP::CounterTable* _tbl;
+};
+
+class SuccessFailCountTarget : public StressTarget
+{
+public:
+  SuccessFailCountTarget(const std::string& oid) :
+    StressTarget(oid),
+    _tbl(SNMP::SuccessFailCountTable::create("stress_success_fail", oid)) {};
+  ~SuccessFailCountTarget() { delete _tbl; }
+
+  std::string name() const { return "SuccessFailCountTable"; }
+
+  void update(unsigned int thread_ix, uint64_t op)
+  {
+    _tbl->increment_attempts();
+
+    if (op % 2 == 0)
+    {
+      _tbl->increment_successes();
+    }
+    else
+    {
+      _tbl->increment_failures();
+    }
+  }
+
+  uint64_t monotonic_total(const std::vector<SNMPVarBind>& walk) const
+  {
+    return sum_column(walk, _oid, 2, current_period_first);
+  }
+
+  // Once the writers have stopped, attempts must equal successes plus
+  // failures.
+  int final_mismatches(const std::vector<SNMPVarBind>& walk,
+                       uint64_t updates) const
+  {
+    uint64_t attempts = sum_column(walk, _oid, 2, current_period_first);
+    uint64_t successes = sum_column(walk, _oid, 3, current_period_first);
+    uint64_t failures = sum_column(walk, _oid, 4, current_period_first);
+
+    return ((attempts == updates) ? 0 : 1) +
+           ((successes + failures == attempts) ? 0 : 1);
+  }
+
+private:
+  SNMP::SuccessFailCountTable* _tbl;
+};
+
+class SingleCountByNodeTypeTarget : public StressTarget
+{
+public:
+  SingleCountByNodeTypeTarget(const std::string& oid) :
+    StressTarget(oid),
+    _tbl(SNMP::SingleCountByNodeTypeTable::create("stress_single_count",
+                                                  oid,
+                                                  {SNMP::NodeTypes::SCSCF,
+                                                   SNMP::NodeTypes::ICSCF})) {};
+  ~SingleCountByNodeTypeTarget() { delete _tbl; }
+
+  std::string name() const { return "SingleCountByNodeTypeTable"; }
+
+  void update(unsigned int thread_ix, uint64_t op)
+  {
+    _tbl->increment((op % 2 == 0) ? SNMP::NodeTypes::SCSCF :
+                                    SNMP::NodeTypes::ICSCF);
+  }
+
+  uint64_t monotonic_total(const std::vector<SNMPVarBind>& walk) const
+  {
+    return sum_column(walk, _oid, 3, current_period_first);
+  }
+
+private:
+  SNMP::SingleCountByNodeTypeTable* _tbl;
+};
+
+class SuccessFailCountByRequestTypeTarget : public StressTarget
+{
+public:
+  SuccessFailCountByRequestTypeTarget(const std::string& oid) :
+    StressTarget(oid),
+    _tbl(SNMP::SuccessFailCountByRequestTypeTable::create("stress_success_fail_by_request",
+                                                          oid)) {};
+  ~SuccessFailCountByRequestTypeTarget() { delete _tbl; }
+
+  std::string name() const { return "SuccessFailCountByRequestTypeTable"; }
+
+  void update(unsigned int thread_ix, uint64_t op)
+  {
+    SNMP::SIPRequestTypes type = (op % 2 == 0) ? SNMP::SIPRequestTypes::INVITE :
+                                                 SNMP::SIPRequestTypes::ACK;
+    _tbl->increment_attempts(type);
+
+    if (thread_ix % 2 == 0)
+    {
+      _tbl->increment_successes(type);
+    }
+    else
+    {
+      _tbl->increment_failures(type);
+    }
+  }
+
+  uint64_t monotonic_total(const std::vector<SNMPVarBind>& walk) const
+  {
+    return sum_column(walk, _oid, 3, current_period_first);
+  }
+
+  int final_mismatches(const std::vector<SNMPVarBind>& walk,
+                       uint64_t updates) const
+  {
+    uint64_t attempts = sum_column(walk, _oid, 3, current_period_first);
+    uint64_t successes = sum_column(walk, _oid, 4, current_period_first);
+    uint64_t failures = sum_column(walk, _oid, 5, current_period_first);
+
+    return ((attempts == updates) ? 0 : 1) +
+           ((successes + failures == attempts) ? 0 : 1);
+  }
+
+private:
+  SNMP::SuccessFailCountByRequestTypeTable* _tbl;
+};
+
+class CxCounterTarget : public StressTarget
+{
+public:
+  CxCounterTarget(const std::string& oid) :
+    StressTarget(oid),
+    _tbl(SNMP::CxCounterTable::create("stress_cx_counter", oid)) {};
+  ~CxCounterTarget() { delete _tbl; }
+
+  std::string name() const { return "CxCounterTable"; }
+
+  void update(unsigned int thread_ix, uint64_t op)
+  {
+    if (op % 2 == 0)
+    {
+      _tbl->increment(SNMP::DiameterAppId::BASE, 2001);
+    }
+    else
+    {
+      _tbl->increment(SNMP::DiameterAppId::_3GPP, 5011);
+    }
+  }
+
+  uint64_t monotonic_total(const std::vector<SNMPVarBind>& walk) const
+  {
+    return sum_column(walk, _oid, 4, current_period_first);
+  }
+
+private:
+  SNMP::CxCounterTable* _tbl;
+};
+
+class IPCountTarget : public StressTarget
+{
+public:
+  IPCountTarget(const std::string& oid) :
+    StressTarget(oid),
+    _tbl(SNMP::IPCountTable::create("stress_ip_count", oid))
+  {
+    // Create the rows up front so that the writers only update them.
+    for (int ii = 0; ii < NUM_IPS; ++ii)
+    {
+      _tbl->get(ip(ii));
+    }
+  }
+  ~IPCountTarget() { delete _tbl; }
+
+  std::string name() const { return "IPCountTable"; }
+
+  void update(unsigned int thread_ix, uint64_t op)
+  {
+    _tbl->get(ip(op % NUM_IPS))->increment();
+  }
+
+  uint64_t monotonic_total(const std::vector<SNMPVarBind>& walk) const
+  {
+    return sum_column(walk, _oid, 3, any_row);
+  }
+
+  static std::string ip(int ii) { return "10.0.0." + std::to_string(ii + 1); }
+
+private:
+  static const int NUM_IPS = 8;
+  SNMP::IPCountTable* _tbl;
+};
+
+class IPTimeBasedCounterTarget : public StressTarget
+{
+public:
+  IPTimeBasedCounterTarget(const std::string& oid) :
+    StressTarget(oid),
+    _tbl(SNMP::IPTimeBasedCounterTable::create("stress_ip_time_based_counter",
+                                               oid))
+  {
+    for (int ii = 0; ii < NUM_IPS; ++ii)
+    {
+      _tbl->add_ip(IPCountTarget::ip(ii));
+    }
+  }
+  ~IPTimeBasedCounterTarget() { delete _tbl; }
+
+  std::string name() const { return "IPTimeBasedCounterTable"; }
+
+  void update(unsigned int thread_ix, uint64_t op)
+  {
+    _tbl->increment(IPCountTarget::ip(op % NUM_IPS));
+  }
+
+  uint64_t monotonic_total(const std::vector<SNMPVarBind>& walk) const
+  {
+    return sum_column(walk, _oid, 4, current_period_last);
+  }
+
+private:
+  static const int NUM_IPS = 8;
+  SNMP::IPTimeBasedCounterTable* _tbl;
+};
+
+/// Results of running writers (and optionally pollers) against a table for a
+/// fixed length of time.
+struct StressResult
+{
+  StressResult() :
+    updates(0), duration_ns(0), walk_latency(), walks(0), failed_walks(0),
+    torn_rows(0), non_monotonic(0) {};
+
+  uint64_t updates;
+  uint64_t duration_ns;
+
+  LatencyRecorder walk_latency;
+  uint64_t walks;
+  uint64_t failed_walks;
+  uint64_t torn_rows;
+  uint64_t non_monotonic;
+
+  double updates_per_sec() const
+  {
+    return (duration_ns == 0) ? 0 : (updates * 1e9) / duration_ns;
+  }
+};
+
+/// Run `writers` threads updating the target as fast as they can, while
+/// `pollers` threads walk it continuously, for the specified time.
+static StressResult run_stress(StressTarget* target,
+                               const std::string& oid,
+                               unsigned int writers,
+                               unsigned int pollers,
+                               uint64_t duration_ms)
+{
+  StressResult result;
+  std::atomic<bool> stop(false);
+  std::vector<std::thread> threads;
+  std::vector<uint64_t> updates(writers, 0);
+  std::vector<StressResult> poller_results(pollers);
+
+  for (unsigned int ii = 0; ii < writers; ++ii)
+  {
+    threads.push_back(std::thread([&, ii]()
+    {
+      uint64_t op = 0;
+
+      while (!stop.load(std::memory_order_relaxed))
+      {
+        target->update(ii, op++);
+      }
+
+      updates[ii] = op;
+    }));
+  }
+
+  for (unsigned int ii = 0; ii < pollers; ++ii)
+  {
+    threads.push_back(std::thread([&, ii]()
+    {
+      SNMPClient client;
+      StressResult& res = poller_results[ii];
+      uint64_t last_total = 0;
+
+      while (!stop.load(std::memory_order_relaxed))
+      {
+        std::vector<SNMPVarBind> walk;
+        uint64_t start_ns = real_time_ns();
+        bool success = client.walk(oid, walk);
+        res.walk_latency.record(real_time_ns() - start_ns);
+        res.walks++;
+
+        if (!success)
+        {
+          res.failed_walks++;
+          continue;
+        }
+
+        res.torn_rows += target->torn_rows(walk);
+
+        uint64_t total = target->monotonic_total(walk);
+        if (total < last_total)
+        {
+          res.non_monotonic++;
+        }
+        last_total = total;
+      }
+    }));
+  }
+
+  uint64_t start_ns = real_time_ns();
+
+  while (real_time_ns() - start_ns < duration_ms * 1000000)
+  {
+    usleep(10000);
+  }
+
+  stop = true;
+
+  for (std::vector<std::thread>::iterator t = threads.begin();
+       t != threads.end();
+       ++t)
+  {
+    t->join();
+  }
+
+  result.duration_ns = real_time_ns() - start_ns;
+
+  for (unsigned int ii = 0; ii < writers; ++ii)
+  {
+    result.updates += updates[ii];
+  }
+
+  for (unsigned int ii = 0; ii < pollers; ++ii)
+  {
+    result.walk_latency.merge(poller_results[ii].walk_latency);
+    result.walks += poller_results[ii].walks;
+    result.failed_walks += poller_results[ii].failed_walks;
+    result.torn_rows += poller_results[ii].torn_rows;
+    result.non_monotonic += poller_results[ii].non_monotonic;
+  }
+
+  return result;
+}
+
+/// Run the stress test against a single table. First the writers run on their
+/// own to get a baseline update rate, and then they run again alongside the
+/// pollers.
+static void stress_table(StressTarget* target, const std::string& oid)
+{
+  SCOPED_TRACE(target->name());
+
+  unsigned int writers = env_or_default("SNMP_STRESS_WRITERS", 8);
+  unsigned int pollers = env_or_default("SNMP_STRESS_POLLERS", 2);
+  uint64_t duration_ms = env_or_default("SNMP_STRESS_DURATION_MS", 2000);
+
+  StressResult baseline = run_stress(target, oid, writers, 0, duration_ms);
+  StressResult polled = run_stress(target, oid, writers, pollers, duration_ms);
+
+  // Take a final walk now that the table is quiescent and check that no
+  // updates have been lost.
+  SNMPClient client;
+  std::vector<SNMPVarBind> walk;
+  EXPECT_TRUE(client.walk(oid, walk));
+  int mismatches = target->final_mismatches(walk,
+                                            baseline.updates + polled.updates);
+
+  double degradation = (baseline.updates_per_sec() == 0) ? 0 :
+    100.0 * (1.0 - (polled.updates_per_sec() / baseline.updates_per_sec()));
+
+  printf("%s: %u writers, %u pollers\n"
+         "  writer throughput: %.0f/s unpolled, %.0f/s polled (%.1f%% degradation)\n"
+         "  walk latency: %s\n"
+         "  walks: %lu (%lu failed), torn rows: %lu, non-monotonic totals: %lu, final mismatches: %d\n",
+         target->name().c_str(),
+         writers,
+         pollers,
+         baseline.updates_per_sec(),
+         polled.updates_per_sec(),
+         degradation,
+         polled.walk_latency.summary().c_str(),
+         polled.walks,
+         polled.failed_walks,
+         polled.torn_rows,
+         polled.non_monotonic,
+         mismatches);
+
+  EXPECT_EQ(0u, polled.failed_walks);
+  EXPECT_EQ(0u, polled.torn_rows);
+  EXPECT_EQ(0u, polled.non_monotonic);
+  EXPECT_EQ(0, mismatches);
+}
+
+// Stress every type of table in turn. This is disabled by default as it takes
+// a while to run - use `make bench` to run it. The number of writers and
+// pollers, and how long each phase runs for, can be set with the
+// SNMP_STRESS_WRITERS, SNMP_STRESS_POLLERS and SNMP_STRESS_DURATION_MS
+// environment variables.
+TEST_F(InProcessSNMPTest, DISABLED_StressConcurrentUpdatesAndWalks)
+{
+  // Freeze time so that every update lands in the current five minute period
+  // and rows never roll over mid-walk.
+  cwtest_completely_control_time(true);
+
+  std::vector<std::function<StressTarget*()>> targets = {
+    [&]() { return new EventAccumulatorTarget(test_oid); },
+    [&]() { return new ContinuousAccumulatorTarget(test_oid); },
+    [&]() { return new CounterTarget(test_oid); },
+    [&]() { return new SuccessFailCountTarget(test_oid); },
+    [&]() { return new SingleCountByNodeTypeTarget(test_oid); },
+    [&]() { return new SuccessFailCountByRequestTypeTarget(test_oid); },
+    [&]() { return new CxCounterTarget(test_oid); },
+    [&]() { return new IPCountTarget(test_oid); },
+    [&]() { return new IPTimeBasedCounterTarget(test_oid); }
+  };
+
+  for (std::vector<std::function<StressTarget*()>>::iterator create = targets.begin();
+       create != targets.end();
+       ++create)
+  {
+    std::unique_ptr<StressTarget> target((*create)());
+    stress_table(target.get(), test_oid);
+  }
+
+  cwtest_reset_time();
+}
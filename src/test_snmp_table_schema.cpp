@@ -0,0 +1,148 @@
+/**
+ * @file test_snmp_table_schema.cpp - tests for the SNMP table schemas.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+#include "gtest/gtest.h"
+#include "snmp_table_schema.h"
+
+using SNMP::CounterPeriod;
+using namespace SNMP::Schema;
+
+// The layout is computed at compile time, so check it there too.
+static_assert(CxCounterTableSchema::rows() == 144,
+              "3 time periods * (33 base + 14 3GPP result codes + 1 timeout)");
+static_assert(CxCounterTableSchema::Index::position(1, 2001) == 33,
+              "3GPP result codes follow the base ones");
+static_assert(CxCounterTableSchema::Index::position(1, 1001) == NOT_FOUND,
+              "1001 is only a base result code");
+static_assert(SuccessFailCountByRequestTypeTableSchema::walk_position(
+                SuccessFailCountByRequestTypeTableSchema::SUCCESSES,
+                CounterPeriod::PREVIOUS_5_SECONDS,
+                0) == 3 * 15,
+              "Successes follow attempts for every time period");
+
+TEST(SNMPTableSchemaTest, ParseOID)
+{
+  OID oid = OID::parse(".1.2.2");
+  ASSERT_EQ(3u, oid.length);
+  EXPECT_EQ(1u, oid.subids[0]);
+  EXPECT_EQ(2u, oid.subids[2]);
+  EXPECT_EQ(".1.2.2", oid.to_string());
+
+  EXPECT_EQ(".1.3.6.1.4.1.19444", OID::parse("1.3.6.1.4.1.19444").to_string());
+  EXPECT_EQ(0u, OID::parse("").length);
+
+  // Parsing stops at a component that isn't a number, without adding it.
+  EXPECT_EQ(".1.2", OID::parse(".1.2.x.3").to_string());
+}
+
+TEST(SNMPTableSchemaTest, CellOIDs)
+{
+  typedef SingleCountByNodeTypeTableSchema NodeTypeSchema;
+  EXPECT_EQ(".1.2.2.1.3.1.2",
+            NodeTypeSchema::oid_string(".1.2.2",
+                                       NodeTypeSchema::COUNT,
+                                       CounterPeriod::PREVIOUS_5_SECONDS,
+                                       2));
+
+  typedef SuccessFailCountByRequestTypeTableSchema RequestTypeSchema;
+  EXPECT_EQ(".1.2.2.1.5.3.14",
+            RequestTypeSchema::oid_string(".1.2.2",
+                                          RequestTypeSchema::FAILURES,
+                                          CounterPeriod::PREVIOUS_5_MINUTES,
+                                          14));
+
+  typedef CxCounterTableSchema CxSchema;
+  EXPECT_EQ(".1.2.2.1.4.2.1.5011",
+            CxSchema::oid_string(".1.2.2",
+                                 CxSchema::COUNT,
+                                 CounterPeriod::CURRENT_5_MINUTES,
+                                 1,
+                                 5011));
+  EXPECT_EQ(".1.2.2.1.4.1.2.0",
+            CxSchema::oid_string(".1.2.2",
+                                 CxSchema::COUNT,
+                                 CounterPeriod::PREVIOUS_5_SECONDS,
+                                 2,
+                                 0));
+}
+
+// Every cell has a distinct walk position, and walking them in that order
+// gives increasing OIDs.
+TEST(SNMPTableSchemaTest, WalkOrder)
+{
+  typedef CxCounterTableSchema CxSchema;
+  OID table = OID::parse(".1.2.2");
+  std::vector<std::vector<uint32_t>> walk(CxSchema::cells());
+  CounterPeriod periods[] = {CounterPeriod::PREVIOUS_5_SECONDS,
+                             CounterPeriod::CURRENT_5_MINUTES,
+                             CounterPeriod::PREVIOUS_5_MINUTES};
+
+  for (size_t p = 0; p < 3; ++p)
+  {
+    for (size_t key = 0; key < CxSchema::Index::size(); ++key)
+    {
+      size_t pos = CxSchema::walk_position(CxSchema::COUNT, periods[p], key);
+      ASSERT_GT(walk.size(), pos);
+      EXPECT_TRUE(walk[pos].empty());
+
+      OID oid = CxSchema::cell_oid(table, CxSchema::COUNT, periods[p], key);
+      walk[pos].assign(oid.subids, oid.subids + oid.length);
+    }
+  }
+
+  for (size_t ii = 1; ii < walk.size(); ++ii)
+  {
+    EXPECT_LT(walk[ii - 1], walk[ii]);
+  }
+}
+
+TEST(SNMPTableSchemaTest, Storage)
+{
+  typedef SuccessFailCountByRequestTypeTableSchema Schema;
+  Schema::Storage storage(Schema::Index::size());
+
+  size_t ack = Schema::Index::position(1);
+  storage[ack].increment(Schema::counter(Schema::ATTEMPTS));
+  storage[ack].increment(Schema::counter(Schema::FAILURES));
+
+  EXPECT_EQ(1u, storage[ack].value(Schema::counter(Schema::ATTEMPTS),
+                                   CounterPeriod::CURRENT_5_MINUTES));
+  EXPECT_EQ(0u, storage[ack].value(Schema::counter(Schema::SUCCESSES),
+                                   CounterPeriod::CURRENT_5_MINUTES));
+  EXPECT_EQ(1u, storage[ack].value(Schema::counter(Schema::FAILURES),
+                                   CounterPeriod::CURRENT_5_MINUTES));
+  EXPECT_FALSE(Schema::has_column(6));
+}
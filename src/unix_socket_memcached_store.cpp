@@ -0,0 +1,170 @@
+/**
+ * @file unix_socket_memcached_store.cpp - a store that talks to a co-located
+ * memcached-protocol server over a Unix domain socket.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+
+#include "unix_socket_memcached_store.h"
+#include "benchmark_utils.h"
+#include "memcached_value.h"
+
+UnixSocketMemcachedStore::UnixSocketMemcachedStore(const std::string& socket_path,
+                                                   bool binary) :
+  _socket_path(socket_path),
+  _binary(binary)
+{
+  pthread_key_create(&_thread_client, free_client);
+}
+
+UnixSocketMemcachedStore::~UnixSocketMemcachedStore()
+{
+  // This frees the calling thread's connection. Any other threads that used
+  // the store must have exited already.
+  free_client(pthread_getspecific(_thread_client));
+  pthread_key_delete(_thread_client);
+}
+
+Store::Status UnixSocketMemcachedStore::get_data(const std::string& table,
+                                                 const std::string& key,
+                                                 std::string& data,
+                                                 uint64_t& cas,
+                                                 SAS::TrailId trail)
+{
+  MemcachedValue value;
+  memcached_return_t rc = memcached_get_value(get_client(),
+                                              qualified_key(table, key),
+                                              value,
+                                              cas);
+
+  if (rc == MEMCACHED_NOTFOUND)
+  {
+    return Status::NOT_FOUND;
+  }
+  else if (!memcached_success(rc))
+  {
+    return Status::ERROR;
+  }
+  else if (value.empty())
+  {
+    // The key has been deleted and this is its tombstone.
+    return Status::NOT_FOUND;
+  }
+
+  data = value.str();
+  return Status::OK;
+}
+
+Store::Status UnixSocketMemcachedStore::set_data(const std::string& table,
+                                                 const std::string& key,
+                                                 const std::string& data,
+                                                 uint64_t cas,
+                                                 int expiry,
+                                                 SAS::TrailId trail)
+{
+  std::string fq = qualified_key(table, key);
+  memcached_return_t rc;
+
+  if (cas == 0)
+  {
+    rc = memcached_add(get_client(),
+                       fq.c_str(),
+                       fq.length(),
+                       data.c_str(),
+                       data.length(),
+                       expiry,
+                       0);
+  }
+  else
+  {
+    rc = memcached_cas(get_client(),
+                       fq.c_str(),
+                       fq.length(),
+                       data.c_str(),
+                       data.length(),
+                       expiry,
+                       0,
+                       cas);
+  }
+
+  if (memcached_success(rc))
+  {
+    return Status::OK;
+  }
+  else if ((rc == MEMCACHED_NOTSTORED) ||
+           (rc == MEMCACHED_DATA_EXISTS) ||
+           (rc == MEMCACHED_NOTFOUND))
+  {
+    // Someone else has written (or deleted) the key since it was read.
+    return Status::DATA_CONTENTION;
+  }
+
+  return Status::ERROR;
+}
+
+Store::Status UnixSocketMemcachedStore::delete_data(const std::string& table,
+                                                    const std::string& key,
+                                                    SAS::TrailId trail)
+{
+  std::string fq = qualified_key(table, key);
+  memcached_return_t rc = memcached_delete(get_client(), fq.c_str(), fq.length(), 0);
+
+  return ((memcached_success(rc)) || (rc == MEMCACHED_NOTFOUND)) ?
+         Status::OK : Status::ERROR;
+}
+
+memcached_st* UnixSocketMemcachedStore::get_client()
+{
+  memcached_st* client = (memcached_st*)pthread_getspecific(_thread_client);
+
+  if (client == NULL)
+  {
+    std::string options("--CONNECT-TIMEOUT=10 --SUPPORT-CAS");
+    client = memcached(options.c_str(), options.length());
+    memcached_behavior_set(client, MEMCACHED_BEHAVIOR_BINARY_PROTOCOL, _binary);
+    memcached_server_add_unix_socket(client, _socket_path.c_str());
+    pthread_setspecific(_thread_client, client);
+  }
+
+  return client;
+}
+
+void UnixSocketMemcachedStore::free_client(void* client)
+{
+  if (client != NULL)
+  {
+    memcached_free((memcached_st*)client);
+  }
+}
@@ -0,0 +1,90 @@
+/**
+ * @file unix_socket_memcached_store.h - a store that talks to a co-located
+ * memcached-protocol server over a Unix domain socket.
+ *
+ * Project Clearwater - IMS in the cloud.
+ * Copyright (C) 2017  Metaswitch Networks Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version, along with the "Special Exception" for use of
+ * the program along with SSL, set forth below. This program is distributed
+ * in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details. You should have received a copy of the GNU General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The author can be reached by email at clearwater@metaswitch.com or by
+ * post at Metaswitch Networks Ltd, 100 Church St, Enfield EN2 6BQ, UK
+ *
+ * Special Exception
+ * Metaswitch Networks Ltd  grants you permission to copy, modify,
+ * propagate, and distribute a work formed by combining OpenSSL with The
+ * Software, or a work derivative of such a combination, even if such
+ * copying, modification, propagation, or distribution would otherwise
+ * violate the terms of the GPL. You must comply with the GPL in all
+ * respects for all of the code used other than OpenSSL.
+ * "OpenSSL" means OpenSSL toolkit software distributed by the OpenSSL
+ * Project and licensed under the OpenSSL Licenses, or a work based on such
+ * software and licensed under the OpenSSL Licenses.
+ * "OpenSSL Licenses" means the OpenSSL License and Original SSLeay License
+ * under which the OpenSSL Project distributes the OpenSSL toolkit software,
+ * as those licenses appear in the file LICENSE-OPENSSL.
+ */
+
+
+
+#ifndef UNIX_SOCKET_MEMCACHED_STORE_H__
+#define UNIX_SOCKET_MEMCACHED_STORE_H__
+
+#include <string>
+#include <pthread.h>
+#include <libmemcached/memcached.h>
+
+#include "store.h"
+
+/// A store that talks to a single co-located memcached-protocol server (e.g.
+/// the local Astaire, or a memcached) over a Unix domain socket, rather than
+/// loopback TCP. It has the same semantics as TopologyNeutralMemcachedStore
+/// talking to that server: a write with a CAS of 0 only succeeds if the key
+/// doesn't exist, and an empty value (a tombstone) reads as NOT_FOUND.
+///
+/// Each thread uses its own connection, which is opened on first use.
+class UnixSocketMemcachedStore : public Store
+{
+public:
+  UnixSocketMemcachedStore(const std::string& socket_path, bool binary = true);
+  virtual ~UnixSocketMemcachedStore();
+
+  virtual Status get_data(const std::string& table,
+                          const std::string& key,
+                          std::string& data,
+                          uint64_t& cas,
+                          SAS::TrailId trail = 0);
+
+  virtual Status set_data(const std::string& table,
+                          const std::string& key,
+                          const std::string& data,
+                          uint64_t cas,
+                          int expiry,
+                          SAS::TrailId trail = 0);
+
+  virtual Status delete_data(const std::string& table,
+                             const std::string& key,
+                             SAS::TrailId trail = 0);
+
+private:
+  /// Get the calling thread's connection, opening it if necessary.
+  memcached_st* get_client();
+
+  static void free_client(void* client);
+
+  std::string _socket_path;
+  bool _binary;
+  pthread_key_t _thread_client;
+};
+
+#endif